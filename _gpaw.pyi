@@ -29,10 +29,14 @@ class Communicator:
 def add_to_density(f: float,
                    psit: np.ndarray,
                    density: np.ndarray) -> None: ...
+def add_to_density_batch(f_n: np.ndarray,
+                         psit_nR: np.ndarray,
+                         nt_R: np.ndarray) -> None: ...
 def pw_insert(coef_G: np.ndarray,
               Q_G: np.ndarray,
               s: float,
-              array_Q: np.ndarray) -> None: ...
+              array_Q: np.ndarray,
+              hermitian: bool = ...) -> None: ...
 def pblas_tran(N: int, M: int,
                alpha: float, a_MN: np.ndarray,
                beta:float, c_NM: np.ndarray,
@@ -55,7 +59,7 @@ def GG_shuffle(G_G: np.ndarray,
                tmp_GG: np.ndarray) -> None: ...
 def pw_precond(G2_G: np.ndarray,
                r_G: np.ndarray,
-               ekin: float,
+               ekin: float | np.ndarray,
                o_G: np.ndarray) -> None: ...
 def evaluate_mpa_poly(x2_GG: np.ndarray,
                       omega: float,
@@ -28,19 +28,25 @@ PyObject* craypat_region_end(PyObject *self, PyObject *args);
 #endif
 
 PyObject* evaluate_mpa_poly(PyObject *self, PyObject *args);
+PyObject* evaluate_mpa_poly_batch(PyObject *self, PyObject *args);
 
 PyObject* symmetrize(PyObject *self, PyObject *args);
 PyObject* symmetrize_ft(PyObject *self, PyObject *args);
+PyObject* symmetrize_gather(PyObject *self, PyObject *args);
 PyObject* symmetrize_wavefunction(PyObject *self, PyObject *args);
 PyObject* symmetrize_return_index(PyObject *self, PyObject *args);
 PyObject* symmetrize_with_index(PyObject *self, PyObject *args);
 PyObject* map_k_points(PyObject *self, PyObject *args);
 PyObject* GG_shuffle(PyObject *self, PyObject *args);
+PyObject* GG_shuffle_batch(PyObject *self, PyObject *args);
 PyObject* tetrahedron_weight(PyObject *self, PyObject *args);
+PyObject* tetrahedron_weight_batch(PyObject *self, PyObject *args);
 #ifndef GPAW_WITHOUT_BLAS
 PyObject* mmm(PyObject *self, PyObject *args);
 PyObject* rk(PyObject *self, PyObject *args);
 PyObject* r2k(PyObject *self, PyObject *args);
+PyObject* pwlfc_integrate(PyObject *self, PyObject *args);
+PyObject* pwlfc_add(PyObject *self, PyObject *args);
 #endif
 PyObject* NewOperatorObject(PyObject *self, PyObject *args);
 PyObject* NewWOperatorObject(PyObject *self, PyObject *args);
@@ -48,14 +54,19 @@ PyObject* NewSplineObject(PyObject *self, PyObject *args);
 PyObject* NewTransformerObject(PyObject *self, PyObject *args);
 PyObject* pc_potential(PyObject *self, PyObject *args);
 PyObject* add_to_density(PyObject *self, PyObject *args);
+PyObject* add_to_density_batch(PyObject *self, PyObject *args);
 PyObject* utilities_gaussian_wave(PyObject *self, PyObject *args);
 PyObject* pack(PyObject *self, PyObject *args);
 PyObject* unpack(PyObject *self, PyObject *args);
 PyObject* unpack_complex(PyObject *self, PyObject *args);
+PyObject* pack_many(PyObject *self, PyObject *args);
+PyObject* unpack_many(PyObject *self, PyObject *args);
+PyObject* packed_dot(PyObject *self, PyObject *args);
 PyObject* hartree(PyObject *self, PyObject *args);
 PyObject* integrate_outwards(PyObject *self, PyObject *args);
 PyObject* integrate_inwards(PyObject *self, PyObject *args);
 PyObject* localize(PyObject *self, PyObject *args);
+PyObject* localize_parallel(PyObject *self, PyObject *args);
 PyObject* NewXCFunctionalObject(PyObject *self, PyObject *args);
 #ifndef GPAW_WITHOUT_LIBXC
 PyObject* NewlxcXCFunctionalObject(PyObject *self, PyObject *args);
@@ -64,13 +75,17 @@ PyObject* lxcXCFuncNum(PyObject *self, PyObject *args);
 PyObject* exterior_electron_density_region(PyObject *self, PyObject *args);
 PyObject* plane_wave_grid(PyObject *self, PyObject *args);
 PyObject* tci_overlap(PyObject *self, PyObject *args);
+PyObject* tci_overlap_many(PyObject *self, PyObject *args);
 PyObject *pwlfc_expand(PyObject *self, PyObject *args);
 PyObject *pw_insert(PyObject *self, PyObject *args);
 PyObject *pw_precond(PyObject *self, PyObject *args);
 PyObject *fd_precond(PyObject *self, PyObject *args);
 PyObject* vdw(PyObject *self, PyObject *args);
+PyObject* vdw_cells(PyObject *self, PyObject *args);
 PyObject* vdw2(PyObject *self, PyObject *args);
+PyObject* vdw2_batch(PyObject *self, PyObject *args);
 PyObject* spherical_harmonics(PyObject *self, PyObject *args);
+PyObject* solid_harmonics(PyObject *self, PyObject *args);
 PyObject* spline_to_grid(PyObject *self, PyObject *args);
 PyObject* NewLFCObject(PyObject *self, PyObject *args);
 #ifdef PARALLEL
@@ -119,9 +134,13 @@ PyObject* pyelpa_deallocate(PyObject *self, PyObject *args);
 #endif // GPAW_WITH_SL and PARALLEL
 
 #ifdef GPAW_WITH_FFTW
-PyObject * FFTWPlan(PyObject *self, PyObject *args);
-PyObject * FFTWExecute(PyObject *self, PyObject *args);
-PyObject * FFTWDestroy(PyObject *self, PyObject *args);
+PyObject * NewFFTWPlanObject(PyObject *self, PyObject *args);
+PyObject * NewFFTWSphereBoxObject(PyObject *self, PyObject *args);
+PyObject * NewFFTWSpherePlanObject(PyObject *self, PyObject *args);
+PyObject * FFTWImportWisdom(PyObject *self, PyObject *args);
+PyObject * FFTWExportWisdom(PyObject *self, PyObject *args);
+PyObject * FFTWNewWisdom(PyObject *self, PyObject *args);
+PyObject * FFTWForgetWisdom(PyObject *self, PyObject *args);
 #endif
 
 // Threading
@@ -198,24 +217,31 @@ PyObject* calculate_residual_gpu(PyObject* self, PyObject* args);
 
 static PyMethodDef functions[] = {
     {"evaluate_mpa_poly", evaluate_mpa_poly, METH_VARARGS, 0},
+    {"evaluate_mpa_poly_batch", evaluate_mpa_poly_batch, METH_VARARGS, 0},
     {"symmetrize", symmetrize, METH_VARARGS, 0},
     {"symmetrize_ft", symmetrize_ft, METH_VARARGS, 0},
+    {"symmetrize_gather", symmetrize_gather, METH_VARARGS, 0},
     {"symmetrize_wavefunction", symmetrize_wavefunction, METH_VARARGS, 0},
     {"symmetrize_return_index", symmetrize_return_index, METH_VARARGS, 0},
     {"symmetrize_with_index", symmetrize_with_index, METH_VARARGS, 0},
     {"map_k_points", map_k_points, METH_VARARGS, 0},
     {"GG_shuffle", GG_shuffle, METH_VARARGS, 0},
+    {"GG_shuffle_batch", GG_shuffle_batch, METH_VARARGS, 0},
     {"tetrahedron_weight", tetrahedron_weight, METH_VARARGS, 0},
+    {"tetrahedron_weight_batch", tetrahedron_weight_batch, METH_VARARGS, 0},
 #ifndef GPAW_WITHOUT_BLAS
     {"mmm", mmm, METH_VARARGS, 0},
     {"rk",  rk,  METH_VARARGS, 0},
     {"r2k", r2k, METH_VARARGS, 0},
+    {"pwlfc_integrate", pwlfc_integrate, METH_VARARGS, 0},
+    {"pwlfc_add", pwlfc_add, METH_VARARGS, 0},
 #endif
     {"Operator", NewOperatorObject, METH_VARARGS, 0},
     {"WOperator", NewWOperatorObject, METH_VARARGS, 0},
     {"Spline", NewSplineObject, METH_VARARGS, 0},
     {"Transformer", NewTransformerObject, METH_VARARGS, 0},
     {"add_to_density", add_to_density, METH_VARARGS, 0},
+    {"add_to_density_batch", add_to_density_batch, METH_VARARGS, 0},
     {"utilities_gaussian_wave", utilities_gaussian_wave, METH_VARARGS, 0},
     {"eed_region", exterior_electron_density_region, METH_VARARGS, 0},
     {"plane_wave_grid", plane_wave_grid, METH_VARARGS, 0},
@@ -226,19 +252,27 @@ static PyMethodDef functions[] = {
     {"pack", pack, METH_VARARGS, 0},
     {"unpack", unpack, METH_VARARGS, 0},
     {"unpack_complex", unpack_complex,           METH_VARARGS, 0},
+    {"pack_many", pack_many, METH_VARARGS, 0},
+    {"unpack_many", unpack_many, METH_VARARGS, 0},
+    {"packed_dot", packed_dot, METH_VARARGS, 0},
     {"hartree", hartree, METH_VARARGS, 0},
     {"integrate_outwards", integrate_outwards, METH_VARARGS, 0},
     {"integrate_inwards", integrate_inwards, METH_VARARGS, 0},
     {"localize", localize, METH_VARARGS, 0},
+    {"localize_parallel", localize_parallel, METH_VARARGS, 0},
     {"XCFunctional", NewXCFunctionalObject, METH_VARARGS, 0},
 #ifndef GPAW_WITHOUT_LIBXC
     {"lxcXCFunctional", NewlxcXCFunctionalObject, METH_VARARGS, 0},
     {"lxcXCFuncNum", lxcXCFuncNum, METH_VARARGS, 0},
 #endif
     {"tci_overlap", tci_overlap, METH_VARARGS, 0},
+    {"tci_overlap_many", tci_overlap_many, METH_VARARGS, 0},
     {"vdw", vdw, METH_VARARGS, 0},
+    {"vdw_cells", vdw_cells, METH_VARARGS, 0},
     {"vdw2", vdw2, METH_VARARGS, 0},
+    {"vdw2_batch", vdw2_batch, METH_VARARGS, 0},
     {"spherical_harmonics", spherical_harmonics, METH_VARARGS, 0},
+    {"solid_harmonics", solid_harmonics, METH_VARARGS, 0},
     {"pc_potential", pc_potential, METH_VARARGS, 0},
     {"spline_to_grid", spline_to_grid, METH_VARARGS, 0},
     {"LFC", NewLFCObject, METH_VARARGS, 0},
@@ -291,9 +325,13 @@ static PyMethodDef functions[] = {
 #endif // GPAW_WITH_ELPA
 #endif // GPAW_WITH_SL && PARALLEL
 #ifdef GPAW_WITH_FFTW
-    {"FFTWPlan", FFTWPlan, METH_VARARGS, 0},
-    {"FFTWExecute", FFTWExecute, METH_VARARGS, 0},
-    {"FFTWDestroy", FFTWDestroy, METH_VARARGS, 0},
+    {"FFTWPlan", NewFFTWPlanObject, METH_VARARGS, 0},
+    {"FFTWSphereBox", NewFFTWSphereBoxObject, METH_VARARGS, 0},
+    {"FFTWSpherePlan", NewFFTWSpherePlanObject, METH_VARARGS, 0},
+    {"FFTWImportWisdom", FFTWImportWisdom, METH_VARARGS, 0},
+    {"FFTWExportWisdom", FFTWExportWisdom, METH_VARARGS, 0},
+    {"FFTWNewWisdom", FFTWNewWisdom, METH_VARARGS, 0},
+    {"FFTWForgetWisdom", FFTWForgetWisdom, METH_VARARGS, 0},
 #endif
 #ifdef GPAW_HPM
     {"hpm_start", ibm_hpm_start, METH_VARARGS, 0},
@@ -365,6 +403,7 @@ static PyMethodDef functions[] = {
 #ifdef PARALLEL
 extern PyTypeObject MPIType;
 extern PyTypeObject GPAW_MPI_Request_type;
+extern PyTypeObject GPAW_MPI_Window_type;
 #endif
 
 extern PyTypeObject LFCType;
@@ -373,6 +412,11 @@ extern PyTypeObject WOperatorType;
 extern PyTypeObject SplineType;
 extern PyTypeObject TransformerType;
 extern PyTypeObject XCFunctionalType;
+#ifdef GPAW_WITH_FFTW
+extern PyTypeObject FFTWPlanType;
+extern PyTypeObject FFTWSphereBoxType;
+extern PyTypeObject FFTWSpherePlanType;
+#endif
 #ifndef GPAW_WITHOUT_LIBXC
 extern PyTypeObject lxcXCFunctionalType;
 #endif
@@ -397,6 +441,8 @@ static PyObject* moduleinit(void)
         return NULL;
     if (PyType_Ready(&GPAW_MPI_Request_type) < 0)
         return NULL;
+    if (PyType_Ready(&GPAW_MPI_Window_type) < 0)
+        return NULL;
 #endif
 
     if (PyType_Ready(&LFCType) < 0)
@@ -411,6 +457,14 @@ static PyObject* moduleinit(void)
         return NULL;
     if (PyType_Ready(&XCFunctionalType) < 0)
         return NULL;
+#ifdef GPAW_WITH_FFTW
+    if (PyType_Ready(&FFTWPlanType) < 0)
+        return NULL;
+    if (PyType_Ready(&FFTWSphereBoxType) < 0)
+        return NULL;
+    if (PyType_Ready(&FFTWSpherePlanType) < 0)
+        return NULL;
+#endif
 #ifndef GPAW_WITHOUT_LIBXC
     if (PyType_Ready(&lxcXCFunctionalType) < 0)
         return NULL;
@@ -424,6 +478,7 @@ static PyObject* moduleinit(void)
 #ifdef PARALLEL
     Py_INCREF(&MPIType);
     Py_INCREF(&GPAW_MPI_Request_type);
+    Py_INCREF(&GPAW_MPI_Window_type);
     PyModule_AddObject(m, "Communicator", (PyObject *)&MPIType);
 #endif
 
@@ -458,6 +513,11 @@ static PyObject* moduleinit(void)
     Py_INCREF(&SplineType);
     Py_INCREF(&TransformerType);
     Py_INCREF(&XCFunctionalType);
+#ifdef GPAW_WITH_FFTW
+    Py_INCREF(&FFTWPlanType);
+    Py_INCREF(&FFTWSphereBoxType);
+    Py_INCREF(&FFTWSpherePlanType);
+#endif
 #ifndef GPAW_WITHOUT_LIBXC
     Py_INCREF(&lxcXCFunctionalType);
 #endif
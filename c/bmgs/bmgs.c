@@ -10,6 +10,7 @@
 #include "zero.c"
 #include "paste.c"
 #include "spline.c"
+#include "solid_harmonics.c"
 #include "stencils.c"
 #include "restrict.c"
 #include "translate.c"
@@ -56,6 +56,9 @@ double bmgs_splinevalue(const bmgsspline* spline, double r);
 void bmgs_get_value_and_derivative(const bmgsspline* spline, double r,
            double *f, double *dfdr);
 void bmgs_deletespline(bmgsspline* spline);
+void bmgs_solid_harmonics(int lmax, int n,
+                          const double* x, const double* y, const double* z,
+                          long stride, double* Y, double* dY);
 void bmgs_fd(const bmgsstencil* s, const double* a, double* b);
 void bmgs_wfd(int nweights, const bmgsstencil* stencils, const double** weights, const double* a, double* b);
 void bmgs_relax(const int relax_method, const bmgsstencil* s, double* a, double* b,
@@ -0,0 +1,143 @@
+/*  Copyright (C) 2026  CAMd
+ *  Please see the accompanying LICENSE file for further information. */
+
+#include <math.h>
+#include "bmgs.h"
+
+// Real solid harmonics r^l Y_lm for all l <= lmax and n points.
+//
+// Coordinates are given as three arrays (x, y, z) and the results are
+// stored as rows: Y[L * stride + i] with L = l^2 + l + m.  If dY is
+// not NULL, the gradients are stored in dY[(v * nL + L) * stride + i]
+// with nL = (lmax + 1)^2.  The harmonics are generated with the
+// standard recurrences for Racah normalized real solid harmonics
+// (Helgaker, Jorgensen and Olsen, eqs. 6.4.70-73), but without the
+// Condon-Shortley phase and with the normalization folded into the
+// coefficients, so that the results are identical to the YL table in
+// gpaw/spherical_harmonics.py.
+void bmgs_solid_harmonics(int lmax, int n,
+                          const double* x, const double* y, const double* z,
+                          long stride, double* Y, double* dY)
+{
+  long nL = (lmax + 1) * (lmax + 1);
+  double* dxY = dY;
+  double* dyY = dY + nL * stride;
+  double* dzY = dY + 2 * nL * stride;
+  const double c0 = 0.28209479177387814;  // (4 pi)^(-1/2)
+#pragma omp simd
+  for (int i = 0; i < n; i++)
+    Y[i] = c0;
+  if (dY != NULL)
+#pragma omp simd
+    for (int i = 0; i < n; i++)
+      dxY[i] = dyY[i] = dzY[i] = 0.0;
+  if (lmax == 0)
+    return;
+
+  const double c1 = sqrt(3.0) * c0;
+#pragma omp simd
+  for (int i = 0; i < n; i++)
+    {
+      Y[stride + i] = c1 * y[i];
+      Y[2 * stride + i] = c1 * z[i];
+      Y[3 * stride + i] = c1 * x[i];
+    }
+  if (dY != NULL)
+    for (int L = 1; L < 4; L++)
+#pragma omp simd
+      for (int i = 0; i < n; i++)
+        {
+          dxY[L * stride + i] = (L == 3) * c1;
+          dyY[L * stride + i] = (L == 1) * c1;
+          dzY[L * stride + i] = (L == 2) * c1;
+        }
+
+  for (int l = 1; l < lmax; l++)
+    {
+      long L0 = (l - 1) * l;            // L for (l - 1, 0)
+      long L1 = l * (l + 1);            // L for (l, 0)
+      long L2 = (l + 1) * (l + 2);      // L for (l + 1, 0)
+      double Nl = sqrt(2 * l + 1.0);
+      double N2 = sqrt(2 * l + 3.0);
+
+      // m = +/-(l + 1):
+      double f = sqrt((2 * l + 1.0) / (2 * l + 2.0)) * N2 / Nl;
+      const double* C = Y + (L1 + l) * stride;
+      const double* S = Y + (L1 - l) * stride;
+      double* Cp = Y + (L2 + l + 1) * stride;
+      double* Sp = Y + (L2 - l - 1) * stride;
+#pragma omp simd
+      for (int i = 0; i < n; i++)
+        {
+          Cp[i] = f * (x[i] * C[i] - y[i] * S[i]);
+          Sp[i] = f * (y[i] * C[i] + x[i] * S[i]);
+        }
+      if (dY != NULL)
+        {
+          long c = (L1 + l) * stride;
+          long s = (L1 - l) * stride;
+          long cp = (L2 + l + 1) * stride;
+          long sp = (L2 - l - 1) * stride;
+#pragma omp simd
+          for (int i = 0; i < n; i++)
+            {
+              dxY[cp + i] = f * (C[i] + x[i] * dxY[c + i] -
+                                 y[i] * dxY[s + i]);
+              dyY[cp + i] = f * (-S[i] + x[i] * dyY[c + i] -
+                                 y[i] * dyY[s + i]);
+              dzY[cp + i] = f * (x[i] * dzY[c + i] - y[i] * dzY[s + i]);
+              dxY[sp + i] = f * (S[i] + y[i] * dxY[c + i] +
+                                 x[i] * dxY[s + i]);
+              dyY[sp + i] = f * (C[i] + y[i] * dyY[c + i] +
+                                 x[i] * dyY[s + i]);
+              dzY[sp + i] = f * (y[i] * dzY[c + i] + x[i] * dzY[s + i]);
+            }
+        }
+
+      // |m| <= l:
+      for (int m = -l; m <= l; m++)
+        {
+          int am = abs(m);
+          double d = sqrt((l + am + 1.0) * (l - am + 1.0));
+          double a = (2 * l + 1) / d * N2 / Nl;
+          double b = sqrt((l + am) * (l - am) * 1.0) / d * N2 /
+            sqrt(2 * l - 1.0);
+          long p = (L2 + m) * stride;
+          long q = (L1 + m) * stride;
+          long r = (L0 + m) * stride;
+          if (am == l)
+            {
+#pragma omp simd
+              for (int i = 0; i < n; i++)
+                Y[p + i] = a * z[i] * Y[q + i];
+              if (dY != NULL)
+#pragma omp simd
+                for (int i = 0; i < n; i++)
+                  {
+                    dxY[p + i] = a * z[i] * dxY[q + i];
+                    dyY[p + i] = a * z[i] * dyY[q + i];
+                    dzY[p + i] = a * (Y[q + i] + z[i] * dzY[q + i]);
+                  }
+              continue;
+            }
+#pragma omp simd
+          for (int i = 0; i < n; i++)
+            {
+              double r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+              Y[p + i] = a * z[i] * Y[q + i] - b * r2 * Y[r + i];
+            }
+          if (dY != NULL)
+#pragma omp simd
+            for (int i = 0; i < n; i++)
+              {
+                double r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+                dxY[p + i] = (a * z[i] * dxY[q + i] -
+                              b * (2 * x[i] * Y[r + i] + r2 * dxY[r + i]));
+                dyY[p + i] = (a * z[i] * dyY[q + i] -
+                              b * (2 * y[i] * Y[r + i] + r2 * dyY[r + i]));
+                dzY[p + i] = (a * (Y[q + i] + z[i] * dzY[q + i]) -
+                              b * (2 * z[i] * Y[r + i] + r2 * dzY[r + i]));
+              }
+        }
+    }
+}
@@ -5,9 +5,106 @@
 #define NO_IMPORT_ARRAY
 #include <numpy/arrayobject.h>
 #include <fftw3.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-/* Create plan and return pointer to plan as a string */
-PyObject * FFTWPlan(PyObject *self, PyObject *args)
+// Set when a plan could not be created from wisdom alone:
+static int new_wisdom = 0;
+
+#ifdef GPAW_FFTW_THREADS
+static int threads_initialized = 0;
+#endif
+
+/* Prepare the planner for a new plan.
+
+   With GPAW_FFTW_THREADS, plans use as many threads as OpenMP would. */
+static void planner_setup(void)
+{
+#ifdef GPAW_FFTW_THREADS
+    if (!threads_initialized) {
+        fftw_init_threads();
+        threads_initialized = 1;
+    }
+#ifdef _OPENMP
+    fftw_plan_with_nthreads(omp_get_max_threads());
+#else
+    fftw_plan_with_nthreads(1);
+#endif
+#endif
+}
+
+/* Create plan p with the expression call that uses the local variable
+   flags.  The plan is first tried from wisdom alone so that we know
+   when new wisdom has been accumulated and should be exported. */
+#define PLAN(p, call)                                   \
+    do {                                                \
+        unsigned int flags0 = flags;                    \
+        p = NULL;                                       \
+        if (!(flags0 & FFTW_ESTIMATE)) {                \
+            flags = flags0 | FFTW_WISDOM_ONLY;          \
+            p = call;                                   \
+            flags = flags0;                             \
+            if (p == NULL)                              \
+                new_wisdom = 1;                         \
+        }                                               \
+        if (p == NULL)                                  \
+            p = call;                                   \
+    } while (0)
+
+
+typedef struct
+{
+    PyObject_HEAD
+    fftw_plan plan;
+    PyObject* in;   // the plan is only valid as long as these are alive
+    PyObject* out;
+} FFTWPlanObject;
+
+
+static void FFTWPlan_dealloc(FFTWPlanObject *self)
+{
+    if (self->plan)
+        fftw_destroy_plan(self->plan);
+    Py_XDECREF(self->in);
+    Py_XDECREF(self->out);
+    PyObject_DEL(self);
+}
+
+
+static PyObject* FFTWPlan_execute(FFTWPlanObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ""))
+        return NULL;
+    fftw_execute(self->plan);
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef FFTWPlan_Methods[] = {
+    {"execute", (PyCFunction)FFTWPlan_execute, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+
+PyTypeObject FFTWPlanType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "FFTWPlan",
+    sizeof(FFTWPlanObject),
+    0,
+    (destructor)FFTWPlan_dealloc,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,
+    "FFTW plan object",
+    0, 0, 0, 0, 0, 0,
+    FFTWPlan_Methods
+};
+
+
+/* Create plan for a 3D transform between two arrays */
+PyObject * NewFFTWPlanObject(PyObject *self, PyObject *args)
 {
     PyArrayObject* in;
     PyArrayObject* out;
@@ -17,8 +114,6 @@ PyObject * FFTWPlan(PyObject *self, PyObject *args)
                           &in, &out, &sign, &flags))
         return NULL;
 
-    fftw_plan* plan = (fftw_plan*)malloc(sizeof(fftw_plan));
-
     int ndim = PyArray_NDIM(in);
     int dims_in[ndim];
     int dims_out[ndim];
@@ -32,46 +127,852 @@ PyObject * FFTWPlan(PyObject *self, PyObject *args)
         dims_out[i] = (int)PyArray_DIMS(out)[i];
     }
 
+    fftw_plan plan;
+    planner_setup();
     if (PyArray_DESCR(in)->type_num == NPY_DOUBLE) {
-        *plan = fftw_plan_dft_r2c(ndim, dims_in,
-                                  (double *)indata,
-                                  (fftw_complex *)outdata,
-                                  flags);
+        PLAN(plan, fftw_plan_dft_r2c(ndim, dims_in,
+                                     (double *)indata,
+                                     (fftw_complex *)outdata,
+                                     flags));
     } else if (PyArray_DESCR(out)->type_num == NPY_DOUBLE) {
-        *plan = fftw_plan_dft_c2r(ndim, dims_out,
-                                  (fftw_complex *)indata,
-                                  (double *)outdata,
-                                  flags);
+        PLAN(plan, fftw_plan_dft_c2r(ndim, dims_out,
+                                     (fftw_complex *)indata,
+                                     (double *)outdata,
+                                     flags));
     } else {
-        *plan = fftw_plan_dft(ndim, dims_out,
-                              (fftw_complex *)indata,
-                              (fftw_complex *)outdata,
-                              sign, flags);
+        PLAN(plan, fftw_plan_dft(ndim, dims_out,
+                                 (fftw_complex *)indata,
+                                 (fftw_complex *)outdata,
+                                 sign, flags));
+    }
+    if (plan == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "FFTW planning failed");
+        return NULL;
+    }
+
+    FFTWPlanObject* obj = PyObject_NEW(FFTWPlanObject, &FFTWPlanType);
+    if (obj == NULL) {
+        fftw_destroy_plan(plan);
+        return NULL;
+    }
+    obj->plan = plan;
+    Py_INCREF(in);
+    Py_INCREF(out);
+    obj->in = (PyObject*)in;
+    obj->out = (PyObject*)out;
+    return (PyObject*)obj;
+}
+
+
+/* Import wisdom from a string.  Returns True on success. */
+PyObject * FFTWImportWisdom(PyObject *self, PyObject *args)
+{
+    const char* wisdom;
+    if (!PyArg_ParseTuple(args, "s", &wisdom))
+        return NULL;
+    return PyBool_FromLong(fftw_import_wisdom_from_string(wisdom));
+}
+
+
+/* Export accumulated wisdom as a string. */
+PyObject * FFTWExportWisdom(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ""))
+        return NULL;
+    char* wisdom = fftw_export_wisdom_to_string();
+    if (wisdom == NULL)
+        return PyErr_NoMemory();
+    PyObject* result = PyUnicode_FromString(wisdom);
+    free(wisdom);
+    new_wisdom = 0;
+    return result;
+}
+
+
+/* Has new wisdom been created since the last export? */
+PyObject * FFTWNewWisdom(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ""))
+        return NULL;
+    return PyBool_FromLong(new_wisdom);
+}
+
+
+PyObject * FFTWForgetWisdom(PyObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ""))
+        return NULL;
+    fftw_forget_wisdom();
+    new_wisdom = 0;
+    Py_RETURN_NONE;
+}
+
+
+/* Batched transforms between plane-wave spheres and real-space boxes.
+
+   A block of nb bands is transformed at a time.  Only 1D lines
+   ("sticks") that contain sphere coefficients take part in the first
+   (last for forward transforms) pass and only planes crossed by sticks
+   take part in the middle pass.  For complex wave functions the sticks
+   run along axis 2 and the planes are selected along axis 0.  For real
+   wave functions the last axis is the half-complex one, so the sticks
+   run along axis 0 and the planes are selected along axis 2.
+
+   The work buffers and the FFTW plans belong to an FFTWSphereBox that
+   is shared by all spheres (k-points) with the same box shape, dtype
+   and block size.  A sphere plan only has its own index tables.
+
+   Buffers (all fftw_malloc'ed and owned by the box):
+
+     S: nb x nQ          sticks (a sphere uses nb x nst x ns)
+     X: nb x nQ          box that is zero outside sticks
+     Y: nb x nQ          work box (result box for complex transforms)
+     R: nb x nR          real-space result (real transforms only)
+*/
+typedef struct
+{
+    PyObject_HEAD
+    int real;
+    int nb;
+    int N[3];
+    int M2;             // N[2] or N[2] / 2 + 1
+    int nQ;             // N[0] * N[1] * M2
+    int nR;             // N[0] * N[1] * N[2]
+    unsigned int flags;
+    double* S;
+    double* X;
+    double* Y;
+    double* R;
+    fftw_plan last_b;
+    fftw_plan last_f;
+    // Stick plans for each number of sticks seen so far:
+    int nsticks;
+    int* sticks_nst;
+    fftw_plan* sticks_b;
+    fftw_plan* sticks_f;
+    // Middle-pass plans for each run of planes seen so far:
+    int nmid;
+    int* mid_start;
+    int* mid_len;
+    fftw_plan* mid_b;
+    fftw_plan* mid_f;
+    const void* owner;  // sphere plan whose sticks are in X
+} FFTWSphereBoxObject;
+
+
+static void FFTWSphereBox_dealloc(FFTWSphereBoxObject* box)
+{
+    for (int i = 0; i < box->nsticks; i++) {
+        fftw_destroy_plan(box->sticks_b[i]);
+        fftw_destroy_plan(box->sticks_f[i]);
+    }
+    for (int i = 0; i < box->nmid; i++) {
+        fftw_destroy_plan(box->mid_b[i]);
+        fftw_destroy_plan(box->mid_f[i]);
+    }
+    if (box->last_b)
+        fftw_destroy_plan(box->last_b);
+    if (box->last_f)
+        fftw_destroy_plan(box->last_f);
+    free(box->sticks_nst);
+    free(box->sticks_b);
+    free(box->sticks_f);
+    free(box->mid_start);
+    free(box->mid_len);
+    free(box->mid_b);
+    free(box->mid_f);
+    fftw_free(box->S);
+    fftw_free(box->X);
+    fftw_free(box->Y);
+    fftw_free(box->R);
+    PyObject_DEL(box);
+}
+
+
+PyTypeObject FFTWSphereBoxType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "FFTWSphereBox",
+    sizeof(FFTWSphereBoxObject),
+    0,
+    (destructor)FFTWSphereBox_dealloc,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,
+    "Work buffers and plans shared by batched sphere transforms",
+    0, 0, 0, 0, 0, 0,
+    0
+};
+
+
+/* Create work buffers for batched sphere transforms.
+
+   size_c: (N0, N1, N2).
+   nb: number of bands transformed together.
+   real: transform between half-complex box and real grid.
+*/
+PyObject * NewFFTWSphereBoxObject(PyObject *self, PyObject *args)
+{
+    int N0, N1, N2;
+    int nb;
+    int real;
+    unsigned int flags;
+    if (!PyArg_ParseTuple(args, "(iii)iiI", &N0, &N1, &N2, &nb, &real,
+                          &flags))
+        return NULL;
+
+    FFTWSphereBoxObject* box = PyObject_NEW(FFTWSphereBoxObject,
+                                            &FFTWSphereBoxType);
+    if (box == NULL)
+        return NULL;
+    // Clear everything after the object header:
+    memset((char*)box + sizeof(PyObject), 0,
+           sizeof(FFTWSphereBoxObject) - sizeof(PyObject));
+    box->real = real;
+    box->nb = nb;
+    box->N[0] = N0;
+    box->N[1] = N1;
+    box->N[2] = N2;
+    int M2 = real ? N2 / 2 + 1 : N2;
+    box->M2 = M2;
+    int nQ = N0 * N1 * M2;
+    int nR = N0 * N1 * N2;
+    box->nQ = nQ;
+    box->nR = nR;
+    box->flags = flags;
+
+    box->S = fftw_malloc(2 * sizeof(double) * (size_t)nb * nQ);
+    box->X = fftw_malloc(2 * sizeof(double) * (size_t)nb * nQ);
+    box->Y = fftw_malloc(2 * sizeof(double) * (size_t)nb * nQ);
+    if (real)
+        box->R = fftw_malloc(sizeof(double) * (size_t)nb * nR);
+    if (!box->S || !box->X || !box->Y || (real && !box->R)) {
+        Py_DECREF(box);
+        return PyErr_NoMemory();
+    }
+
+    fftw_complex* Y = (fftw_complex*)box->Y;
+    planner_setup();
+    if (real) {
+        fftw_iodim dim = {N2, 1, 1};
+        fftw_iodim hdims_b[2] = {{nb, nQ, nR}, {N0 * N1, M2, N2}};
+        fftw_iodim hdims_f[2] = {{nb, nR, nQ}, {N0 * N1, N2, M2}};
+        PLAN(box->last_b, fftw_plan_guru_dft_c2r(1, &dim, 2, hdims_b,
+                                                 Y, box->R, flags));
+        PLAN(box->last_f, fftw_plan_guru_dft_r2c(1, &dim, 2, hdims_f,
+                                                 box->R, Y, flags));
+    }
+    else {
+        fftw_iodim dim = {N0, N1 * N2, N1 * N2};
+        fftw_iodim hdims[2] = {{nb, nR, nR}, {N1 * N2, 1, 1}};
+        PLAN(box->last_b,
+             fftw_plan_guru_dft(1, &dim, 2, hdims, Y, Y, 1, flags));
+        PLAN(box->last_f,
+             fftw_plan_guru_dft(1, &dim, 2, hdims, Y, Y, -1, flags));
+    }
+    if (!box->last_b || !box->last_f) {
+        Py_DECREF(box);
+        PyErr_SetString(PyExc_RuntimeError, "FFTW planning failed");
+        return NULL;
+    }
+
+    // Planning with FFTW_MEASURE overwrites the arrays, so we plan first
+    // and clear afterwards.
+    if (real)
+        memset(box->R, 0, sizeof(double) * (size_t)nb * nR);
+    return (PyObject*)box;
+}
+
+
+/* Find or create the stick plans for nst sticks. */
+static int box_sticks_plans(FFTWSphereBoxObject* box, int nst,
+                            fftw_plan* b, fftw_plan* f)
+{
+    for (int i = 0; i < box->nsticks; i++)
+        if (box->sticks_nst[i] == nst) {
+            *b = box->sticks_b[i];
+            *f = box->sticks_f[i];
+            return 1;
+        }
+
+    int n = box->nsticks + 1;
+    int* nst_i = realloc(box->sticks_nst, n * sizeof(int));
+    if (nst_i)
+        box->sticks_nst = nst_i;
+    fftw_plan* b_i = realloc(box->sticks_b, n * sizeof(fftw_plan));
+    if (b_i)
+        box->sticks_b = b_i;
+    fftw_plan* f_i = realloc(box->sticks_f, n * sizeof(fftw_plan));
+    if (f_i)
+        box->sticks_f = f_i;
+    if (!nst_i || !b_i || !f_i) {
+        PyErr_NoMemory();
+        return 0;
     }
 
-    return Py_BuildValue("y#", plan, (Py_ssize_t)sizeof(fftw_plan*));
+    int ns = box->real ? box->N[0] : box->N[2];
+    int howmany = box->nb * nst;
+    fftw_complex* S = (fftw_complex*)box->S;
+    unsigned int flags = box->flags;
+    planner_setup();
+    PLAN(*b, fftw_plan_many_dft(1, &ns, howmany,
+                                S, NULL, 1, ns,
+                                S, NULL, 1, ns,
+                                1, flags));
+    PLAN(*f, fftw_plan_many_dft(1, &ns, howmany,
+                                S, NULL, 1, ns,
+                                S, NULL, 1, ns,
+                                -1, flags));
+    box->owner = NULL;
+    if (!*b || !*f) {
+        if (*b)
+            fftw_destroy_plan(*b);
+        if (*f)
+            fftw_destroy_plan(*f);
+        PyErr_SetString(PyExc_RuntimeError, "FFTW planning failed");
+        return 0;
+    }
+    box->sticks_nst[box->nsticks] = nst;
+    box->sticks_b[box->nsticks] = *b;
+    box->sticks_f[box->nsticks] = *f;
+    box->nsticks = n;
+    return 1;
+}
+
+
+/* Find or create the middle-pass plans for a run of planes. */
+static int box_mid_plans(FFTWSphereBoxObject* box, int start, int len,
+                         fftw_plan* b, fftw_plan* f)
+{
+    for (int i = 0; i < box->nmid; i++)
+        if (box->mid_start[i] == start && box->mid_len[i] == len) {
+            *b = box->mid_b[i];
+            *f = box->mid_f[i];
+            return 1;
+        }
+
+    int n = box->nmid + 1;
+    int* start_i = realloc(box->mid_start, n * sizeof(int));
+    if (start_i)
+        box->mid_start = start_i;
+    int* len_i = realloc(box->mid_len, n * sizeof(int));
+    if (len_i)
+        box->mid_len = len_i;
+    fftw_plan* b_i = realloc(box->mid_b, n * sizeof(fftw_plan));
+    if (b_i)
+        box->mid_b = b_i;
+    fftw_plan* f_i = realloc(box->mid_f, n * sizeof(fftw_plan));
+    if (f_i)
+        box->mid_f = f_i;
+    if (!start_i || !len_i || !b_i || !f_i) {
+        PyErr_NoMemory();
+        return 0;
+    }
+
+    int N0 = box->N[0];
+    int N1 = box->N[1];
+    int M2 = box->M2;
+    int nQ = box->nQ;
+    fftw_complex* X = (fftw_complex*)box->X;
+    fftw_complex* Y = (fftw_complex*)box->Y;
+
+    // Transform along axis 1 for a run of planes:
+    fftw_iodim dim = {N1, M2, M2};
+    fftw_iodim hdims[3];
+    hdims[0] = (fftw_iodim){box->nb, nQ, nQ};
+    int offset;
+    if (box->real) {
+        hdims[1] = (fftw_iodim){N0, N1 * M2, N1 * M2};
+        hdims[2] = (fftw_iodim){len, 1, 1};
+        offset = start;
+    }
+    else {
+        hdims[1] = (fftw_iodim){len, N1 * M2, N1 * M2};
+        hdims[2] = (fftw_iodim){M2, 1, 1};
+        offset = start * N1 * M2;
+    }
+    unsigned int flags = box->flags;
+    planner_setup();
+    PLAN(*b, fftw_plan_guru_dft(1, &dim, 3, hdims,
+                                X + offset, Y + offset,
+                                1, flags));
+    PLAN(*f, fftw_plan_guru_dft(1, &dim, 3, hdims,
+                                Y + offset, Y + offset,
+                                -1, flags));
+    box->owner = NULL;
+    if (!*b || !*f) {
+        if (*b)
+            fftw_destroy_plan(*b);
+        if (*f)
+            fftw_destroy_plan(*f);
+        PyErr_SetString(PyExc_RuntimeError, "FFTW planning failed");
+        return 0;
+    }
+    box->mid_start[box->nmid] = start;
+    box->mid_len[box->nmid] = len;
+    box->mid_b[box->nmid] = *b;
+    box->mid_f[box->nmid] = *f;
+    box->nmid = n;
+    return 1;
+}
+
+
+typedef struct
+{
+    PyObject_HEAD
+    FFTWSphereBoxObject* box;
+    int real;
+    int nb;
+    int N[3];
+    int M2;
+    int nG;
+    int nQ;
+    int nR;
+    int ns;             // length of a stick
+    int sstride;        // stride of a stick inside the box
+    int nst;            // number of sticks
+    int* Q_s;           // start of stick in box
+    int* S_G;           // position of coefficient in S
+    int* Smirror_G;     // position of conjugated partner or -1
+    int nruns;
+    int* run_start;     // runs of selected planes
+    int* run_len;
+    // Plans owned by the box:
+    fftw_plan sticks_b;
+    fftw_plan sticks_f;
+    fftw_plan* mid_b;
+    fftw_plan* mid_f;
+} FFTWSpherePlanObject;
+
+
+static void FFTWSpherePlan_dealloc(FFTWSpherePlanObject* sp)
+{
+    if (sp->box) {
+        if (sp->box->owner == sp)
+            sp->box->owner = NULL;
+        Py_DECREF(sp->box);
+    }
+    free(sp->mid_b);
+    free(sp->mid_f);
+    free(sp->Q_s);
+    free(sp->S_G);
+    free(sp->Smirror_G);
+    free(sp->run_start);
+    free(sp->run_len);
+    PyObject_DEL(sp);
+}
+
+
+extern PyTypeObject FFTWSpherePlanType;
+
+
+/* Create plan for batched sphere transforms.
+
+   Q_G: indices into the flattened (N0, N1, M2) box (int32).
+   box: FFTWSphereBox with buffers and plans.
+*/
+PyObject * NewFFTWSpherePlanObject(PyObject *self, PyObject *args)
+{
+    PyArrayObject* Q_G_obj;
+    FFTWSphereBoxObject* box;
+    if (!PyArg_ParseTuple(args, "OO!",
+                          &Q_G_obj, &FFTWSphereBoxType, &box))
+        return NULL;
+
+    FFTWSpherePlanObject* sp = PyObject_NEW(FFTWSpherePlanObject,
+                                            &FFTWSpherePlanType);
+    if (sp == NULL)
+        return NULL;
+    // Clear everything after the object header:
+    memset((char*)sp + sizeof(PyObject), 0,
+           sizeof(FFTWSpherePlanObject) - sizeof(PyObject));
+    Py_INCREF(box);
+    sp->box = box;
+    int real = box->real;
+    int N0 = box->N[0];
+    int N1 = box->N[1];
+    int M2 = box->M2;
+    int nQ = box->nQ;
+    sp->real = real;
+    sp->nb = box->nb;
+    sp->N[0] = N0;
+    sp->N[1] = N1;
+    sp->N[2] = box->N[2];
+    sp->M2 = M2;
+    sp->nQ = nQ;
+    sp->nR = box->nR;
+    int nG = (int)PyArray_SIZE(Q_G_obj);
+    sp->nG = nG;
+    const npy_int32* Q_G = PyArray_DATA(Q_G_obj);
+
+    // Columns are (i0, i1) for complex and (i1, i2) for real transforms;
+    // planes are i0 for complex and i2 for real transforms:
+    int ncols = real ? N1 * M2 : N0 * N1;
+    int nplanes = real ? M2 : N0;
+    sp->ns = real ? N0 : box->N[2];
+    sp->sstride = real ? N1 * M2 : 1;
+    int* s_col = malloc(ncols * sizeof(int));
+    for (int c = 0; c < ncols; c++)
+        s_col[c] = -1;
+
+    for (int G = 0; G < nG; G++) {
+        int Q = Q_G[G];
+        if (Q < 0 || Q >= nQ) {
+            free(s_col);
+            Py_DECREF(sp);
+            PyErr_SetString(PyExc_IndexError, "Q_G out of range");
+            return NULL;
+        }
+        int i0 = Q / (N1 * M2);
+        int i1 = (Q / M2) % N1;
+        int i2 = Q % M2;
+        if (real) {
+            s_col[i1 * M2 + i2] = 0;
+            if (i2 == 0)
+                s_col[((N1 - i1) % N1) * M2] = 0;
+        }
+        else
+            s_col[i0 * N1 + i1] = 0;
+    }
+
+    int nst = 0;
+    for (int c = 0; c < ncols; c++)
+        if (s_col[c] == 0)
+            s_col[c] = nst++;
+    sp->nst = nst;
+    sp->Q_s = malloc(nst * sizeof(int));
+    char* plane_used = calloc(nplanes, 1);
+    for (int c = 0; c < ncols; c++) {
+        int s = s_col[c];
+        if (s < 0)
+            continue;
+        if (real) {
+            sp->Q_s[s] = c;
+            plane_used[c % M2] = 1;
+        }
+        else {
+            sp->Q_s[s] = c * M2;
+            plane_used[c / N1] = 1;
+        }
+    }
+
+    int ns = sp->ns;
+    sp->S_G = malloc(nG * sizeof(int));
+    sp->Smirror_G = malloc(nG * sizeof(int));
+    for (int G = 0; G < nG; G++) {
+        int Q = Q_G[G];
+        int i0 = Q / (N1 * M2);
+        int i1 = (Q / M2) % N1;
+        int i2 = Q % M2;
+        sp->Smirror_G[G] = -1;
+        if (real) {
+            sp->S_G[G] = s_col[i1 * M2 + i2] * ns + i0;
+            if (i2 == 0 && (i0 != 0 || i1 != 0))
+                sp->Smirror_G[G] = (s_col[((N1 - i1) % N1) * M2] * ns +
+                                    (N0 - i0) % N0);
+        }
+        else
+            sp->S_G[G] = s_col[i0 * N1 + i1] * ns + i2;
+    }
+    free(s_col);
+
+    sp->run_start = malloc(nplanes * sizeof(int));
+    sp->run_len = malloc(nplanes * sizeof(int));
+    for (int p = 0; p < nplanes; p++) {
+        if (!plane_used[p])
+            continue;
+        if (p > 0 && plane_used[p - 1])
+            sp->run_len[sp->nruns - 1]++;
+        else {
+            sp->run_start[sp->nruns] = p;
+            sp->run_len[sp->nruns] = 1;
+            sp->nruns++;
+        }
+    }
+    free(plane_used);
+
+    if (nst > 0 &&
+        !box_sticks_plans(box, nst, &sp->sticks_b, &sp->sticks_f)) {
+        Py_DECREF(sp);
+        return NULL;
+    }
+    sp->mid_b = calloc(sp->nruns, sizeof(fftw_plan));
+    sp->mid_f = calloc(sp->nruns, sizeof(fftw_plan));
+    for (int r = 0; r < sp->nruns; r++)
+        if (!box_mid_plans(box, sp->run_start[r], sp->run_len[r],
+                           &sp->mid_b[r], &sp->mid_f[r])) {
+            Py_DECREF(sp);
+            return NULL;
+        }
+    return (PyObject*)sp;
+}
+
+/* Zero the planes of the Y-box that are not crossed by any stick. */
+static void zero_unused_planes(FFTWSpherePlanObject* sp)
+{
+    int N0 = sp->N[0];
+    int N1 = sp->N[1];
+    int M2 = sp->M2;
+    int nlines = sp->real ? sp->nb * N0 * N1 : sp->nb;
+    int line = sp->real ? M2 : N0;
+    int size = sp->real ? 1 : N1 * M2;
+    for (int l = 0; l < nlines; l++) {
+        double* y = sp->box->Y + 2 * (size_t)l * line * size;
+        int p = 0;
+        for (int r = 0; r <= sp->nruns; r++) {
+            int p2 = r < sp->nruns ? sp->run_start[r] : line;
+            if (p2 > p)
+                memset(y + 2 * (size_t)p * size, 0,
+                       2 * sizeof(double) * (size_t)(p2 - p) * size);
+            if (r < sp->nruns)
+                p = p2 + sp->run_len[r];
+        }
+    }
 }
 
 
-PyObject * FFTWExecute(PyObject *self, PyObject *args)
+/* Sphere coefficients -> real space (Y or R of the box). */
+static void sphere_backward(FFTWSpherePlanObject* sp, int nb,
+                            const double* c_bG)
 {
-    fftw_plan* plan;
-    Py_ssize_t n;
-    if (!PyArg_ParseTuple(args, "y#", &plan, &n))
+    int nG = sp->nG;
+    int ns = sp->ns;
+    int nst = sp->nst;
+    int nQ = sp->nQ;
+    size_t nSb = (size_t)nst * ns;
+
+    memset(sp->box->S, 0, 2 * sizeof(double) * sp->nb * nSb);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nb; b++) {
+        double* S = sp->box->S + 2 * b * nSb;
+        const double* c_G = c_bG + 2 * (size_t)b * nG;
+        for (int G = 0; G < nG; G++) {
+            int i = sp->S_G[G];
+            S[2 * i] = c_G[2 * G];
+            S[2 * i + 1] = c_G[2 * G + 1];
+            int m = sp->Smirror_G[G];
+            if (m >= 0) {
+                S[2 * m] = c_G[2 * G];
+                S[2 * m + 1] = -c_G[2 * G + 1];
+            }
+        }
+    }
+
+    if (nst > 0)
+        fftw_execute(sp->sticks_b);
+
+    // X may still hold the sticks of another sphere:
+    if (sp->box->owner != sp) {
+        memset(sp->box->X, 0, 2 * sizeof(double) * (size_t)sp->nb * nQ);
+        sp->box->owner = sp;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < sp->nb; b++) {
+        const double* S = sp->box->S + 2 * b * nSb;
+        double* X = sp->box->X + 2 * (size_t)b * nQ;
+        for (int s = 0; s < nst; s++) {
+            double* x = X + 2 * (size_t)sp->Q_s[s];
+            const double* st = S + 2 * (size_t)s * ns;
+            if (sp->sstride == 1)
+                memcpy(x, st, 2 * sizeof(double) * ns);
+            else
+                for (int i = 0; i < ns; i++) {
+                    x[2 * (size_t)i * sp->sstride] = st[2 * i];
+                    x[2 * (size_t)i * sp->sstride + 1] = st[2 * i + 1];
+                }
+        }
+    }
+
+    zero_unused_planes(sp);
+    for (int r = 0; r < sp->nruns; r++)
+        fftw_execute(sp->mid_b[r]);
+    fftw_execute(sp->box->last_b);
+}
+
+
+/* Real space (Y or R of the box) -> sphere coefficients scaled by 1 / N.
+
+   If psit_bG is not NULL, ekin_G * psit_bG is added. */
+static void sphere_forward(FFTWSpherePlanObject* sp, int nb,
+                           double* c_bG,
+                           const double* psit_bG,
+                           const double* ekin_G)
+{
+    int nG = sp->nG;
+    int ns = sp->ns;
+    int nst = sp->nst;
+    int nQ = sp->nQ;
+    size_t nSb = (size_t)nst * ns;
+
+    fftw_execute(sp->box->last_f);
+    for (int r = 0; r < sp->nruns; r++)
+        fftw_execute(sp->mid_f[r]);
+
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nb; b++) {
+        double* S = sp->box->S + 2 * b * nSb;
+        const double* Y = sp->box->Y + 2 * (size_t)b * nQ;
+        for (int s = 0; s < nst; s++) {
+            const double* y = Y + 2 * (size_t)sp->Q_s[s];
+            double* st = S + 2 * (size_t)s * ns;
+            if (sp->sstride == 1)
+                memcpy(st, y, 2 * sizeof(double) * ns);
+            else
+                for (int i = 0; i < ns; i++) {
+                    st[2 * i] = y[2 * (size_t)i * sp->sstride];
+                    st[2 * i + 1] = y[2 * (size_t)i * sp->sstride + 1];
+                }
+        }
+    }
+
+    if (nst > 0)
+        fftw_execute(sp->sticks_f);
+
+    double scale = 1.0 / sp->nR;
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nb; b++) {
+        const double* S = sp->box->S + 2 * b * nSb;
+        double* c_G = c_bG + 2 * (size_t)b * nG;
+        for (int G = 0; G < nG; G++) {
+            int i = sp->S_G[G];
+            c_G[2 * G] = S[2 * i] * scale;
+            c_G[2 * G + 1] = S[2 * i + 1] * scale;
+        }
+        if (psit_bG != NULL) {
+            const double* p_G = psit_bG + 2 * (size_t)b * nG;
+#pragma omp simd
+            for (int G = 0; G < nG; G++) {
+                c_G[2 * G] += ekin_G[G] * p_G[2 * G];
+                c_G[2 * G + 1] += ekin_G[G] * p_G[2 * G + 1];
+            }
+        }
+    }
+}
+
+
+static int check_block(FFTWSpherePlanObject* sp, PyArrayObject* c_bG_obj)
+{
+    if (PyArray_NDIM(c_bG_obj) != 2 ||
+        PyArray_DIM(c_bG_obj, 0) > sp->nb ||
+        PyArray_DIM(c_bG_obj, 1) != sp->nG) {
+        PyErr_SetString(PyExc_ValueError, "Bad coefficient block");
+        return 0;
+    }
+    return 1;
+}
+
+
+/* coef_bG -> out_bR for a block of at most nb bands. */
+static PyObject* FFTWSpherePlan_ifft(FFTWSpherePlanObject *sp, PyObject *args)
+{
+    PyArrayObject* coef_bG_obj;
+    PyArrayObject* out_bR_obj;
+    if (!PyArg_ParseTuple(args, "OO", &coef_bG_obj, &out_bR_obj))
+        return NULL;
+    if (!check_block(sp, coef_bG_obj))
         return NULL;
-    fftw_execute(*plan);
+    int nb = (int)PyArray_DIM(coef_bG_obj, 0);
+    sphere_backward(sp, nb, PyArray_DATA(coef_bG_obj));
+    if (sp->real)
+        memcpy(PyArray_DATA(out_bR_obj), sp->box->R,
+               sizeof(double) * (size_t)nb * sp->nR);
+    else
+        memcpy(PyArray_DATA(out_bR_obj), sp->box->Y,
+               2 * sizeof(double) * (size_t)nb * sp->nR);
     Py_RETURN_NONE;
 }
 
 
-PyObject * FFTWDestroy(PyObject *self, PyObject *args)
+/* in_bR -> coef_bG (scaled by 1 / N) for a block of at most nb bands. */
+static PyObject* FFTWSpherePlan_fft(FFTWSpherePlanObject *sp, PyObject *args)
 {
-    fftw_plan* plan;
-    Py_ssize_t n;
-    if (!PyArg_ParseTuple(args, "y#", &plan, &n))
+    PyArrayObject* in_bR_obj;
+    PyArrayObject* coef_bG_obj;
+    if (!PyArg_ParseTuple(args, "OO", &in_bR_obj, &coef_bG_obj))
         return NULL;
-    fftw_destroy_plan(*plan);
+    if (!check_block(sp, coef_bG_obj))
+        return NULL;
+    int nb = (int)PyArray_DIM(coef_bG_obj, 0);
+    if (sp->real)
+        memcpy(sp->box->R, PyArray_DATA(in_bR_obj),
+               sizeof(double) * (size_t)nb * sp->nR);
+    else
+        memcpy(sp->box->Y, PyArray_DATA(in_bR_obj),
+               2 * sizeof(double) * (size_t)nb * sp->nR);
+    sphere_forward(sp, nb, PyArray_DATA(coef_bG_obj), NULL, NULL);
     Py_RETURN_NONE;
 }
 
+
+/* out_bG = ekin_G * psit_bG + FFT[vt_R * IFFT[psit_bG]].
+
+   Kinetic energy plus local potential applied to a block of bands
+   without leaving the plan's work buffers. */
+static PyObject* FFTWSpherePlan_apply_potential(FFTWSpherePlanObject *sp,
+                                                PyObject *args)
+{
+    PyArrayObject* psit_bG_obj;
+    PyArrayObject* vt_R_obj;
+    PyArrayObject* ekin_G_obj;
+    PyArrayObject* out_bG_obj;
+    if (!PyArg_ParseTuple(args, "OOOO", &psit_bG_obj, &vt_R_obj,
+                          &ekin_G_obj, &out_bG_obj))
+        return NULL;
+    if (!check_block(sp, psit_bG_obj) || !check_block(sp, out_bG_obj))
+        return NULL;
+    if (PyArray_SIZE(vt_R_obj) != sp->nR ||
+        PyArray_SIZE(ekin_G_obj) != sp->nG) {
+        PyErr_SetString(PyExc_ValueError, "Bad potential or ekin_G");
+        return NULL;
+    }
+    int nb = (int)PyArray_DIM(psit_bG_obj, 0);
+    const double* psit_bG = PyArray_DATA(psit_bG_obj);
+    const double* vt_R = PyArray_DATA(vt_R_obj);
+    int nR = sp->nR;
+
+    sphere_backward(sp, nb, psit_bG);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nb; b++) {
+        if (sp->real) {
+            double* a_R = sp->box->R + (size_t)b * nR;
+#pragma omp simd
+            for (int R = 0; R < nR; R++)
+                a_R[R] *= vt_R[R];
+        }
+        else {
+            double* a_R = sp->box->Y + 2 * (size_t)b * nR;
+#pragma omp simd
+            for (int R = 0; R < nR; R++) {
+                a_R[2 * R] *= vt_R[R];
+                a_R[2 * R + 1] *= vt_R[R];
+            }
+        }
+    }
+    sphere_forward(sp, nb, PyArray_DATA(out_bG_obj), psit_bG,
+                   PyArray_DATA(ekin_G_obj));
+    Py_RETURN_NONE;
+}
+
+
+static PyMethodDef FFTWSpherePlan_Methods[] = {
+    {"ifft", (PyCFunction)FFTWSpherePlan_ifft, METH_VARARGS, NULL},
+    {"fft", (PyCFunction)FFTWSpherePlan_fft, METH_VARARGS, NULL},
+    {"apply_potential", (PyCFunction)FFTWSpherePlan_apply_potential,
+     METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+
+PyTypeObject FFTWSpherePlanType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "FFTWSpherePlan",
+    sizeof(FFTWSpherePlanObject),
+    0,
+    (destructor)FFTWSpherePlan_dealloc,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,
+    "Batched FFTW sphere-transform plan",
+    0, 0, 0, 0, 0, 0,
+    FFTWSpherePlan_Methods
+};
+
 #endif // GPAW_WITH_FFTW
@@ -191,3 +191,223 @@ PyObject *tci_overlap(PyObject *self, PyObject *args)
 
     Py_RETURN_NONE;
 }
+
+
+PyObject *tci_overlap_many(PyObject *self, PyObject *args)
+{
+    /*
+    Batched version of tci_overlap() for many displacement vectors R_pc:
+
+    x_pmi[p] += sum_l s_l(r_p) sum_L'' G_LL'L'' rlY_L''(R_p)
+
+    and, if dxdR_pcmi is not None, the derivatives as in tci_overlap().
+
+    rlY_Lp and drlYdR_cLp must hold the solid harmonics (and their
+    gradients) for all L up to the largest l of the splines with the
+    vectors as the last (contiguous) axis.  The output arrays may be
+    strided views into larger arrays (we only add to them).
+
+    The non-zero Gaunt coefficients for the (la, lb) block are packed
+    once into a short list and the pairs are processed in blocks so that
+    the innermost loops run over pairs.
+    */
+
+    int la, lb;
+    PyArrayObject *G_LLL_obj;
+    PyObject *spline_l;
+    PyArrayObject *R_pc_obj, *rlY_Lp_obj, *x_pmi_obj;
+    PyObject *drlYdR_cLp_obj, *dxdR_pcmi_obj;
+
+    if (!PyArg_ParseTuple(args, "iiOOOOOOO", &la, &lb, &G_LLL_obj, &spline_l,
+                          &R_pc_obj, &rlY_Lp_obj, &x_pmi_obj,
+                          &drlYdR_cLp_obj, &dxdR_pcmi_obj))
+        return NULL;
+
+    int is_derivative = dxdR_pcmi_obj != Py_None;
+    if (!PyArray_Check(R_pc_obj) ||
+        PyArray_TYPE(R_pc_obj) != NPY_DOUBLE ||
+        !PyArray_IS_C_CONTIGUOUS(R_pc_obj) ||
+        PyArray_NDIM(R_pc_obj) != 2 ||
+        PyArray_DIM(R_pc_obj, 1) != 3) {
+        PyErr_SetString(PyExc_ValueError, "Bad R_pc array");
+        return NULL;
+    }
+    int npairs = PyArray_DIM(R_pc_obj, 0);
+    int nsplines = PyList_Size(spline_l);
+    int nm1 = 2 * la + 1;
+    int nm2 = 2 * lb + 1;
+    int nmi = nm1 * nm2;
+    int l0 = (la + lb) % 2;
+    int lmax = l0 + 2 * (nsplines - 1);
+    if (nsplines == 0 || npairs == 0)
+        Py_RETURN_NONE;
+    if (!PyArray_Check(rlY_Lp_obj) ||
+        PyArray_TYPE(rlY_Lp_obj) != NPY_DOUBLE ||
+        !PyArray_IS_C_CONTIGUOUS(rlY_Lp_obj) ||
+        PyArray_NDIM(rlY_Lp_obj) != 2 ||
+        PyArray_DIM(rlY_Lp_obj, 0) < (lmax + 1) * (lmax + 1) ||
+        PyArray_DIM(rlY_Lp_obj, 1) != npairs) {
+        PyErr_SetString(PyExc_ValueError, "Bad rlY_Lp array");
+        return NULL;
+    }
+    if (is_derivative) {
+        PyArrayObject *a = (PyArrayObject *) drlYdR_cLp_obj;
+        if (!PyArray_Check(drlYdR_cLp_obj) ||
+            PyArray_TYPE(a) != NPY_DOUBLE ||
+            !PyArray_IS_C_CONTIGUOUS(a) ||
+            PyArray_NDIM(a) != 3 ||
+            PyArray_DIM(a, 0) != 3 ||
+            PyArray_DIM(a, 1) < (lmax + 1) * (lmax + 1) ||
+            PyArray_DIM(a, 2) != npairs) {
+            PyErr_SetString(PyExc_ValueError, "Bad drlYdR_cLp array");
+            return NULL;
+        }
+    }
+    // Output: x_pmi (npairs, nm1, nm2) or dxdR_pcmi (npairs, 3, nm1, nm2):
+    PyObject *o = is_derivative ? dxdR_pcmi_obj : (PyObject *) x_pmi_obj;
+    if (!PyArray_Check(o) ||
+        PyArray_TYPE((PyArrayObject *) o) != NPY_DOUBLE ||
+        PyArray_NDIM((PyArrayObject *) o) != 3 + is_derivative ||
+        PyArray_DIM((PyArrayObject *) o, 0) != npairs ||
+        (is_derivative && PyArray_DIM((PyArrayObject *) o, 1) != 3) ||
+        PyArray_DIM((PyArrayObject *) o, 1 + is_derivative) != nm1 ||
+        PyArray_DIM((PyArrayObject *) o, 2 + is_derivative) != nm2) {
+        PyErr_SetString(PyExc_ValueError, "Bad output array");
+        return NULL;
+    }
+
+    const double *R_pc = (const double *) PyArray_DATA(R_pc_obj);
+    const double *rlY_Lp = (const double *) PyArray_DATA(rlY_Lp_obj);
+    const double *drlYdR_cLp = NULL;
+    long nLp = 0;
+    if (is_derivative) {
+        drlYdR_cLp = (const double *) PyArray_DATA(
+            (PyArrayObject *) drlYdR_cLp_obj);
+        nLp = PyArray_DIM((PyArrayObject *) drlYdR_cLp_obj, 1) * (long)npairs;
+    }
+
+    // Output strides in units of doubles:
+    PyArrayObject *out_obj = (PyArrayObject *)
+        (is_derivative ? dxdR_pcmi_obj : (PyObject *) x_pmi_obj);
+    double *out = (double *) PyArray_DATA(out_obj);
+    npy_intp *ostrides = PyArray_STRIDES(out_obj);
+    long os_p = ostrides[0] / sizeof(double);
+    long os_c = is_derivative ? ostrides[1] / sizeof(double) : 0;
+    int d = is_derivative;
+    long os_m1 = ostrides[1 + d] / sizeof(double);
+    long os_m2 = ostrides[2 + d] / sizeof(double);
+
+    // Pack non-zero Gaunt coefficients: (m1 * nm2 + m2, spline, L, G)
+    npy_intp *gstrides = PyArray_STRIDES(G_LLL_obj);
+    long gs0 = gstrides[0] / sizeof(double);
+    long gs1 = gstrides[1] / sizeof(double);
+    long gs2 = gstrides[2] / sizeof(double);
+    const double *G_LLL = ((const double *) PyArray_DATA(G_LLL_obj) +
+                           la * la * gs0 + lb * lb * gs1);
+    int ngmax = 0;
+    for (int j = 0; j < nsplines; j++)
+        ngmax += nmi * (2 * (l0 + 2 * j) + 1);
+    int *i_g = GPAW_MALLOC(int, 3 * ngmax);
+    double *G_g = GPAW_MALLOC(double, ngmax);
+    int ng = 0;
+    for (int m1 = 0; m1 < nm1; m1++)
+        for (int m2 = 0; m2 < nm2; m2++)
+            for (int j = 0; j < nsplines; j++) {
+                int l = l0 + 2 * j;
+                for (int L = l * l; L < (l + 1) * (l + 1); L++) {
+                    double G = G_LLL[m1 * gs0 + m2 * gs1 + L * gs2];
+                    if (fabs(G) < 1e-14)
+                        continue;
+                    i_g[3 * ng] = m1 * nm2 + m2;
+                    i_g[3 * ng + 1] = j;
+                    i_g[3 * ng + 2] = L;
+                    G_g[ng++] = G;
+                }
+            }
+
+    const bmgsspline **splines = GPAW_MALLOC(const bmgsspline *, nsplines);
+    for (int j = 0; j < nsplines; j++)
+        splines[j] = &((SplineObject *)
+                       PyList_GET_ITEM(spline_l, j))->spline;
+
+#define TCI_BLOCK 32
+    int nblocks = (npairs + TCI_BLOCK - 1) / TCI_BLOCK;
+#pragma omp parallel
+    {
+        double *s_jb = GPAW_MALLOC(double, 2 * nsplines * TCI_BLOCK);
+        double *ds_jb = s_jb + nsplines * TCI_BLOCK;
+        double *x_xb = GPAW_MALLOC(double, (is_derivative ? 3 : 1) *
+                                   nmi * TCI_BLOCK);
+        double Rhat_cb[3][TCI_BLOCK];
+#pragma omp for schedule(dynamic)
+        for (int block = 0; block < nblocks; block++) {
+            int p0 = block * TCI_BLOCK;
+            int nb = npairs - p0 < TCI_BLOCK ? npairs - p0 : TCI_BLOCK;
+            for (int b = 0; b < nb; b++) {
+                const double *R_c = R_pc + 3 * (p0 + b);
+                double r = sqrt(R_c[0] * R_c[0] + R_c[1] * R_c[1] +
+                                R_c[2] * R_c[2]);
+                for (int c = 0; c < 3; c++)
+                    Rhat_cb[c][b] = r > 0.0 ? R_c[c] / r : 0.0;
+                for (int j = 0; j < nsplines; j++) {
+                    double *s = s_jb + j * TCI_BLOCK + b;
+                    double *ds = ds_jb + j * TCI_BLOCK + b;
+                    bmgs_get_value_and_derivative(splines[j], r, s, ds);
+                    if (fabs(*s) < 1e-10)  // same cutoff as tci_overlap()
+                        *s = *ds = 0.0;
+                }
+            }
+            if (!is_derivative) {
+                memset(x_xb, 0, nmi * TCI_BLOCK * sizeof(double));
+                for (int g = 0; g < ng; g++) {
+                    double *x_b = x_xb + i_g[3 * g] * TCI_BLOCK;
+                    const double *s_b = s_jb + i_g[3 * g + 1] * TCI_BLOCK;
+                    const double *Y_b = rlY_Lp + i_g[3 * g + 2] * (long)npairs + p0;
+                    double G = G_g[g];
+#pragma omp simd
+                    for (int b = 0; b < nb; b++)
+                        x_b[b] += G * s_b[b] * Y_b[b];
+                }
+                for (int mi = 0; mi < nmi; mi++) {
+                    double *o = out + (mi / nm2) * os_m1 + (mi % nm2) * os_m2;
+                    for (int b = 0; b < nb; b++)
+                        o[(p0 + b) * os_p] += x_xb[mi * TCI_BLOCK + b];
+                }
+                continue;
+            }
+            memset(x_xb, 0, 3 * nmi * TCI_BLOCK * sizeof(double));
+            for (int g = 0; g < ng; g++) {
+                int mi = i_g[3 * g];
+                const double *s_b = s_jb + i_g[3 * g + 1] * TCI_BLOCK;
+                const double *ds_b = ds_jb + i_g[3 * g + 1] * TCI_BLOCK;
+                long L = i_g[3 * g + 2];
+                const double *Y_b = rlY_Lp + L * npairs + p0;
+                double G = G_g[g];
+                for (int c = 0; c < 3; c++) {
+                    double *x_b = x_xb + (c * nmi + mi) * TCI_BLOCK;
+                    const double *dY_b = drlYdR_cLp + c * nLp + L * npairs + p0;
+                    const double *Rhat_b = Rhat_cb[c];
+#pragma omp simd
+                    for (int b = 0; b < nb; b++)
+                        x_b[b] += G * (ds_b[b] * Rhat_b[b] * Y_b[b] +
+                                       s_b[b] * dY_b[b]);
+                }
+            }
+            for (int c = 0; c < 3; c++)
+                for (int mi = 0; mi < nmi; mi++) {
+                    double *o = (out + c * os_c + (mi / nm2) * os_m1 +
+                                 (mi % nm2) * os_m2);
+                    const double *x_b = x_xb + (c * nmi + mi) * TCI_BLOCK;
+                    for (int b = 0; b < nb; b++)
+                        o[(p0 + b) * os_p] += x_b[b];
+                }
+        }
+        free(x_xb);
+        free(s_jb);
+    }
+#undef TCI_BLOCK
+    free(splines);
+    free(G_g);
+    free(i_g);
+    Py_RETURN_NONE;
+}
@@ -157,3 +157,182 @@ PyObject* evaluate_mpa_poly(PyObject *self, PyObject *args)
 }
 
 
+
+// Evaluate the multipole expansion for a batch of frequencies and
+// occupation numbers in one pass over omegat_nGG and W_nGG:
+// x_wGG: output, x_GG of evaluate_mpa_poly() for each omega_w[w], f_w[w]
+// dx_wGG: output, dx_GG of evaluate_mpa_poly() for each omega_w[w], f_w[w]
+// omega_w: frequencies to evaluate the expansion at
+// f_w: occupation numbers
+// omegat_nGG, W_nGG, eta, factor: as for evaluate_mpa_poly()
+//
+// Each row G1 of poles and residues is copied into a buffer with the
+// pole index innermost and real and imaginary parts split, so that
+// the loop over poles vectorizes.  Rows are distributed over OpenMP
+// threads.
+PyObject* evaluate_mpa_poly_batch(PyObject *self, PyObject *args)
+{
+    PyArrayObject* x_wGG_obj;
+    PyArrayObject* dx_wGG_obj;
+    PyArrayObject* omega_w_obj;
+    PyArrayObject* f_w_obj;
+    PyArrayObject* omegat_nGG_obj;
+    PyArrayObject* W_nGG_obj;
+    double eta;
+    double factor;
+
+    if (!PyArg_ParseTuple(args, "OOOOOOdd",
+                          &x_wGG_obj, &dx_wGG_obj, &omega_w_obj, &f_w_obj,
+                          &omegat_nGG_obj, &W_nGG_obj, &eta, &factor))
+        return NULL;
+
+    if (PyArray_NDIM(W_nGG_obj) != 3 || PyArray_NDIM(omegat_nGG_obj) != 3)
+    {
+         PyErr_SetString(PyExc_TypeError,
+                         "omegat_nGG and W_nGG should be 3 dimensional");
+         return NULL;
+    }
+
+    int np = PyArray_DIMS(omegat_nGG_obj)[0];
+    int nG1 = PyArray_DIMS(omegat_nGG_obj)[1];
+    int nG2 = PyArray_DIMS(omegat_nGG_obj)[2];
+    int nw = PyArray_SIZE(omega_w_obj);
+
+    if ((np != PyArray_DIMS(W_nGG_obj)[0]) ||
+        (nG1 != PyArray_DIMS(W_nGG_obj)[1]) ||
+        (nG2 != PyArray_DIMS(W_nGG_obj)[2]) ||
+        (PyArray_SIZE(f_w_obj) != nw) ||
+        (PyArray_SIZE(x_wGG_obj) != (npy_intp)nw * nG1 * nG2) ||
+        (PyArray_SIZE(dx_wGG_obj) != (npy_intp)nw * nG1 * nG2))
+    {
+         PyErr_SetString(PyExc_TypeError, "Unmatched dimensions.");
+         return NULL;
+    }
+
+    if ((PyArray_TYPE(omegat_nGG_obj) != NPY_COMPLEX128) ||
+        (PyArray_TYPE(W_nGG_obj) != NPY_COMPLEX128) ||
+        (PyArray_TYPE(x_wGG_obj) != NPY_COMPLEX128) ||
+        (PyArray_TYPE(dx_wGG_obj) != NPY_COMPLEX128) ||
+        (PyArray_TYPE(omega_w_obj) != NPY_DOUBLE) ||
+        (PyArray_TYPE(f_w_obj) != NPY_DOUBLE))
+    {
+         PyErr_SetString(PyExc_TypeError,
+                         "Expected complex arrays for omegat_nGG, W_nGG, "
+                         "x_wGG and dx_wGG and float arrays for omega_w "
+                         "and f_w.");
+         return NULL;
+    }
+
+    if (!PyArray_IS_C_CONTIGUOUS(x_wGG_obj)
+        || !PyArray_IS_C_CONTIGUOUS(dx_wGG_obj)
+        || !PyArray_IS_C_CONTIGUOUS(W_nGG_obj)
+        || !PyArray_IS_C_CONTIGUOUS(omegat_nGG_obj)
+        || !PyArray_IS_C_CONTIGUOUS(omega_w_obj)
+        || !PyArray_IS_C_CONTIGUOUS(f_w_obj))
+    {
+        PyErr_SetString(PyExc_TypeError, "Arrays need to be c-contiguous.");
+        return NULL;
+    }
+
+    double complex* x_wGG = (double complex*)PyArray_DATA(x_wGG_obj);
+    double complex* dx_wGG = (double complex*)PyArray_DATA(dx_wGG_obj);
+    double complex* omegat_nGG = (double complex*)PyArray_DATA(omegat_nGG_obj);
+    double complex* W_nGG = (double complex*)PyArray_DATA(W_nGG_obj);
+    double* omega_w = (double*)PyArray_DATA(omega_w_obj);
+    double* f_w = (double*)PyArray_DATA(f_w_obj);
+
+    // Weights of the two branches.  Same rounding of occupation
+    // numbers close to one or zero as in evaluate_mpa_poly():
+    double* a_w = GPAW_MALLOC(double, 2 * nw);
+    double* b_w = a_w + nw;
+    for (int w = 0; w < nw; w++)
+    {
+        double f = f_w[w];
+        if (f < 0 || f > 1)
+        {
+            free(a_w);
+            PyErr_SetString(PyExc_TypeError, "Occupation out of bounds.");
+            return NULL;
+        }
+        if (f > 1 - 1e-10)
+            f = 1.0;
+        else if (f < 1e-10)
+            f = 0.0;
+        a_w[w] = f;
+        b_w[w] = 1.0 - f;
+    }
+
+    size_t nGG = (size_t)nG1 * nG2;
+    double scale = 2 * factor;
+
+#pragma omp parallel
+    {
+        // One row of poles and residues: [G2][re(omegat), im(omegat),
+        // re(W), im(W)][p]
+        double* buf = GPAW_MALLOC(double, 4 * (size_t)np * nG2);
+
+#pragma omp for schedule(static)
+        for (int G1 = 0; G1 < nG1; G1++)
+        {
+            for (int G2 = 0; G2 < nG2; G2++)
+            {
+                double* o_p = buf + 4 * (size_t)np * G2;
+                for (int p = 0; p < np; p++)
+                {
+                    size_t index = G2 + G1 * (size_t)nG2 + p * nGG;
+                    o_p[p] = creal(omegat_nGG[index]);
+                    o_p[np + p] = cimag(omegat_nGG[index]);
+                    o_p[2 * np + p] = creal(W_nGG[index]);
+                    o_p[3 * np + p] = cimag(W_nGG[index]);
+                }
+            }
+            for (int G2 = 0; G2 < nG2; G2++)
+            {
+                const double* ore_p = buf + 4 * (size_t)np * G2;
+                const double* oim_p = ore_p + np;
+                const double* wre_p = oim_p + np;
+                const double* wim_p = wre_p + np;
+                for (int w = 0; w < nw; w++)
+                {
+                    double omega = omega_w[w];
+                    double a = a_w[w];
+                    double b = b_w[w];
+                    double xr = 0.0;
+                    double xi = 0.0;
+                    double dxr = 0.0;
+                    double dxi = 0.0;
+#pragma omp simd reduction(+:xr,xi,dxr,dxi)
+                    for (int p = 0; p < np; p++)
+                    {
+                        // x1 = a / (omega - i eta + omegat)
+                        double d1r = omega + ore_p[p];
+                        double d1i = oim_p[p] - eta;
+                        double n1 = a / (d1r * d1r + d1i * d1i);
+                        double x1r = n1 * d1r;
+                        double x1i = -n1 * d1i;
+                        // x2 = b / (omega + i eta - omegat)
+                        double d2r = omega - ore_p[p];
+                        double d2i = eta - oim_p[p];
+                        double n2 = b / (d2r * d2r + d2i * d2i);
+                        double x2r = n2 * d2r;
+                        double x2i = -n2 * d2i;
+                        double yr = x1r + x2r;
+                        double yi = x1i + x2i;
+                        double zr = x1r * x1r - x1i * x1i + x2r * x2r - x2i * x2i;
+                        double zi = 2 * (x1r * x1i + x2r * x2i);
+                        xr += yr * wre_p[p] - yi * wim_p[p];
+                        xi += yr * wim_p[p] + yi * wre_p[p];
+                        dxr -= zr * wre_p[p] - zi * wim_p[p];
+                        dxi -= zr * wim_p[p] + zi * wre_p[p];
+                    }
+                    size_t index = G2 + G1 * (size_t)nG2 + w * nGG;
+                    x_wGG[index] = (xr + I * xi) * scale;
+                    dx_wGG[index] = (dxr + I * dxi) * scale;
+                }
+            }
+        }
+        free(buf);
+    }
+    free(a_w);
+    Py_RETURN_NONE;
+}
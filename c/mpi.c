@@ -14,6 +14,7 @@
 #include <mpi.h>
 #include "extensions.h"
 #include <structmember.h>
+#include <limits.h>
 #include "mympi.h"
 #ifdef __bgp__
 #include <mpix.h>
@@ -54,9 +55,19 @@ typedef struct {
   PyObject_HEAD
   MPI_Request rq;
   PyObject *buffer;
+  void *data;  // malloc'ed arguments that must live until completion
   int status;
 } GPAW_MPI_Request;
 
+// Release the buffer (and the argument data) of a completed request.
+static void mpi_request_release(GPAW_MPI_Request *self)
+{
+  Py_DECREF(self->buffer);
+  free(self->data);
+  self->data = NULL;
+  self->status = 0;
+}
+
 static void maybeSynchronize(PyObject* a)
 {
 #ifdef GPAW_GPU_AWARE_MPI
@@ -81,8 +92,7 @@ static PyObject *mpi_request_wait(GPAW_MPI_Request *self, PyObject *noargs)
       PyErr_SetString(PyExc_RuntimeError, "MPI_Wait error occurred.");
       return NULL;
     }
-  Py_DECREF(self->buffer);
-  self->status = 0;
+  mpi_request_release(self);
 
   Py_RETURN_NONE;
 }
@@ -103,8 +113,7 @@ static PyObject *mpi_request_test(GPAW_MPI_Request *self, PyObject *noargs)
     }
   if (flag)
     {
-      Py_DECREF(self->buffer);
-      self->status = 0;
+      mpi_request_release(self);
       Py_RETURN_TRUE;
     }
   else
@@ -188,11 +197,137 @@ static GPAW_MPI_Request *NewMPIRequest(void)
   if (self == NULL) return NULL;
   memset(&(self->rq), 0, sizeof(MPI_Request));
   self->buffer = NULL;
+  self->data = NULL;
   self->status = 1;  // Active
 
   return self;
 }
 
+// Request for a non-blocking collective on buffer (a Python object
+// that is kept alive until the communication has completed).
+static GPAW_MPI_Request *NewCollectiveRequest(PyObject *buffer)
+{
+  GPAW_MPI_Request *req = NewMPIRequest();
+  if (req == NULL) return NULL;
+  req->buffer = buffer;
+  Py_INCREF(buffer);
+  return req;
+}
+
+// Return the request of a started collective or raise an error.
+static PyObject *collective_started(GPAW_MPI_Request *req, int ret,
+                                    const char *name)
+{
+  if (ret != MPI_SUCCESS)
+    {
+      mpi_request_release(req);
+      Py_DECREF(req);
+      PyErr_Format(PyExc_RuntimeError, "%s error occurred.", name);
+      return NULL;
+    }
+  return (PyObject *) req;
+}
+
+
+// Owner of an MPI_Win_allocate_shared() window.  It is the base object
+// of the NumPy arrays viewing the shared memory.  MPI_Win_free() is
+// collective, so it can't be called when a Python object happens to
+// be deallocated: the memory stays allocated until free() is called by
+// all ranks of the window or until MPI_Finalize().
+typedef struct {
+  PyObject_HEAD
+  MPI_Win win;
+} GPAW_MPI_Window;
+
+static void mpi_window_dealloc(GPAW_MPI_Window *self)
+{
+  PyObject_Del(self);
+}
+
+static PyObject * mpi_window_free(GPAW_MPI_Window *self, PyObject *noargs)
+{
+  if (self->win != MPI_WIN_NULL)
+    MPI_Win_free(&(self->win));
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef mpi_window_methods[] = {
+    {"free", (PyCFunction)mpi_window_free, METH_NOARGS,
+     "free() releases the shared memory.  Collective over the ranks of "
+     "the window.  Arrays viewing the memory must not be used "
+     "afterwards."},
+    {0, 0, 0, 0}
+};
+
+PyTypeObject GPAW_MPI_Window_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "MPI_Window",
+    sizeof(GPAW_MPI_Window),
+    0,
+    (destructor)mpi_window_dealloc,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Py_TPFLAGS_DEFAULT,
+    "Shared-memory MPI window",
+    0, 0, 0, 0, 0, 0,
+    mpi_window_methods
+};
+
+// Messages are counted in MPI_BYTEs with a plain int.  Larger buffers
+// are sent as chunks of GPAW_MPI_CHUNK bytes or as one element of a
+// derived datatype built from such chunks.
+#define GPAW_MPI_CHUNK (1 << 28)
+
+static size_t array_nbytes(PyObject* a)
+{
+  size_t n = Array_ITEMSIZE(a);
+  for (int d = 0; d < Array_NDIM(a); d++)
+    n *= Array_DIM(a, d);
+  return n;
+}
+
+// Contiguous datatype of nbytes bytes (any size).
+static MPI_Datatype mpi_block_type(size_t nbytes)
+{
+  MPI_Datatype chunk;
+  MPI_Datatype chunks;
+  MPI_Datatype type;
+  size_t q = nbytes / GPAW_MPI_CHUNK;
+  int r = nbytes % GPAW_MPI_CHUNK;
+  MPI_Type_contiguous(GPAW_MPI_CHUNK, MPI_BYTE, &chunk);
+  MPI_Type_contiguous((int)q, chunk, &chunks);
+  MPI_Type_free(&chunk);
+  if (r == 0)
+    type = chunks;
+  else
+    {
+      MPI_Datatype rest;
+      MPI_Type_contiguous(r, MPI_BYTE, &rest);
+      int blocklengths[2] = {1, 1};
+      MPI_Aint displacements[2] = {0, (MPI_Aint)(q * GPAW_MPI_CHUNK)};
+      MPI_Datatype types[2] = {chunks, rest};
+      MPI_Type_create_struct(2, blocklengths, displacements, types, &type);
+      MPI_Type_free(&chunks);
+      MPI_Type_free(&rest);
+    }
+  MPI_Type_commit(&type);
+  return type;
+}
+
+// Count and datatype for sending nbytes bytes.  Returns 1 if the
+// datatype is a derived one that must be freed with MPI_Type_free().
+static int mpi_bytes(size_t nbytes, int* count, MPI_Datatype* type)
+{
+  if (nbytes <= INT_MAX)
+    {
+      *count = (int)nbytes;
+      *type = MPI_BYTE;
+      return 0;
+    }
+  *count = 1;
+  *type = mpi_block_type(nbytes);
+  return 1;
+}
+
 
 static void mpi_ensure_finalized(void)
 {
@@ -271,6 +406,20 @@ static void mpi_ensure_initialized(void)
 
 static void mpi_dealloc(MPIObject *obj)
 {
+    // Like the communicators, the buffers of hierarchical sums are
+    // released when the communicator object is deallocated (unless
+    // MPI_Finalize() already did that).
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (obj->shm != NULL && !finalized)
+      {
+        MPI_Win_unlock_all(obj->shm_win);
+        MPI_Win_free(&(obj->shm_win));
+      }
+    if (obj->node_comm != MPI_COMM_NULL)
+	MPI_Comm_free(&(obj->node_comm));
+    if (obj->leader_comm != MPI_COMM_NULL)
+	MPI_Comm_free(&(obj->leader_comm));
     if (obj->comm != MPI_COMM_WORLD)
 	MPI_Comm_free(&(obj->comm));
     Py_XDECREF(obj->parent);
@@ -296,16 +445,18 @@ static PyObject * mpi_sendreceive(MPIObject *self, PyObject *args,
     CHK_OTHER_PROC(dest);
     CHK_ARRAY(b);
     CHK_OTHER_PROC(src);
-    int nsend = Array_ITEMSIZE(a);
-    for (int d = 0; d < Array_NDIM(a); d++)
-	nsend *= Array_DIM(a,d);
-    int nrecv = Array_ITEMSIZE(b);
-    for (int d = 0; d < Array_NDIM(b); d++)
-	nrecv *= Array_DIM(b,d);
+    int nsend, nrecv;
+    MPI_Datatype sendtype, recvtype;
+    int sderived = mpi_bytes(array_nbytes(a), &nsend, &sendtype);
+    int rderived = mpi_bytes(array_nbytes(b), &nrecv, &recvtype);
     maybeSynchronize(a);
-    int ret = MPI_Sendrecv(Array_BYTES(a), nsend, MPI_BYTE, dest, sendtag,
-			   Array_BYTES(b), nrecv, MPI_BYTE, src, recvtag,
+    int ret = MPI_Sendrecv(Array_BYTES(a), nsend, sendtype, dest, sendtag,
+			   Array_BYTES(b), nrecv, recvtype, src, recvtag,
 			   self->comm, MPI_STATUS_IGNORE);
+    if (sderived)
+	MPI_Type_free(&sendtype);
+    if (rderived)
+	MPI_Type_free(&recvtype);
     if (ret != MPI_SUCCESS) {
 	PyErr_SetString(PyExc_RuntimeError, "MPI_Sendrecv error occurred.");
 	return NULL;
@@ -327,14 +478,16 @@ static PyObject * mpi_receive(MPIObject *self, PyObject *args, PyObject *kwargs)
     return NULL;
   CHK_ARRAY(a);
   CHK_OTHER_PROC(src);
-  int n = Array_ITEMSIZE(a);
-  for (int d = 0; d < Array_NDIM(a); d++)
-    n *= Array_DIM(a, d);
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(a), &n, &type);
   if (block)
     {
       maybeSynchronize(a);
-      int ret = MPI_Recv(Array_BYTES(a), n, MPI_BYTE, src, tag, self->comm,
+      int ret = MPI_Recv(Array_BYTES(a), n, type, src, tag, self->comm,
 			 MPI_STATUS_IGNORE);
+      if (derived)
+	MPI_Type_free(&type);
       if (ret != MPI_SUCCESS)
 	{
 	  PyErr_SetString(PyExc_RuntimeError, "MPI_Recv error occurred.");
@@ -349,8 +502,10 @@ static PyObject * mpi_receive(MPIObject *self, PyObject *args, PyObject *kwargs)
       req->buffer = (PyObject*)a;
       Py_INCREF(req->buffer);
       maybeSynchronize(a);
-      int ret = MPI_Irecv(Array_BYTES(a), n, MPI_BYTE, src, tag, self->comm,
+      int ret = MPI_Irecv(Array_BYTES(a), n, type, src, tag, self->comm,
 			  &(req->rq));
+      if (derived)
+	MPI_Type_free(&type);
       if (ret != MPI_SUCCESS)
 	{
 	  PyErr_SetString(PyExc_RuntimeError, "MPI_Irecv error occurred.");
@@ -372,13 +527,15 @@ static PyObject * mpi_send(MPIObject *self, PyObject *args, PyObject *kwargs)
     return NULL;
   CHK_ARRAY(a);
   CHK_OTHER_PROC(dest);
-  int n = Array_ITEMSIZE(a);
-  for (int d = 0; d < Array_NDIM(a); d++)
-    n *= Array_DIM(a,d);
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(a), &n, &type);
   if (block)
     {
       maybeSynchronize(a);
-      int ret = MPI_Send(Array_BYTES(a), n, MPI_BYTE, dest, tag, self->comm);
+      int ret = MPI_Send(Array_BYTES(a), n, type, dest, tag, self->comm);
+      if (derived)
+	MPI_Type_free(&type);
       if (ret != MPI_SUCCESS)
 	{
 	  PyErr_SetString(PyExc_RuntimeError, "MPI_Send error occurred.");
@@ -392,8 +549,10 @@ static PyObject * mpi_send(MPIObject *self, PyObject *args, PyObject *kwargs)
       req->buffer = (PyObject*)a;
       Py_INCREF(a);
       maybeSynchronize(a);
-      int ret = MPI_Isend(Array_BYTES(a), n, MPI_BYTE, dest, tag, self->comm,
+      int ret = MPI_Isend(Array_BYTES(a), n, type, dest, tag, self->comm,
 			  &(req->rq));
+      if (derived)
+	MPI_Type_free(&type);
       if (ret != MPI_SUCCESS)
 	{
 	  PyErr_SetString(PyExc_RuntimeError, "MPI_Isend error occurred.");
@@ -415,11 +574,13 @@ static PyObject * mpi_ssend(MPIObject *self, PyObject *args, PyObject *kwargs)
     return NULL;
   CHK_ARRAY_RO(a);
   CHK_OTHER_PROC(dest);
-  int n = Array_ITEMSIZE(a);
-  for (int d = 0; d < Array_NDIM(a); d++)
-    n *= Array_DIM(a,d);
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(a), &n, &type);
   maybeSynchronize(a);
-  MPI_Ssend(Array_BYTES(a), n, MPI_BYTE, dest, tag, self->comm);
+  MPI_Ssend(Array_BYTES(a), n, type, dest, tag, self->comm);
+  if (derived)
+    MPI_Type_free(&type);
   Py_RETURN_NONE;
 }
 
@@ -507,9 +668,8 @@ static PyObject * mpi_testall(MPIObject *self, PyObject *requests)
 	if (o->status)
 	{
 	  assert(o->buffer != NULL);
-	  Py_DECREF(o->buffer);
+	  mpi_request_release(o);
 	}
-	o->status = 0;
 	Py_DECREF(o);
       }
     }
@@ -569,9 +729,8 @@ static PyObject * mpi_waitall(MPIObject *self, PyObject *requests)
      if (o->status)
      {
        assert(o->buffer != NULL);
-       Py_DECREF(o->buffer);
+       mpi_request_release(o);
      }
-     o->status = 0;
      Py_DECREF(o);
    }
   // Release internal data and return.
@@ -635,6 +794,166 @@ static MPI_Datatype get_mpi_datatype(PyObject *a)
   return 0;
 }
 
+// Bytes per rank and segment of a hierarchical sum:
+#define GPAW_MPI_SEGMENT (1 << 18)
+
+// Node and leader communicators and two sets of shared-memory buffers
+// (one segment per rank plus one for the result) for hierarchical sums.
+// For testing on a single node, nfake > 1 splits each node into nfake
+// "nodes" (by rank modulo nfake).
+static int hierarchical_init(MPIObject *self, int nfake)
+{
+  if (self->shm != NULL)
+    return MPI_SUCCESS;
+  int node_rank;
+  int node_size;
+  MPI_Comm_split_type(self->comm, MPI_COMM_TYPE_SHARED, self->rank,
+                      MPI_INFO_NULL, &(self->node_comm));
+  if (nfake > 1)
+    {
+      MPI_Comm node_comm = self->node_comm;
+      MPI_Comm_split(node_comm, self->rank % nfake, self->rank,
+                     &(self->node_comm));
+      MPI_Comm_free(&node_comm);
+    }
+  MPI_Comm_rank(self->node_comm, &node_rank);
+  MPI_Comm_size(self->node_comm, &node_size);
+  MPI_Comm_split(self->comm, node_rank == 0 ? 0 : MPI_UNDEFINED, self->rank,
+                 &(self->leader_comm));
+  MPI_Aint nbytes = 2 * (MPI_Aint)(node_size + 1) * GPAW_MPI_SEGMENT;
+  void *data;
+  int ret = MPI_Win_allocate_shared(node_rank == 0 ? nbytes : 0, 1,
+                                    MPI_INFO_NULL, self->node_comm, &data,
+                                    &(self->shm_win));
+  if (ret != MPI_SUCCESS)
+    return ret;
+  int disp_unit;
+  MPI_Win_shared_query(self->shm_win, 0, &nbytes, &disp_unit, &data);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, self->shm_win);
+  self->shm = data;
+  return MPI_SUCCESS;
+}
+
+// Make writes to the shared buffers visible to the whole node.
+static void shm_barrier(MPIObject *self)
+{
+  MPI_Win_sync(self->shm_win);
+  MPI_Barrier(self->node_comm);
+  MPI_Win_sync(self->shm_win);
+}
+
+#define SHM_SUM(T)                                              \
+  {                                                             \
+    T* r = (T*)res;                                             \
+    const T* x = (const T*)slots;                               \
+    for (size_t i = i1; i < i2; i++)                            \
+      r[i] = x[i];                                              \
+    for (int j = 1; j < nslots; j++)                            \
+      {                                                         \
+        x = (const T*)(slots + j * (size_t)GPAW_MPI_SEGMENT);   \
+        _Pragma("omp simd")                                     \
+        for (size_t i = i1; i < i2; i++)                        \
+          r[i] += x[i];                                         \
+      }                                                         \
+  }
+
+// res[i1:i2] = sum of the nslots segments in slots.
+static void shm_sum(MPI_Datatype datatype, const char* slots, int nslots,
+                    char* res, size_t i1, size_t i2)
+{
+  if (datatype == MPI_DOUBLE)
+    SHM_SUM(double)
+  else
+    SHM_SUM(long)
+}
+
+// In-place sum over all ranks: shared-memory reduction on each node
+// (every rank sums a slice), allreduce among the node leaders and
+// copy-out from shared memory.  Segments are double-buffered so that
+// the leaders' MPI_Iallreduce of one segment overlaps with the
+// intra-node reduction of the next.
+static int mpi_sum_hierarchical(MPIObject *self, char* data,
+                                MPI_Datatype datatype, size_t n,
+                                int elemsize)
+{
+  int ret = hierarchical_init(self, 1);
+  if (ret != MPI_SUCCESS)
+    return ret;
+  int node_rank;
+  int node_size;
+  MPI_Comm_rank(self->node_comm, &node_rank);
+  MPI_Comm_size(self->node_comm, &node_size);
+  size_t m = GPAW_MPI_SEGMENT / elemsize;  // elements per segment
+  size_t nseg = (n + m - 1) / m;
+  char* slots[2];
+  char* res[2];
+  for (int b = 0; b < 2; b++)
+    {
+      slots[b] = self->shm + b * (size_t)(node_size + 1) * GPAW_MPI_SEGMENT;
+      res[b] = slots[b] + node_size * (size_t)GPAW_MPI_SEGMENT;
+    }
+  MPI_Request rq = MPI_REQUEST_NULL;
+  for (size_t k = 0; k <= nseg; k++)
+    {
+      int b = k % 2;
+      size_t mk = 0;
+      if (k < nseg)
+        {
+          mk = n - k * m < m ? n - k * m : m;
+          memcpy(slots[b] + node_rank * (size_t)GPAW_MPI_SEGMENT,
+                 data + k * m * elemsize, mk * elemsize);
+          shm_barrier(self);
+          shm_sum(datatype, slots[b], node_size, res[b],
+                  mk * node_rank / node_size,
+                  mk * (node_rank + 1) / node_size);
+          // All slices of res[b] must be done before the leader sends it:
+          shm_barrier(self);
+        }
+      if (self->leader_comm != MPI_COMM_NULL)
+        {
+          ret = MPI_Wait(&rq, MPI_STATUS_IGNORE);
+          if (ret == MPI_SUCCESS && k < nseg)
+            ret = MPI_Iallreduce(MPI_IN_PLACE, res[b], mk, datatype,
+                                 MPI_SUM, self->leader_comm, &rq);
+          // The other ranks of the node are already waiting in
+          // shm_barrier() and the other leaders in the allreduce, so
+          // there is no way to return cleanly:
+          if (ret != MPI_SUCCESS)
+            {
+              fprintf(stderr, "Hierarchical sum: MPI error %d\n", ret);
+              MPI_Abort(self->comm, ret);
+            }
+        }
+      shm_barrier(self);
+      if (k > 0)
+        {
+          size_t mk1 = n - (k - 1) * m < m ? n - (k - 1) * m : m;
+          memcpy(data + (k - 1) * m * elemsize, res[1 - b], mk1 * elemsize);
+        }
+    }
+  return MPI_SUCCESS;
+}
+
+static PyObject * mpi_setup_hierarchical(MPIObject *self, PyObject *args)
+{
+  int nfake = 1;
+  if (!PyArg_ParseTuple(args, "|i:setup_hierarchical", &nfake))
+    return NULL;
+  if (self->shm != NULL)
+    {
+      PyErr_SetString(PyExc_RuntimeError,
+                      "Hierarchical sums already set up.");
+      return NULL;
+    }
+  if (hierarchical_init(self, nfake) != MPI_SUCCESS)
+    {
+      PyErr_SetString(PyExc_RuntimeError,
+                      "MPI_Win_allocate_shared error occurred.");
+      return NULL;
+    }
+  Py_RETURN_NONE;
+}
+
 static PyObject * mpi_reduce(MPIObject *self, PyObject *args, PyObject *kwargs,
 			     MPI_Op operation, int allowcomplex)
 {
@@ -643,12 +962,27 @@ static PyObject * mpi_reduce(MPIObject *self, PyObject *args, PyObject *kwargs,
 #endif
   PyObject* obj;
   int root = -1;
-  static char *kwlist[] = {"a", "root", NULL};
+  int block = 1;
+  int hierarchical = 0;
+  static char *kwlist[] = {"a", "root", "block", "hierarchical", NULL};
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i:reduce", kwlist,
-				   &obj, &root))
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|iii:reduce", kwlist,
+				   &obj, &root, &block, &hierarchical))
     return NULL;
   CHK_PROC_DEF(root);
+  if (hierarchical && operation != MPI_SUM)
+    {
+      PyErr_SetString(PyExc_ValueError,
+		      "Hierarchical reductions are only done for sums");
+      return NULL;
+    }
+  if (!block && (PyFloat_Check(obj) || PyLong_Check(obj) ||
+                 PyComplex_Check(obj)))
+    {
+      PyErr_SetString(PyExc_ValueError,
+		      "Non-blocking reductions are only done on arrays");
+      return NULL;
+    }
   if (PyFloat_Check(obj))
     {
       double din = PyFloat_AS_DOUBLE(obj);
@@ -713,6 +1047,39 @@ static PyObject * mpi_reduce(MPIObject *self, PyObject *args, PyObject *kwargs,
 	      return NULL;
 	    }
 	}
+      if (!block)
+	{
+	  // MPI_Iallreduce/MPI_Ireduce are MPI-3, which always has
+	  // MPI_IN_PLACE.
+	  GPAW_MPI_Request *req = NewCollectiveRequest(aobj);
+	  if (req == NULL) return NULL;
+          maybeSynchronize(aobj);
+	  int ret;
+	  if (root == -1)
+	    ret = MPI_Iallreduce(MPI_IN_PLACE, Array_BYTES(aobj), n, datatype,
+				 operation, self->comm, &(req->rq));
+	  else if (root == self->rank)
+	    ret = MPI_Ireduce(MPI_IN_PLACE, Array_BYTES(aobj), n, datatype,
+			      operation, root, self->comm, &(req->rq));
+	  else
+	    ret = MPI_Ireduce(Array_BYTES(aobj), NULL, n, datatype,
+			      operation, root, self->comm, &(req->rq));
+	  return collective_started(req, ret, root == -1 ? "MPI_Iallreduce"
+				    : "MPI_Ireduce");
+	}
+      if (root == -1 && hierarchical && PyArray_Check(aobj) &&
+	  (datatype == MPI_DOUBLE || datatype == MPI_LONG))
+	{
+	  if (mpi_sum_hierarchical(self, Array_BYTES(aobj), datatype,
+				   Array_NBYTES(aobj) / elemsize,
+				   elemsize) != MPI_SUCCESS)
+	    {
+	      PyErr_SetString(PyExc_RuntimeError,
+			      "Hierarchical sum error occurred.");
+	      return NULL;
+	    }
+	  Py_RETURN_NONE;
+	}
       if (root == -1)
 	{
           maybeSynchronize(aobj);
@@ -871,33 +1238,58 @@ static PyObject * mpi_scatter(MPIObject *self, PyObject *args)
     CHK_ARRAYS(recvobj, sendobj, self->size); // size(send) = size(recv)*Ncpu
     source = Array_BYTES(sendobj);
   }
-  int n = Array_ITEMSIZE(recvobj);
-  for (int d = 0; d < Array_NDIM(recvobj); d++)
-    n *= Array_DIM(recvobj,d);
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(recvobj), &n, &type);
   maybeSynchronize(recvobj);
-  MPI_Scatter(source, n, MPI_BYTE, Array_BYTES(recvobj),
-	      n, MPI_BYTE, root, self->comm);
+  MPI_Scatter(source, n, type, Array_BYTES(recvobj),
+	      n, type, root, self->comm);
+  if (derived)
+    MPI_Type_free(&type);
   Py_RETURN_NONE;
 }
 
 
 
-static PyObject * mpi_allgather(MPIObject *self, PyObject *args)
+static PyObject * mpi_allgather(MPIObject *self, PyObject *args,
+                                PyObject *kwargs)
 {
   PyObject* a;
   PyObject* b;
-  if (!PyArg_ParseTuple(args, "OO:allgather", &a, &b))
+  int block = 1;
+  static char *kwlist[] = {"a", "b", "block", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|i:allgather", kwlist,
+                                   &a, &b, &block))
     return NULL;
   CHK_ARRAY(a);
   CHK_ARRAY(b);
   CHK_ARRAYS(a, b, self->size);
-  int n = Array_ITEMSIZE(a);
-  for (int d = 0; d < Array_NDIM(a); d++)
-    n *= Array_DIM(a,d);
+  GPAW_MPI_Request *req = NULL;
+  if (!block)
+    {
+      PyObject* ab = PyTuple_Pack(2, a, b);
+      if (ab == NULL) return NULL;
+      req = NewCollectiveRequest(ab);
+      Py_DECREF(ab);
+      if (req == NULL) return NULL;
+    }
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(a), &n, &type);
   // What about endianness????
   maybeSynchronize(a);
-  MPI_Allgather(Array_BYTES(a), n, MPI_BYTE, Array_BYTES(b), n,
-		MPI_BYTE, self->comm);
+  if (!block)
+    {
+      int ret = MPI_Iallgather(Array_BYTES(a), n, type, Array_BYTES(b), n,
+                               type, self->comm, &(req->rq));
+      if (derived)
+        MPI_Type_free(&type);
+      return collective_started(req, ret, "MPI_Iallgather");
+    }
+  MPI_Allgather(Array_BYTES(a), n, type, Array_BYTES(b), n,
+		type, self->comm);
+  if (derived)
+    MPI_Type_free(&type);
   Py_RETURN_NONE;
 }
 
@@ -922,25 +1314,31 @@ static PyObject * mpi_gather(MPIObject *self, PyObject *args)
 		      "mpi_gather: b array should not be given on non-root processors.");
       return NULL;
     }
-  int n = Array_ITEMSIZE(a);
-  for (int d = 0; d < Array_NDIM(a); d++)
-    n *= Array_DIM(a,d);
+  int n;
+  MPI_Datatype type;
+  int derived = mpi_bytes(array_nbytes(a), &n, &type);
   maybeSynchronize(a);
   if (root != self->rank)
-    MPI_Gather(Array_BYTES(a), n, MPI_BYTE, 0, n, MPI_BYTE, root, self->comm);
+    MPI_Gather(Array_BYTES(a), n, type, 0, n, type, root, self->comm);
   else
-    MPI_Gather(Array_BYTES(a), n, MPI_BYTE, Array_BYTES(b), n, MPI_BYTE, root, self->comm);
+    MPI_Gather(Array_BYTES(a), n, type, Array_BYTES(b), n, type, root, self->comm);
+  if (derived)
+    MPI_Type_free(&type);
   Py_RETURN_NONE;
 }
 
-static PyObject * mpi_broadcast(MPIObject *self, PyObject *args)
+static PyObject * mpi_broadcast(MPIObject *self, PyObject *args,
+                                PyObject *kwargs)
 {
 #ifdef GPAW_MPI_DEBUG
   MPI_Barrier(self->comm);
 #endif
   PyObject* buf;
   int root;
-  if (!PyArg_ParseTuple(args, "Oi:broadcast", &buf, &root))
+  int block = 1;
+  static char *kwlist[] = {"a", "root", "block", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Oi|i:broadcast", kwlist,
+                                   &buf, &root, &block))
     return NULL;
   if (root == self->rank)
       CHK_ARRAY_RO(buf);
@@ -948,11 +1346,44 @@ static PyObject * mpi_broadcast(MPIObject *self, PyObject *args)
       CHK_ARRAY(buf);
 
   CHK_PROC(root);
-  int n = Array_ITEMSIZE(buf);
-  for (int d = 0; d < Array_NDIM(buf); d++)
-    n *= Array_DIM(buf,d);
+  size_t nbytes = array_nbytes(buf);
   maybeSynchronize(buf);
-  MPI_Bcast(Array_BYTES(buf), n, MPI_BYTE, root, self->comm);
+  if (!block)
+    {
+      GPAW_MPI_Request *req = NewCollectiveRequest(buf);
+      if (req == NULL) return NULL;
+      int n;
+      MPI_Datatype type;
+      int derived = mpi_bytes(nbytes, &n, &type);
+      int ret = MPI_Ibcast(Array_BYTES(buf), n, type, root, self->comm,
+                           &(req->rq));
+      if (derived)
+        MPI_Type_free(&type);
+      return collective_started(req, ret, "MPI_Ibcast");
+    }
+  if (nbytes <= INT_MAX)
+    {
+      MPI_Bcast(Array_BYTES(buf), (int)nbytes, MPI_BYTE, root, self->comm);
+      Py_RETURN_NONE;
+    }
+  // Pipeline: start all chunks so that they can progress concurrently.
+  int nchunks = (nbytes + GPAW_MPI_CHUNK - 1) / GPAW_MPI_CHUNK;
+  MPI_Request *rqs = GPAW_MALLOC(MPI_Request, nchunks);
+  char *p = Array_BYTES(buf);
+  for (int c = 0; c < nchunks; c++)
+    {
+      size_t offset = (size_t)c * GPAW_MPI_CHUNK;
+      int n = nbytes - offset < GPAW_MPI_CHUNK ? nbytes - offset
+                                               : GPAW_MPI_CHUNK;
+      MPI_Ibcast(p + offset, n, MPI_BYTE, root, self->comm, rqs + c);
+    }
+  int ret = MPI_Waitall(nchunks, rqs, MPI_STATUSES_IGNORE);
+  free(rqs);
+  if (ret != MPI_SUCCESS)
+    {
+      PyErr_SetString(PyExc_RuntimeError, "MPI_Ibcast error occurred.");
+      return NULL;
+    }
   Py_RETURN_NONE;
 }
 
@@ -1028,7 +1459,8 @@ static PyObject *mpi_translate_ranks(MPIObject *self, PyObject *args)
   return (PyObject*)other_ranks_anytype;
 }
 
-static PyObject * mpi_alltoallv(MPIObject *self, PyObject *args)
+static PyObject * mpi_alltoallv(MPIObject *self, PyObject *args,
+                                PyObject *kwargs)
 {
   PyObject* send_obj;
   PyObject* send_cnts;
@@ -1036,10 +1468,14 @@ static PyObject * mpi_alltoallv(MPIObject *self, PyObject *args)
   PyObject* recv_obj;
   PyObject* recv_cnts;
   PyObject* recv_displs;
+  int block = 1;
+  static char *kwlist[] = {"sbuffer", "scounts", "sdispls",
+                           "rbuffer", "rcounts", "rdispls", "block", NULL};
 
-  if (!PyArg_ParseTuple(args, "OOOOOO:alltoallv", &send_obj, &send_cnts,
-						  &send_displs, &recv_obj,
-						  &recv_cnts, &recv_displs))
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOOOO|i:alltoallv", kwlist,
+                                   &send_obj, &send_cnts, &send_displs,
+                                   &recv_obj, &recv_cnts, &recv_displs,
+                                   &block))
     return NULL;
   CHK_ARRAY(send_obj);
   CHK_ARRAY(send_cnts);
@@ -1048,39 +1484,120 @@ static PyObject * mpi_alltoallv(MPIObject *self, PyObject *args)
   CHK_ARRAY(recv_cnts);
   CHK_ARRAY(recv_displs);
 
-  int *s_cnts = GPAW_MALLOC(int, self->size);
-  int *s_displs = GPAW_MALLOC(int, self->size);
-  int *r_cnts = GPAW_MALLOC(int, self->size);
-  int *r_displs = GPAW_MALLOC(int, self->size);
-
-  /* Create count and displacement arrays in units of bytes */
-  int elem_size = Array_ITEMSIZE(send_obj);
+  // Counts and displacements are given in elements of a contiguous
+  // datatype of the array's item size, so that the byte counts may
+  // exceed 2 GiB.  One allocation for all four arrays, so that a
+  // non-blocking request can own them until it completes:
+  int *s_cnts = GPAW_MALLOC(int, 4 * self->size);
+  int *s_displs = s_cnts + self->size;
+  int *r_cnts = s_displs + self->size;
+  int *r_displs = r_cnts + self->size;
 
   long* tmp1 = Array_DATA(send_cnts);
   long* tmp2 = Array_DATA(send_displs);
   long* tmp3 = Array_DATA(recv_cnts);
   long* tmp4 = Array_DATA(recv_displs);
   for (int i=0; i < self->size; i++) {
-      s_cnts[i] = tmp1[i] * elem_size;
-      s_displs[i] = tmp2[i] * elem_size;
-      r_cnts[i] = tmp3[i] * elem_size;
-      r_displs[i] = tmp4[i] * elem_size;
+      if (tmp1[i] + tmp2[i] > INT_MAX || tmp3[i] + tmp4[i] > INT_MAX) {
+          free(s_cnts);
+          PyErr_SetString(PyExc_ValueError,
+                          "alltoallv: too many elements.");
+          return NULL;
+      }
+      s_cnts[i] = tmp1[i];
+      s_displs[i] = tmp2[i];
+      r_cnts[i] = tmp3[i];
+      r_displs[i] = tmp4[i];
   }
+  MPI_Datatype type;
+  MPI_Type_contiguous(Array_ITEMSIZE(send_obj), MPI_BYTE, &type);
+  MPI_Type_commit(&type);
   maybeSynchronize(send_obj);
 
+  if (!block)
+    {
+      GPAW_MPI_Request *req = NULL;
+      PyObject* sr = PyTuple_Pack(2, send_obj, recv_obj);
+      if (sr != NULL)
+        {
+          req = NewCollectiveRequest(sr);
+          Py_DECREF(sr);
+        }
+      if (req == NULL)
+        {
+          MPI_Type_free(&type);
+          free(s_cnts);
+          return NULL;
+        }
+      req->data = s_cnts;
+      int ret = MPI_Ialltoallv(Array_BYTES(send_obj),
+                               s_cnts, s_displs,
+                               type, Array_BYTES(recv_obj), r_cnts,
+                               r_displs, type, self->comm, &(req->rq));
+      MPI_Type_free(&type);
+      return collective_started(req, ret, "MPI_Ialltoallv");
+    }
+
   MPI_Alltoallv(Array_BYTES(send_obj),
 		s_cnts, s_displs,
-		MPI_BYTE, Array_BYTES(recv_obj), r_cnts,
-		r_displs, MPI_BYTE, self->comm);
+		type, Array_BYTES(recv_obj), r_cnts,
+		r_displs, type, self->comm);
 
+  MPI_Type_free(&type);
   free(s_cnts);
-  free(s_displs);
-  free(r_cnts);
-  free(r_displs);
 
   Py_RETURN_NONE;
 }
 
+// One array of nbytes bytes shared by all ranks of the communicator,
+// which must be on the same node (see split_shared()).  The memory is
+// allocated next to the first rank.
+static PyObject * mpi_allocate_shared(MPIObject *self, PyObject *args)
+{
+  Py_ssize_t nbytes;
+  if (!PyArg_ParseTuple(args, "n:allocate_shared", &nbytes))
+    return NULL;
+  if (nbytes < 0)
+    {
+      PyErr_SetString(PyExc_ValueError, "Negative size.");
+      return NULL;
+    }
+  GPAW_MPI_Window *window = PyObject_NEW(GPAW_MPI_Window,
+                                         &GPAW_MPI_Window_type);
+  if (window == NULL)
+    return NULL;
+  void *data;
+  int ret = MPI_Win_allocate_shared(self->rank == 0 ? nbytes : 0, 1,
+                                    MPI_INFO_NULL, self->comm, &data,
+                                    &(window->win));
+  if (ret == MPI_SUCCESS)
+    {
+      MPI_Aint size;
+      int disp_unit;
+      ret = MPI_Win_shared_query(window->win, 0, &size, &disp_unit, &data);
+    }
+  if (ret != MPI_SUCCESS)
+    {
+      PyObject_Del(window);
+      PyErr_SetString(PyExc_RuntimeError,
+                      "MPI_Win_allocate_shared error occurred.");
+      return NULL;
+    }
+  npy_intp dims[1] = {nbytes};
+  PyObject *a = PyArray_SimpleNewFromData(1, dims, NPY_UINT8, data);
+  if (a == NULL)
+    {
+      Py_DECREF(window);
+      return NULL;
+    }
+  if (PyArray_SetBaseObject((PyArrayObject *)a, (PyObject *)window) < 0)
+    {
+      Py_DECREF(a);
+      return NULL;
+    }
+  return a;
+}
+
 static PyObject * get_members(MPIObject *self, PyObject *args)
 {
   PyArrayObject *ranks;
@@ -1105,6 +1622,7 @@ static PyObject * get_c_object(MPIObject *self, PyObject *args)
 // that needs MPI_getattr that needs MPI_Methods that need
 // MPI_Communicator that need ...
 static PyObject * MPICommunicator(MPIObject *self, PyObject *args);
+static PyObject * mpi_split_shared(MPIObject *self, PyObject *noargs);
 
 static PyMethodDef mpi_methods[] = {
     {"sendreceive",          (PyCFunction)mpi_sendreceive,
@@ -1135,22 +1653,26 @@ static PyMethodDef mpi_methods[] = {
      "waitall(list_of_rqs) waits for multiple nonblocking communications to complete."},
     {"sum",              (PyCFunction)mpi_sum,
      METH_VARARGS|METH_KEYWORDS,
-     "sum(a, root=-1) sums arrays, result on all tasks unless root is given."},
+     "sum(a, root=-1, block=1, hierarchical=0) sums arrays, result on all tasks unless root is given."},
+    {"setup_hierarchical", (PyCFunction)mpi_setup_hierarchical,
+     METH_VARARGS,
+     "setup_hierarchical(fake_nodes=1) creates node communicators and "
+     "buffers for hierarchical sums now."},
     {"sum_scalar",       (PyCFunction)mpi_sum_scalar,
      METH_VARARGS|METH_KEYWORDS,
      "sum_scalar(a, root=-1) sums numbers, result on all tasks unless root is given. Returns the sum."},
     {"product",          (PyCFunction)mpi_product,
      METH_VARARGS|METH_KEYWORDS,
-     "product(a, root=-1) multiplies arrays, result on all tasks unless root is given."},
+     "product(a, root=-1, block=1) multiplies arrays, result on all tasks unless root is given."},
     {"max",              (PyCFunction)mpi_max,
      METH_VARARGS|METH_KEYWORDS,
-     "max(a, root=-1) maximum of arrays, result on all tasks unless root is given."},
+     "max(a, root=-1, block=1) maximum of arrays, result on all tasks unless root is given."},
     {"max_scalar",       (PyCFunction)mpi_max_scalar,
      METH_VARARGS|METH_KEYWORDS,
      "max_sclar(a, root=-1) maximum of scalars, result on all tasks unless root is given. Returns the value."},
     {"min",              (PyCFunction)mpi_min,
      METH_VARARGS|METH_KEYWORDS,
-     "min(a, root=-1) minimum of arrays, result on all tasks unless root is given."},
+     "min(a, root=-1, block=1) minimum of arrays, result on all tasks unless root is given."},
     {"min_scalar",       (PyCFunction)mpi_min_scalar,
      METH_VARARGS|METH_KEYWORDS,
      "min_scalar(a, root=-1) minimum of scalars, result on all tasks unless root is given. Returns the value."},
@@ -1158,12 +1680,15 @@ static PyMethodDef mpi_methods[] = {
      "scatter(src, target, root) distributes array from root task."},
     {"gather",           (PyCFunction)mpi_gather,       METH_VARARGS,
      "gather(src, root, target=None) gathers data from all tasks on root task."},
-    {"all_gather",       (PyCFunction)mpi_allgather,    METH_VARARGS,
-     "all_gather(src, target) gathers data from all tasks on all tasks."},
-    {"alltoallv",       (PyCFunction)mpi_alltoallv,    METH_VARARGS,
-     "alltoallv(sbuf, scnt, sdispl, rbuf, ...) send data from all tasks to all tasks."},
-    {"broadcast",        (PyCFunction)mpi_broadcast,    METH_VARARGS,
-     "broadcast(buffer, root) Broadcast data in-place from root task."},
+    {"all_gather",       (PyCFunction)mpi_allgather,
+     METH_VARARGS|METH_KEYWORDS,
+     "all_gather(src, target, block=1) gathers data from all tasks on all tasks."},
+    {"alltoallv",       (PyCFunction)mpi_alltoallv,
+     METH_VARARGS|METH_KEYWORDS,
+     "alltoallv(sbuf, scnt, sdispl, rbuf, ..., block=1) send data from all tasks to all tasks."},
+    {"broadcast",        (PyCFunction)mpi_broadcast,
+     METH_VARARGS|METH_KEYWORDS,
+     "broadcast(buffer, root, block=1) Broadcast data in-place from root task."},
     {"compare",          (PyCFunction)mpi_compare,      METH_VARARGS,
      "compare two communicators for identity using MPI_Comm_compare."},
     {"translate_ranks",  (PyCFunction)mpi_translate_ranks, METH_VARARGS,
@@ -1172,6 +1697,11 @@ static PyMethodDef mpi_methods[] = {
     {"get_c_object",     (PyCFunction)get_c_object,     METH_VARARGS, 0},
     {"new_communicator", (PyCFunction)MPICommunicator,  METH_VARARGS,
      "new_communicator(ranks) creates a new communicator."},
+    {"split_shared",     (PyCFunction)mpi_split_shared, METH_NOARGS,
+     "split_shared() creates a communicator for the ranks on this node."},
+    {"allocate_shared",  (PyCFunction)mpi_allocate_shared, METH_VARARGS,
+     "allocate_shared(nbytes) allocates a uint8 array shared by all ranks "
+     "of a node communicator."},
     {0, 0, 0, 0}
 };
 
@@ -1201,6 +1731,9 @@ static PyObject *NewMPIObject(PyTypeObject* type, PyObject *args,
     MPI_Comm_size(MPI_COMM_WORLD, &(self->size));
     MPI_Comm_rank(MPI_COMM_WORLD, &(self->rank));
     self->comm = MPI_COMM_WORLD;
+    self->node_comm = MPI_COMM_NULL;
+    self->leader_comm = MPI_COMM_NULL;
+    self->shm = NULL;
     Py_INCREF(Py_None);
     self->parent = Py_None;
     self->members = (int*) malloc(self->size*sizeof(int));
@@ -1342,6 +1875,9 @@ static PyObject * MPICommunicator(MPIObject *self, PyObject *args)
       MPI_Comm_size(comm, &(obj->size));
       MPI_Comm_rank(comm, &(obj->rank));
       obj->comm = comm;
+      obj->node_comm = MPI_COMM_NULL;
+      obj->leader_comm = MPI_COMM_NULL;
+      obj->shm = NULL;
       if (obj->parent == Py_None)
 	Py_DECREF(obj->parent);
       obj->members = (int*) malloc(obj->size*sizeof(int));
@@ -1358,6 +1894,40 @@ static PyObject * MPICommunicator(MPIObject *self, PyObject *args)
     }
 }
 
+static PyObject * mpi_split_shared(MPIObject *self, PyObject *noargs)
+{
+  MPI_Comm comm;
+  MPI_Comm_split_type(self->comm, MPI_COMM_TYPE_SHARED, self->rank,
+                      MPI_INFO_NULL, &comm);
+  MPIObject *obj = PyObject_NEW(MPIObject, &MPIType);
+  if (obj == NULL)
+    {
+      MPI_Comm_free(&comm);
+      return NULL;
+    }
+  MPI_Comm_size(comm, &(obj->size));
+  MPI_Comm_rank(comm, &(obj->rank));
+  obj->comm = comm;
+  obj->node_comm = MPI_COMM_NULL;
+  obj->leader_comm = MPI_COMM_NULL;
+  obj->shm = NULL;
+  // Ranks in the new communicator and their ranks in this one:
+  obj->members = GPAW_MALLOC(int, obj->size);
+  int *ranks = GPAW_MALLOC(int, obj->size);
+  for (int i = 0; i < obj->size; i++)
+    ranks[i] = i;
+  MPI_Group group, newgroup;
+  MPI_Comm_group(self->comm, &group);
+  MPI_Comm_group(comm, &newgroup);
+  MPI_Group_translate_ranks(newgroup, obj->size, ranks, group, obj->members);
+  MPI_Group_free(&newgroup);
+  MPI_Group_free(&group);
+  free(ranks);
+  Py_INCREF(self);
+  obj->parent = (PyObject*)self;
+  return (PyObject*)obj;
+}
+
 
 PyObject* globally_broadcast_bytes(PyObject *self, PyObject *args)
 {
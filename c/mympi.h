@@ -9,5 +9,10 @@ typedef struct
   MPI_Comm comm;
   PyObject* parent;
   int* members;
+  // Created on first use by hierarchical sums:
+  MPI_Comm node_comm;    // ranks on this node
+  MPI_Comm leader_comm;  // first rank of each node (MPI_COMM_NULL elsewhere)
+  MPI_Win shm_win;       // shared-memory buffers of the node
+  char* shm;
 } MPIObject;
 
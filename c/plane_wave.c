@@ -26,50 +26,225 @@ void _pw_insert(int nG,
 }
 
 
+void _pw_insert_mirror(int nG,
+                       int N0,
+                       int N1,
+                       int M2,
+                       npy_int32* Q_G,
+                       double complex* tmp_Q)
+// Complete the Q_z=0 plane of a half-complex box so that
+// tmp_Q[-i0, -i1, 0] = tmp_Q[i0, i1, 0]^*.  Only the points in Q_G are
+// visited, so this is cheap compared to a pass over the box.
+{
+    for (int G = 0; G < nG; G++) {
+        int Q = Q_G[G];
+        if (Q % M2 != 0 || Q == 0)
+            continue;
+        int i0 = Q / (N1 * M2);
+        int i1 = (Q / M2) % N1;
+        int Qm = (((N0 - i0) % N0) * N1 + (N1 - i1) % N1) * M2;
+        tmp_Q[Qm] = conj(tmp_Q[Q]);
+    }
+}
+
+
 PyObject *pw_insert(PyObject *self, PyObject *args)
-// Python wrapper
+// Python wrapper.
+//
+// c_G can also be a block of bands (nb, nG) with tmp_Q of shape
+// (nb, ...).  With hermitian=1, tmp_Q must be a (..., N0, N1, M2)
+// half-complex box for a real-valued function and the Q_z=0 plane is
+// completed for the c2r transform.
 {
     PyArrayObject *c_G_obj, *Q_G_obj, *tmp_Q_obj;
     double scale;
-    if (!PyArg_ParseTuple(args, "OOdO",
-                          &c_G_obj, &Q_G_obj, &scale, &tmp_Q_obj))
+    int hermitian = 0;
+    if (!PyArg_ParseTuple(args, "OOdO|i",
+                          &c_G_obj, &Q_G_obj, &scale, &tmp_Q_obj,
+                          &hermitian))
         return NULL;
     double complex *c_G = PyArray_DATA(c_G_obj);
     npy_int32 *Q_G = PyArray_DATA(Q_G_obj);
     double complex *tmp_Q = PyArray_DATA(tmp_Q_obj);
-    int nG = PyArray_SIZE(c_G_obj);
-    int nQ = PyArray_SIZE(tmp_Q_obj);
-    _pw_insert(nG, nQ, c_G, Q_G, scale, tmp_Q);
+    int nb = 1;
+    if (PyArray_NDIM(c_G_obj) == 2)
+        nb = PyArray_DIM(c_G_obj, 0);
+    if (nb == 0)
+        Py_RETURN_NONE;
+    int nG = PyArray_SIZE(c_G_obj) / nb;
+    int nQ = PyArray_SIZE(tmp_Q_obj) / nb;
+    int N0 = 0, N1 = 0, M2 = 0;
+    if (hermitian) {
+        int ndim = PyArray_NDIM(tmp_Q_obj);
+        if (ndim < 3) {
+            PyErr_SetString(PyExc_ValueError,
+                            "hermitian=1 needs a 3-d box");
+            return NULL;
+        }
+        N0 = PyArray_DIM(tmp_Q_obj, ndim - 3);
+        N1 = PyArray_DIM(tmp_Q_obj, ndim - 2);
+        M2 = PyArray_DIM(tmp_Q_obj, ndim - 1);
+    }
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nb; b++) {
+        double complex* tmp_bQ = tmp_Q + (size_t)b * nQ;
+        _pw_insert(nG, nQ, c_G + (size_t)b * nG, Q_G, scale, tmp_bQ);
+        if (hermitian)
+            _pw_insert_mirror(nG, N0, N1, M2, Q_G, tmp_bQ);
+    }
     Py_RETURN_NONE;
 }
 
 
+static void _pw_precond(int nG,
+                        const double* G2_G,
+                        const double* R_G,
+                        double ekin,
+                        double* out_G)
+// Real and imaginary parts are interleaved in R_G and out_G.
+{
+    double c = 1.0 / ekin / 3;
+    double d = -4.0 / 3 / ekin;
+#pragma omp simd
+    for (int G = 0; G < nG; G++) {
+        double x = c * G2_G[G];
+        double a = 27.0 + x * (18.0 + x * (12.0 + x * 8.0));
+        double xx = x * x;
+        double f = d * a / (a + 16.0 * xx * xx);
+        out_G[2 * G] = f * R_G[2 * G];
+        out_G[2 * G + 1] = f * R_G[2 * G + 1];
+    }
+}
+
+
 PyObject *pw_precond(PyObject *self, PyObject *args)
+// Teter-Payne-Allan preconditioner.
+//
+// Either a single residual with a float ekin, or a block of residuals
+// R_nG with one kinetic energy per band in the array ekin_n.
 {
     PyArrayObject *G2_G_obj;
     PyArrayObject *R_G_obj;
-    double ekin;
+    PyObject *ekin_obj;
     PyArrayObject *out_G_obj;
 
-    if (!PyArg_ParseTuple(args, "OOdO",
-                          &G2_G_obj, &R_G_obj, &ekin, &out_G_obj))
+    if (!PyArg_ParseTuple(args, "OOOO",
+                          &G2_G_obj, &R_G_obj, &ekin_obj, &out_G_obj))
         return NULL;
 
     double *G2_G = PyArray_DATA(G2_G_obj);
-    double complex *R_G = PyArray_DATA(R_G_obj);
-    double complex *out_G = PyArray_DATA(out_G_obj);
+    double *R_G = PyArray_DATA(R_G_obj);
+    double *out_G = PyArray_DATA(out_G_obj);
     int nG = PyArray_SIZE(G2_G_obj);
 
-    for (int G = 0; G < nG; G++) {
-        double x = 1 / ekin / 3 * G2_G[G];
-        double a = 27.0 + x * (18.0 + x * (12.0 + x * 8.0));
-        double xx = x * x;
-        out_G[G] = -4.0 / 3 / ekin * a / (a + 16.0 * xx * xx) * R_G[G];
+    if (!PyArray_Check(ekin_obj)) {
+        double ekin = PyFloat_AsDouble(ekin_obj);
+        if (PyErr_Occurred())
+            return NULL;
+        _pw_precond(nG, G2_G, R_G, ekin, out_G);
+        Py_RETURN_NONE;
+    }
+
+    PyArrayObject *ekin_n_obj = (PyArrayObject*)ekin_obj;
+    int nn = PyArray_SIZE(ekin_n_obj);
+    if (PyArray_TYPE(ekin_n_obj) != NPY_DOUBLE ||
+        !PyArray_IS_C_CONTIGUOUS(R_G_obj) ||
+        !PyArray_IS_C_CONTIGUOUS(out_G_obj) ||
+        PyArray_SIZE(R_G_obj) != (npy_intp)nn * nG ||
+        PyArray_SIZE(out_G_obj) != (npy_intp)nn * nG) {
+        PyErr_SetString(PyExc_ValueError, "Bad block of residuals");
+        return NULL;
     }
+    double *ekin_n = PyArray_DATA(ekin_n_obj);
+#pragma omp parallel for schedule(static)
+    for (int n = 0; n < nn; n++)
+        _pw_precond(nG, G2_G, R_G + 2 * (size_t)n * nG, ekin_n[n],
+                    out_G + 2 * (size_t)n * nG);
     Py_RETURN_NONE;
 }
 
 
+// Position-independent (f_Gs, Y_GL) and position-dependent
+// (emiGR_Ga) tables for a collection of atom-centered functions:
+typedef struct
+{
+    const double *f_Gs;
+    const double complex *emiGR_Ga;
+    const double *Y_GL;
+    const npy_int32 *l_s;
+    const npy_int32 *a_J;
+    const npy_int32 *s_J;
+    int nG;
+    int nJ;
+    int nL;
+    int natoms;
+    int nsplines;
+    int nI;
+} pwlfc_tables;
+
+
+static void pwlfc_init_tables(pwlfc_tables *t,
+                              PyArrayObject *f_Gs_obj,
+                              PyArrayObject *emiGR_Ga_obj,
+                              PyArrayObject *Y_GL_obj,
+                              PyArrayObject *l_s_obj,
+                              PyArrayObject *a_J_obj,
+                              PyArrayObject *s_J_obj)
+{
+    t->f_Gs = PyArray_DATA(f_Gs_obj);
+    t->emiGR_Ga = PyArray_DATA(emiGR_Ga_obj);
+    t->Y_GL = PyArray_DATA(Y_GL_obj);
+    t->l_s = PyArray_DATA(l_s_obj);
+    t->a_J = PyArray_DATA(a_J_obj);
+    t->s_J = PyArray_DATA(s_J_obj);
+    t->nG = PyArray_DIM(emiGR_Ga_obj, 0);
+    t->nJ = PyArray_DIM(a_J_obj, 0);
+    t->nL = PyArray_DIM(Y_GL_obj, 1);
+    t->natoms = PyArray_DIM(emiGR_Ga_obj, 1);
+    t->nsplines = PyArray_DIM(f_Gs_obj, 1);
+    t->nI = 0;
+    for (int J = 0; J < t->nJ; J++)
+        t->nI += 2 * t->l_s[t->s_J[J]] + 1;
+}
+
+
+static void _pwlfc_expand(const pwlfc_tables *t, int G1, int G2,
+                          int cc, int split, double *f_GI)
+// Complex layout: (G, I) pairs of doubles.  Split layout for real
+// wave functions: a row of real parts followed by a row of imaginary
+// parts for each G.  Either way 2 * nI doubles per G.
+{
+    int nI = t->nI;
+    double complex imag_powers[4] = {1.0, -I, -1.0, I};
+
+#pragma omp parallel for schedule(static)
+    for (int G = G1; G < G2; G++) {
+        const double *f_s = t->f_Gs + (size_t)G * t->nsplines;
+        const double complex *emiGR_a = t->emiGR_Ga + (size_t)G * t->natoms;
+        const double *Y_L = t->Y_GL + (size_t)G * t->nL;
+        double *re_I = f_GI + 2 * (size_t)(G - G1) * nI;
+        double *im_I = split ? re_I + nI : re_I + 1;
+        int step = split ? 1 : 2;
+        for (int J = 0; J < t->nJ; J++) {
+            int s = t->s_J[J];
+            int l = t->l_s[s];
+            double complex f1 = (emiGR_a[t->a_J[J]] *
+                                 f_s[s] *
+                                 imag_powers[l % 4]);
+            double re = creal(f1);
+            double im = cc ? -cimag(f1) : cimag(f1);
+            const double *Y_m = Y_L + l * l;
+            for (int m = 0; m < 2 * l + 1; m++) {
+                *re_I = re * Y_m[m];
+                *im_I = im * Y_m[m];
+                re_I += step;
+                im_I += step;
+            }
+        }
+    }
+}
+
+
 PyObject *pwlfc_expand(PyObject *self, PyObject *args)
 {
     PyArrayObject *f_Gs_obj;
@@ -87,65 +262,200 @@ PyObject *pwlfc_expand(PyObject *self, PyObject *args)
                           &cc, &f_GI_obj))
         return NULL;
 
-    double *f_Gs = PyArray_DATA(f_Gs_obj);
-    double complex *emiGR_Ga = PyArray_DATA(emiGR_Ga_obj);
-    double *Y_GL = PyArray_DATA(Y_GL_obj);
-    npy_int32 *l_s = PyArray_DATA(l_s_obj);
-    npy_int32 *a_J = PyArray_DATA(a_J_obj);
-    npy_int32 *s_J = PyArray_DATA(s_J_obj);
-    double *f_GI = PyArray_DATA(f_GI_obj);
+    pwlfc_tables t;
+    pwlfc_init_tables(&t, f_Gs_obj, emiGR_Ga_obj, Y_GL_obj,
+                      l_s_obj, a_J_obj, s_J_obj);
+    _pwlfc_expand(&t, 0, t.nG, cc, PyArray_ITEMSIZE(f_GI_obj) == 8,
+                  PyArray_DATA(f_GI_obj));
+    Py_RETURN_NONE;
+}
 
-    int nG = PyArray_DIM(emiGR_Ga_obj, 0);
-    int nJ = PyArray_DIM(a_J_obj, 0);
-    int nL = PyArray_DIM(Y_GL_obj, 1);
-    int natoms = PyArray_DIM(emiGR_Ga_obj, 1);
-    int nsplines = PyArray_DIM(f_Gs_obj, 1);
 
-    double complex imag_powers[4] = {1.0, -I, -1.0, I};
+#ifndef GPAW_WITHOUT_BLAS
+#ifdef GPAW_NO_UNDERSCORE_BLAS
+#  define dgemm_  dgemm
+#  define zgemm_  zgemm
+#endif
+void dgemm_(char *transa, char *transb, int *m, int * n,
+            int *k, double *alpha, double *a, int *lda,
+            double *b, int *ldb, double *beta,
+            double *c, int *ldc);
+void zgemm_(char *transa, char *transb, int *m, int * n,
+            int *k, void *alpha, void *a, int *lda,
+            void *b, int *ldb, void *beta,
+            void *c, int *ldc);
 
-    if (PyArray_ITEMSIZE(f_GI_obj) == 16)
-        for(int G = 0; G < nG; G++) {
-            for (int J = 0; J < nJ; J++) {
-                int s = s_J[J];
-                int l = l_s[s];
-                double complex f1 = (emiGR_Ga[a_J[J]] *
-                                     f_Gs[s] *
-                                     imag_powers[l % 4]);
-                for (int m = 0; m < 2 * l + 1; m++) {
-                    double complex f = f1 * Y_GL[l * l + m];
-                    *f_GI++ = creal(f);
-                    *f_GI++ = cc ? -cimag(f) : cimag(f);
-                }
-            }
-            f_Gs += nsplines;
-            emiGR_Ga += natoms;
-            Y_GL += nL;
+
+static int pwlfc_block_size(const pwlfc_tables *t)
+// Number of G-vectors per block so that the expanded f_GI block
+// (16 * nI bytes per G) stays around 2 MiB.
+{
+    int B = (1 << 21) / (16 * (t->nI > 0 ? t->nI : 1));
+    return B < 32 ? 32 : B;
+}
+
+
+static int pwlfc_check_xG(PyArrayObject *a_xG_obj, int nG, int *nx, int *ld)
+{
+    int itemsize = PyArray_ITEMSIZE(a_xG_obj);
+    if (PyArray_NDIM(a_xG_obj) != 2 ||
+        PyArray_STRIDE(a_xG_obj, 1) != itemsize ||
+        PyArray_STRIDE(a_xG_obj, 0) % itemsize != 0 ||
+        PyArray_DIM(a_xG_obj, 1) != nG) {
+        PyErr_SetString(PyExc_ValueError,
+                        "Expected a_xG with shape (nx, nG) and "
+                        "contiguous rows");
+        return 0;
+    }
+    *nx = PyArray_DIM(a_xG_obj, 0);
+    *ld = PyArray_STRIDE(a_xG_obj, 0) / itemsize;
+    return 1;
+}
+
+
+PyObject *pwlfc_integrate(PyObject *self, PyObject *args)
+// Calculate b_xI += alpha * sum_G a_xG * f_GI without storing f_GI
+// for more than one block of G-vectors at a time.
+//
+// For complex wave functions f_GI is complex conjugated.  For real
+// wave functions a_xG is a float array of shape (nx, 2 * nG) and the
+// split layout is used.  If g0 is true, the first G-vector is G=0 and
+// it is only counted with half weight (only half of the G-vectors are
+// stored for real wave functions).
+{
+    PyArrayObject *f_Gs_obj;
+    PyArrayObject *emiGR_Ga_obj;
+    PyArrayObject *Y_GL_obj;
+    PyArrayObject *l_s_obj;
+    PyArrayObject *a_J_obj;
+    PyArrayObject *s_J_obj;
+    PyArrayObject *a_xG_obj;
+    double alpha;
+    int g0;
+    PyArrayObject *b_xI_obj;
+
+    if (!PyArg_ParseTuple(args, "OOOOOOOdiO",
+                          &f_Gs_obj, &emiGR_Ga_obj, &Y_GL_obj,
+                          &l_s_obj, &a_J_obj, &s_J_obj,
+                          &a_xG_obj, &alpha, &g0, &b_xI_obj))
+        return NULL;
+
+    pwlfc_tables t;
+    pwlfc_init_tables(&t, f_Gs_obj, emiGR_Ga_obj, Y_GL_obj,
+                      l_s_obj, a_J_obj, s_J_obj);
+
+    int real = PyArray_ITEMSIZE(a_xG_obj) == 8;
+    int nx;
+    int ld;
+    if (!pwlfc_check_xG(a_xG_obj, real ? 2 * t.nG : t.nG, &nx, &ld))
+        return NULL;
+    if (!PyArray_IS_C_CONTIGUOUS(b_xI_obj) ||
+        PyArray_SIZE(b_xI_obj) != (npy_intp)nx * t.nI) {
+        PyErr_SetString(PyExc_ValueError, "Bad b_xI array");
+        return NULL;
+    }
+    if (nx == 0 || t.nI == 0)
+        Py_RETURN_NONE;
+
+    int B = pwlfc_block_size(&t);
+    double *f_GI = GPAW_MALLOC(double, 2 * (size_t)B * t.nI);
+    double *a_xG = PyArray_DATA(a_xG_obj);
+    double *b_xI = PyArray_DATA(b_xI_obj);
+    int nI = t.nI;
+
+    for (int G1 = 0; G1 < t.nG; G1 += B) {
+        int G2 = G1 + B < t.nG ? G1 + B : t.nG;
+        int nb = G2 - G1;
+        _pwlfc_expand(&t, G1, G2, !real, real, f_GI);
+        if (g0 && real && G1 == 0)
+            for (int i = 0; i < nI; i++)
+                f_GI[i] *= 0.5;
+        // Column-major: b(I, x) += f(I, G) a(G, x):
+        if (real) {
+            int k = 2 * nb;
+            double one = 1.0;
+            dgemm_("N", "N", &nI, &nx, &k, &alpha, f_GI, &nI,
+                   a_xG + 2 * (size_t)G1, &ld, &one, b_xI, &nI);
         }
-    else {
-        int nI = PyArray_DIM(f_GI_obj, 1);
-        for(int G = 0; G < nG; G++) {
-            for (int J = 0; J < nJ; J++) {
-                int s = s_J[J];
-                int l = l_s[s];
-                double complex f1 = (emiGR_Ga[a_J[J]] *
-                                     f_Gs[s] *
-                                     imag_powers[l % 4]);
-                for (int m = 0; m < 2 * l + 1; m++) {
-                    double complex f = f1 * Y_GL[l * l + m];
-                    f_GI[0] = creal(f);
-                    f_GI[nI] = cc ? -cimag(f) : cimag(f);
-                    f_GI++;
-                }
-            }
-            f_Gs += nsplines;
-            emiGR_Ga += natoms;
-            Y_GL += nL;
-            f_GI += nI;
+        else {
+            double complex z = alpha;
+            double complex one = 1.0;
+            zgemm_("N", "N", &nI, &nx, &nb, &z, f_GI, &nI,
+                   a_xG + 2 * (size_t)G1, &ld, &one, b_xI, &nI);
         }
     }
+    free(f_GI);
+    Py_RETURN_NONE;
+}
+
+
+PyObject *pwlfc_add(PyObject *self, PyObject *args)
+// Calculate a_xG += alpha * sum_I c_xI * f_GI without storing f_GI
+// for more than one block of G-vectors at a time.  Same layouts as
+// for pwlfc_integrate(), but f_GI is not complex conjugated.
+{
+    PyArrayObject *f_Gs_obj;
+    PyArrayObject *emiGR_Ga_obj;
+    PyArrayObject *Y_GL_obj;
+    PyArrayObject *l_s_obj;
+    PyArrayObject *a_J_obj;
+    PyArrayObject *s_J_obj;
+    PyArrayObject *c_xI_obj;
+    double alpha;
+    PyArrayObject *a_xG_obj;
+
+    if (!PyArg_ParseTuple(args, "OOOOOOOdO",
+                          &f_Gs_obj, &emiGR_Ga_obj, &Y_GL_obj,
+                          &l_s_obj, &a_J_obj, &s_J_obj,
+                          &c_xI_obj, &alpha, &a_xG_obj))
+        return NULL;
+
+    pwlfc_tables t;
+    pwlfc_init_tables(&t, f_Gs_obj, emiGR_Ga_obj, Y_GL_obj,
+                      l_s_obj, a_J_obj, s_J_obj);
+
+    int real = PyArray_ITEMSIZE(a_xG_obj) == 8;
+    int nx;
+    int ld;
+    if (!pwlfc_check_xG(a_xG_obj, real ? 2 * t.nG : t.nG, &nx, &ld))
+        return NULL;
+    if (!PyArray_IS_C_CONTIGUOUS(c_xI_obj) ||
+        PyArray_ITEMSIZE(c_xI_obj) != PyArray_ITEMSIZE(a_xG_obj) ||
+        PyArray_SIZE(c_xI_obj) != (npy_intp)nx * t.nI) {
+        PyErr_SetString(PyExc_ValueError, "Bad c_xI array");
+        return NULL;
+    }
+    if (nx == 0 || t.nI == 0)
+        Py_RETURN_NONE;
+
+    int B = pwlfc_block_size(&t);
+    double *f_GI = GPAW_MALLOC(double, 2 * (size_t)B * t.nI);
+    double *a_xG = PyArray_DATA(a_xG_obj);
+    double *c_xI = PyArray_DATA(c_xI_obj);
+    int nI = t.nI;
 
+    for (int G1 = 0; G1 < t.nG; G1 += B) {
+        int G2 = G1 + B < t.nG ? G1 + B : t.nG;
+        int nb = G2 - G1;
+        _pwlfc_expand(&t, G1, G2, 0, real, f_GI);
+        // Column-major: a(G, x) += f(I, G)^T c(I, x):
+        if (real) {
+            int m = 2 * nb;
+            double one = 1.0;
+            dgemm_("T", "N", &m, &nx, &nI, &alpha, f_GI, &nI,
+                   c_xI, &nI, &one, a_xG + 2 * (size_t)G1, &ld);
+        }
+        else {
+            double complex z = alpha;
+            double complex one = 1.0;
+            zgemm_("T", "N", &nb, &nx, &nI, &z, f_GI, &nI,
+                   c_xI, &nI, &one, a_xG + 2 * (size_t)G1, &ld);
+        }
+    }
+    free(f_GI);
     Py_RETURN_NONE;
 }
+#endif
 
 
 PyObject *plane_wave_grid(PyObject *self, PyObject *args)
@@ -1,6 +1,117 @@
 #include "extensions.h"
-//#include <stdlib.h>
+#include <stdlib.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
+
+// Potential from a point charge q at distance d.  dc is the distance
+// used for the cutoff (d, or the distance from the center of mass of
+// the molecule of the charge).
+static inline double pc_v(double q, double d, double dc,
+                          double rc, double rc2, double rc12, double width)
+{
+    if (rc < 0.0)
+        return (q * (d * d * d * d - rc * rc * rc * rc) /
+                (d * d * d * d * d + rc * rc * rc * rc * rc));
+    if (dc > rc2)
+        return 0.0;
+    if (dc > rc12) {
+        double x = (dc - rc12) / width;
+        return q * (1 - x * x * (3 - 2 * x)) / d;
+    }
+    if (d > rc)
+        return q / d;
+    double s = d / rc;
+    double s2 = s * s;
+    return q * (3.28125 +
+                s2 * (-5.46875 +
+                      s2 * (4.59375 +
+                            s2 * -1.40625))) / rc;
+}
+
+
+// Force factors for the same potential: w = -(dv/dr)/r / q and o for
+// the derivative of the smooth cutoff with respect to dc.
+static inline void pc_w(double d, double dc,
+                        double rc, double rc2, double rc12, double width,
+                        double* w_out, double* o_out)
+{
+    double w;
+    double o = 0.0;
+    if (rc < 0.0) {
+        double x = (d * d * d * d * d +
+                    rc * rc * rc * rc * rc);
+        w = ((d * d * d * d - rc * rc * rc * rc) /
+             (x * x) * 5 * d * d * d -
+             4 * d * d / x);
+    }
+    else
+        if (dc > rc2)
+            w = 0.0;
+        else if (dc > rc12) {
+            double x = (dc - rc12) / width;
+            w = (1 - x * x * (3 - 2 * x)) / (d * d * d);
+            o = 6 * x * (1 - x) / (width * dc * d);
+        }
+        else if (d > rc)
+            w = 1 / (d * d * d);
+        else {
+            double s = d / rc;
+            double s2 = s * s;
+            w = (-2 * (-5.46875 +
+                       s2 * (2 * 4.59375 +
+                             s2 * 3 * -1.40625)) /
+                 (rc * rc * rc));
+        }
+    *w_out = w;
+    *o_out = o;
+}
+
+
+typedef struct
+{
+    double x;
+    int p;
+} pc_key;
+
+
+static int compare_x(const void* a, const void* b)
+{
+    double xa = ((const pc_key*)a)->x;
+    double xb = ((const pc_key*)b)->x;
+    return (xa > xb) - (xa < xb);
+}
+
+
+// First index in [p1, p2) with x_p[p] >= x:
+static int pc_lower_bound(const double* x_p, int p1, int p2, double x)
+{
+    while (p1 < p2) {
+        int p = (p1 + p2) / 2;
+        if (x_p[p] < x)
+            p1 = p + 1;
+        else
+            p2 = p;
+    }
+    return p1;
+}
+
+
+// Potential (vext_G -= ...) or forces (F_pv -= ...) from point charges.
+//
+// Charges that are cut off everywhere (distance of their molecule
+// larger than rc2) are dropped up front.  With a cutoff on the
+// distance to the grid point itself, the charges are sorted along x
+// and each plane of grid points only looks at the charges less than
+// rc2 away along x, further filtered along y for each line.  Planes
+// are distributed over OpenMP threads; forces are summed in
+// thread-private arrays.
+//
+// Without rc2 (the default) every charge reaches every grid point and
+// all pairs are summed exactly.  A multipole expansion for distant
+// charges would make the potential and the forces approximate, so it
+// is not done here; use rc2 to limit the cost for many charges.
 PyObject *pc_potential(PyObject *self, PyObject *args)
 {
     PyArrayObject* beg_v_obj;
@@ -43,97 +154,153 @@ PyObject *pc_potential(PyObject *self, PyObject *args)
 
     double rc12 = rc2 - width;
 
-    for (int i = 0; i < n[0]; i++) {
-        double x = (beg_v[0] + i) * h_v[0];
-        for (int j = 0; j < n[1]; j++) {
-            double y = (beg_v[1] + j) * h_v[1];
-            int ij = (i * n[1] + j) * n[2];
-            for (int k = 0; k < n[2]; k++) {
-                double z = (beg_v[2] + k) * h_v[2];
-                for (int p = 0; p < np; p++) {
-                    const double* R_v = R_pv + 3 * p;
-                    double dx = R_v[0] - x;
-                    double dy = R_v[1] - y;
-                    double dz = R_v[2] - z;
-                    double d  = sqrt(dx * dx + dy * dy + dz * dz);
-                    double dc, dxc, dyc, dzc;
-                    if (dcom_pv == 0) {
-                        dc = d;
-                        dxc = dx;
-                        dyc = dy;
-                        dzc = dz;
-                    } else {
-                        const double* dcom_v = dcom_pv + 3 * p;
-                        dxc = dcom_v[0];
-                        dyc = dcom_v[1];
-                        dzc = dcom_v[2];
-                        dc = sqrt(dxc * dxc + dyc * dyc + dzc * dzc);
-                    }
+    // Active charges, sorted along x if we can use the cutoff:
+    int* p_i = GPAW_MALLOC(int, np > 0 ? np : 1);
+    int ni = 0;
+    for (int p = 0; p < np; p++) {
+        if (dcom_pv != 0 && rc >= 0.0) {
+            const double* dcom_v = dcom_pv + 3 * p;
+            double dc = sqrt(dcom_v[0] * dcom_v[0] +
+                             dcom_v[1] * dcom_v[1] +
+                             dcom_v[2] * dcom_v[2]);
+            if (dc > rc2)
+                continue;
+        }
+        p_i[ni++] = p;
+    }
+    int cutoff = dcom_pv == 0 && rc >= 0.0 && rc2 < INFINITY;
+    if (cutoff && ni > 1) {
+        pc_key* key_i = GPAW_MALLOC(pc_key, ni);
+        for (int i = 0; i < ni; i++) {
+            key_i[i].x = R_pv[3 * p_i[i]];
+            key_i[i].p = p_i[i];
+        }
+        qsort(key_i, ni, sizeof(pc_key), compare_x);
+        for (int i = 0; i < ni; i++)
+            p_i[i] = key_i[i].p;
+        free(key_i);
+    }
+
+    // Positions and charges in the same order:
+    double* buf_i = GPAW_MALLOC(double, 4 * (size_t)(ni > 0 ? ni : 1));
+    double* x_i = buf_i;
+    double* y_i = x_i + ni;
+    double* z_i = y_i + ni;
+    double* q_i = z_i + ni;
+    for (int i = 0; i < ni; i++) {
+        const double* R_v = R_pv + 3 * p_i[i];
+        x_i[i] = R_v[0];
+        y_i[i] = R_v[1];
+        z_i[i] = R_v[2];
+        q_i[i] = q_p[p_i[i]];
+    }
+
+    // Thread-private force arrays:
+    double* F_tiv = 0;
+    if (F_pv != 0) {
+#ifdef _OPENMP
+        int nthreads = omp_get_max_threads();
+#else
+        int nthreads = 1;
+#endif
+        F_tiv = calloc(3 * (size_t)(ni > 0 ? ni : 1) * nthreads,
+                       sizeof(double));
+        if (F_tiv == NULL) {
+            free(buf_i);
+            free(p_i);
+            return PyErr_NoMemory();
+        }
+    }
+
+#pragma omp parallel
+    {
+        int* j_l = GPAW_MALLOC(int, ni > 0 ? ni : 1);
+        double* F_iv = 0;
+        if (F_pv != 0) {
+#ifdef _OPENMP
+            F_iv = F_tiv + 3 * (size_t)ni * omp_get_thread_num();
+#else
+            F_iv = F_tiv;
+#endif
+        }
+
+#pragma omp for schedule(dynamic)
+        for (int i = 0; i < n[0]; i++) {
+            double x = (beg_v[0] + i) * h_v[0];
+            int i1 = 0;
+            int i2 = ni;
+            if (cutoff) {
+                i1 = pc_lower_bound(x_i, 0, ni, x - rc2);
+                i2 = pc_lower_bound(x_i, i1, ni, nextafter(x + rc2,
+                                                           INFINITY));
+            }
+            for (int j = 0; j < n[1]; j++) {
+                double y = (beg_v[1] + j) * h_v[1];
+                // Charges within reach of this line:
+                int nl = 0;
+                for (int l = i1; l < i2; l++)
+                    if (!cutoff || fabs(y_i[l] - y) <= rc2)
+                        j_l[nl++] = l;
+                if (nl == 0)
+                    continue;
+                int ij = (i * n[1] + j) * n[2];
+                for (int k = 0; k < n[2]; k++) {
+                    double z = (beg_v[2] + k) * h_v[2];
                     int G = ij + k;
-                    if (F_pv == 0) {
-                        // Calculate potential:
-                        double v;
-                        if (rc < 0.0)
-                           v = (q_p[p] * (d * d * d * d - rc * rc * rc * rc) /
-                                (d * d * d * d * d + rc * rc * rc * rc * rc));
-                        else
-                            if (dc > rc2)
-                                v = 0.0;
-                            else if (dc > rc12) {
-                                double x = (dc - rc12) / width;
-                                v = q_p[p] * (1 - x * x * (3 - 2 * x)) / d;
-                            }
-                            else if (d > rc)
-                                v = q_p[p] / d;
-                            else {
-                                double s = d / rc;
-                                double s2 = s * s;
-                                v = q_p[p] * (3.28125 +
-                                              s2 * (-5.46875 +
-                                                    s2 * (4.59375 +
-                                                          s2 * -1.40625))) / rc;
-                            }
-                        vext_G[G] -= v;
-                    }
-                    else {
-                        // Calculate forces:
-                        double w;  // -(dv/dr)/r
-                        double o = 0.0;
-                        if (rc < 0.0) {
-                            double x = (d * d * d * d * d +
-                                        rc * rc * rc * rc * rc);
-                            w = ((d * d * d * d - rc * rc * rc * rc) /
-                                 (x * x) * 5 * d * d * d -
-                                 4 * d * d / x);
+                    double vsum = 0.0;
+                    double r = F_pv != 0 ? rhot_G[G] * dV : 0.0;
+                    for (int m = 0; m < nl; m++) {
+                        int l = j_l[m];
+                        double dx = x_i[l] - x;
+                        double dy = y_i[l] - y;
+                        double dz = z_i[l] - z;
+                        double d  = sqrt(dx * dx + dy * dy + dz * dz);
+                        double dc, dxc, dyc, dzc;
+                        if (dcom_pv == 0) {
+                            dc = d;
+                            dxc = dx;
+                            dyc = dy;
+                            dzc = dz;
+                        } else {
+                            const double* dcom_v = dcom_pv + 3 * p_i[l];
+                            dxc = dcom_v[0];
+                            dyc = dcom_v[1];
+                            dzc = dcom_v[2];
+                            dc = sqrt(dxc * dxc + dyc * dyc + dzc * dzc);
+                        }
+                        if (F_pv == 0) {
+                            // Calculate potential:
+                            vsum += pc_v(q_i[l], d, dc, rc, rc2, rc12, width);
+                        }
+                        else {
+                            // Calculate forces:
+                            double w;  // -(dv/dr)/r
+                            double o;
+                            pc_w(d, dc, rc, rc2, rc12, width, &w, &o);
+                            w *= q_i[l] * r;
+                            o *= q_i[l] * r;
+                            double* F_v = F_iv + 3 * l;
+                            F_v[0] -= w * dx + o * dxc;
+                            F_v[1] -= w * dy + o * dyc;
+                            F_v[2] -= w * dz + o * dzc;
                         }
-                        else
-                            if (dc > rc2)
-                                w = 0.0;
-                            else if (dc > rc12) {
-                                double x = (dc - rc12) / width;
-                                w = (1 - x * x * (3 - 2 * x)) / (d * d * d);
-                                o = 6 * x * (1 - x) / (width * dc * d);
-                            }
-                            else if (d > rc)
-                                w = 1 / (d * d * d);
-                            else {
-                                double s = d / rc;
-                                double s2 = s * s;
-                                w = (-2 * (-5.46875 +
-                                           s2 * (2 * 4.59375 +
-                                                 s2 * 3 * -1.40625)) /
-                                     (rc * rc * rc));
-                            }
-                        w *= q_p[p] * rhot_G[G] * dV;
-                        o *= q_p[p] * rhot_G[G] * dV;
-                        double* F_v = F_pv + 3 * p;
-                        F_v[0] -= w * dx + o * dxc;
-                        F_v[1] -= w * dy + o * dyc;
-                        F_v[2] -= w * dz + o * dzc;
                     }
+                    if (F_pv == 0)
+                        vext_G[G] -= vsum;
                 }
             }
         }
+
+        if (F_pv != 0) {
+#pragma omp critical
+            for (int l = 0; l < ni; l++)
+                for (int v = 0; v < 3; v++)
+                    F_pv[3 * p_i[l] + v] += F_iv[3 * l + v];
+        }
+        free(j_l);
     }
+    free(F_tiv);
+    free(buf_i);
+    free(p_i);
     Py_RETURN_NONE;
 }
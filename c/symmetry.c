@@ -4,28 +4,92 @@
 
 
 
-PyObject* GG_shuffle(PyObject *self, PyObject *args)
+// Tile size for GG_shuffle: a 64x64 tile of B_GG is 64 KiB.
+#define GG_TILE 64
+
+// Add the permuted matrices of nsym symmetry operations to B_GG, one
+// tile of B_GG at a time:
+//
+//   B_GG[G0, G1] += A_GG[G_sG[s, G0], G_sG[s, G1]]  (sign_s[s] == 1)
+//   B_GG[G0, G1] += A_GG[G_sG[s, G1], G_sG[s, G0]]  (sign_s[s] == -1)
+//
+// For the transposed case, the tile is filled column by column so
+// that the gather from A_GG still runs along rows.  Tiles are
+// distributed over OpenMP threads and each tile of B_GG stays in
+// cache while all the symmetry operations are added to it.
+static void gg_shuffle(int nG, int nsym,
+                       const npy_intp* row_sG, const npy_intp* col_sG,
+                       const int* sign_s,
+                       const char* A_GG, double complex* B_GG)
 {
-    PyArrayObject* G_G_obj;
-    int sign;
-    PyArrayObject* A_GG_obj;
-    PyArrayObject* B_GG_obj;
+    int ntiles = (nG + GG_TILE - 1) / GG_TILE;
+#pragma omp parallel for schedule(dynamic) collapse(2)
+    for (int t0 = 0; t0 < ntiles; t0++)
+        for (int t1 = 0; t1 < ntiles; t1++)
+        {
+            int G0a = t0 * GG_TILE;
+            int G0b = G0a + GG_TILE < nG ? G0a + GG_TILE : nG;
+            int G1a = t1 * GG_TILE;
+            int G1b = G1a + GG_TILE < nG ? G1a + GG_TILE : nG;
+            for (int s = 0; s < nsym; s++)
+            {
+                const npy_intp* row_G = row_sG + (size_t)s * nG;
+                const npy_intp* col_G = col_sG + (size_t)s * nG;
+                if (sign_s[s] == 1)
+                    for (int G0 = G0a; G0 < G0b; G0++)
+                    {
+                        const char* A_G = A_GG + row_G[G0];
+                        double complex* B_G = B_GG + (size_t)G0 * nG;
+                        for (int G1 = G1a; G1 < G1b; G1++)
+                            B_G[G1] += *(const double complex*)(A_G +
+                                                                col_G[G1]);
+                    }
+                else
+                    for (int G1 = G1a; G1 < G1b; G1++)
+                    {
+                        const char* A_G = A_GG + row_G[G1];
+                        double complex* B_G = B_GG + G1;
+                        for (int G0 = G0a; G0 < G0b; G0++)
+                            B_G[(size_t)G0 * nG] +=
+                                *(const double complex*)(A_G + col_G[G0]);
+                    }
+            }
+        }
+}
 
-    // def GG_shuffle(G_G:int32 array, sign:int, A_GG:complex128 array, B_GG:complex128 array)
-    if (!PyArg_ParseTuple(args, "OiOO",
-                          &G_G_obj, &sign, &A_GG_obj, &B_GG_obj))
-        return NULL;
 
+// Byte offsets into A_GG for the rows and columns of the permuted
+// matrices:
+static void gg_shuffle_offsets(int nG, int nsym,
+                               const npy_int32* G_sG,
+                               PyArrayObject* A_GG_obj,
+                               npy_intp* row_sG, npy_intp* col_sG)
+{
+    npy_intp stride0 = PyArray_STRIDES(A_GG_obj)[0];
+    npy_intp stride1 = PyArray_STRIDES(A_GG_obj)[1];
+    for (int s = 0; s < nsym; s++)
+        for (int G = 0; G < nG; G++)
+        {
+            size_t sG = (size_t)s * nG + G;
+            row_sG[sG] = G_sG[sG] * stride0;
+            col_sG[sG] = G_sG[sG] * stride1;
+        }
+}
 
-    int nG = PyArray_DIMS(G_G_obj)[0];
+
+static int gg_shuffle_check(int nG, PyArrayObject* A_GG_obj,
+                            PyArrayObject* B_GG_obj)
+{
     // Check dimensions
-    if ((nG != PyArray_DIMS(B_GG_obj)[0]) ||
+    if ((PyArray_NDIM(A_GG_obj) != 2) ||
+        (PyArray_NDIM(B_GG_obj) != 2) ||
+        (nG != PyArray_DIMS(B_GG_obj)[0]) ||
         (nG != PyArray_DIMS(B_GG_obj)[1]) ||
         (nG != PyArray_DIMS(A_GG_obj)[0]) ||
         (nG != PyArray_DIMS(A_GG_obj)[1]))
      {
          PyErr_SetString(PyExc_TypeError, "Unmatched dimensions at GG_shuffle.");
-         return NULL;
+         return 0;
      }
 
     // Check input types
@@ -33,19 +97,39 @@ PyObject* GG_shuffle(PyObject *self, PyObject *args)
         (PyArray_TYPE(A_GG_obj) != NPY_COMPLEX128))
     {
          PyErr_SetString(PyExc_TypeError, "Expected complex arrays.");
-         return NULL;
-    }
-
-    if (PyArray_TYPE(G_G_obj) != NPY_INT)
-    {
-         PyErr_SetString(PyExc_TypeError, "G_G expected to be an integer array.");
-         return NULL;
+         return 0;
     }
 
     if (!PyArray_IS_C_CONTIGUOUS(B_GG_obj))
     {
         PyErr_SetString(PyExc_TypeError, "B_GG need to be c-contiguous.");
+        return 0;
+    }
+    return 1;
+}
+
+
+PyObject* GG_shuffle(PyObject *self, PyObject *args)
+{
+    PyArrayObject* G_G_obj;
+    int sign;
+    PyArrayObject* A_GG_obj;
+    PyArrayObject* B_GG_obj;
+
+    // def GG_shuffle(G_G:int32 array, sign:int, A_GG:complex128 array, B_GG:complex128 array)
+    if (!PyArg_ParseTuple(args, "OiOO",
+                          &G_G_obj, &sign, &A_GG_obj, &B_GG_obj))
         return NULL;
+
+
+    int nG = PyArray_DIMS(G_G_obj)[0];
+    if (!gg_shuffle_check(nG, A_GG_obj, B_GG_obj))
+        return NULL;
+
+    if (PyArray_TYPE(G_G_obj) != NPY_INT || !PyArray_IS_C_CONTIGUOUS(G_G_obj))
+    {
+         PyErr_SetString(PyExc_TypeError, "G_G expected to be an integer array.");
+         return NULL;
     }
 
     if (!((sign == 1) || (sign == -1)))
@@ -54,45 +138,63 @@ PyObject* GG_shuffle(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    int* G0_G = (int*)malloc(nG * sizeof(int));
-    int* G1_G = (int*)malloc(nG * sizeof(int));
+    npy_intp* row_G = GPAW_MALLOC(npy_intp, 2 * (size_t)nG);
+    npy_intp* col_G = row_G + nG;
+    gg_shuffle_offsets(nG, 1, PyArray_DATA(G_G_obj), A_GG_obj,
+                       row_G, col_G);
+    gg_shuffle(nG, 1, row_G, col_G, &sign,
+               PyArray_DATA(A_GG_obj), PyArray_DATA(B_GG_obj));
+    free(row_G);
+    Py_RETURN_NONE;
+}
 
-    npy_int32* G_G = (npy_int32*)PyArray_DATA(G_G_obj);
 
-    int stride0 = PyArray_STRIDES(A_GG_obj)[0];
-    int stride1 = PyArray_STRIDES(A_GG_obj)[1];
-    for (int G=0; G < nG; G++)
+// Same as calling GG_shuffle(G_sG[s], sign_s[s], A_GG, B_GG) for all s,
+// but with a single pass over B_GG.
+PyObject* GG_shuffle_batch(PyObject *self, PyObject *args)
+{
+    PyArrayObject* G_sG_obj;
+    PyArrayObject* sign_s_obj;
+    PyArrayObject* A_GG_obj;
+    PyArrayObject* B_GG_obj;
+
+    if (!PyArg_ParseTuple(args, "OOOO",
+                          &G_sG_obj, &sign_s_obj, &A_GG_obj, &B_GG_obj))
+        return NULL;
+
+    if ((PyArray_NDIM(G_sG_obj) != 2) ||
+        (PyArray_TYPE(G_sG_obj) != NPY_INT) ||
+        !PyArray_IS_C_CONTIGUOUS(G_sG_obj) ||
+        (PyArray_TYPE(sign_s_obj) != NPY_INT) ||
+        !PyArray_IS_C_CONTIGUOUS(sign_s_obj) ||
+        (PyArray_SIZE(sign_s_obj) != PyArray_DIMS(G_sG_obj)[0]))
     {
-        if (sign==1)
-        {
-            G0_G[G] = G_G[G] * stride0;
-            G1_G[G] = G_G[G] * stride1;
-        }
-        else  // Transpose
-        {
-            G0_G[G] = G_G[G] * stride1;
-            G1_G[G] = G_G[G] * stride0;
-        }
+         PyErr_SetString(PyExc_TypeError,
+                         "G_sG and sign_s expected to be integer arrays "
+                         "of shape (nsym, nG) and (nsym,).");
+         return NULL;
     }
 
-    double complex* A_GG = (double complex*)PyArray_DATA(A_GG_obj);
-    double complex* B_GG = (double complex*)PyArray_DATA(B_GG_obj);
+    int nsym = PyArray_DIMS(G_sG_obj)[0];
+    int nG = PyArray_DIMS(G_sG_obj)[1];
+    if (!gg_shuffle_check(nG, A_GG_obj, B_GG_obj))
+        return NULL;
 
-    for (int G0=0; G0<nG; G0++)
-    {
-        int take0 = G0_G[G0];
-        for (int G1=0; G1<nG; G1++)
+    const int* sign_s = PyArray_DATA(sign_s_obj);
+    for (int s = 0; s < nsym; s++)
+        if (!((sign_s[s] == 1) || (sign_s[s] == -1)))
         {
-            int take1 = G1_G[G1];
-            // Instead of numpy magic, we do some C magic.
-            char* ptr = (char*)A_GG + take0 + take1;
-            double complex* value_ptr = (double_complex*) ptr;
-            *(B_GG++) += *value_ptr;
+            PyErr_SetString(PyExc_TypeError, "Sign must be 1 or -1.");
+            return NULL;
         }
-    }
 
-    free(G0_G);
-    free(G1_G);
+    npy_intp* row_sG = GPAW_MALLOC(npy_intp, 2 * (size_t)nsym * nG);
+    npy_intp* col_sG = row_sG + (size_t)nsym * nG;
+    gg_shuffle_offsets(nG, nsym, PyArray_DATA(G_sG_obj), A_GG_obj,
+                       row_sG, col_sG);
+    gg_shuffle(nG, nsym, row_sG, col_sG, sign_s,
+               PyArray_DATA(A_GG_obj), PyArray_DATA(B_GG_obj));
+    free(row_sG);
     Py_RETURN_NONE;
 }
 
@@ -190,6 +292,131 @@ PyObject* symmetrize_ft(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+//
+// Apply all symmetry operations in one pass as a gather:
+//
+//    _       ---    -1 _
+//  b(h) +=   >   a(P  (h)),
+//            ---   s
+//             s
+//
+// where the inverse operations are given as per-axis tables:
+//
+//    -1 _                                             _
+//  (P  (h))  = (T     (h ) + T     (h ) + T     (h )) mod N ,
+//     s    c     sc0   0      sc1   1      sc2   2         c
+//
+// stored as table_scx[s, c, x] with x running over h0, then h1 and
+// then h2 (see gpaw.symmetry.GridSymmetrizer).  Each output point is
+// written by one thread only.
+//
+PyObject* symmetrize_gather(PyObject *self, PyObject *args)
+{
+    PyArrayObject* a_g_obj;
+    PyArrayObject* b_g_obj;
+    PyArrayObject* table_scx_obj;
+    PyArrayObject* offset_c_obj;
+
+    if (!PyArg_ParseTuple(args, "OOOO",
+                          &a_g_obj, &b_g_obj, &table_scx_obj, &offset_c_obj))
+        return NULL;
+
+    const int* table_scx = (const int*)PyArray_DATA(table_scx_obj);
+    const long* o_c = (const long*)PyArray_DATA(offset_c_obj);
+    int nsym = PyArray_DIMS(table_scx_obj)[0];
+    int nx = PyArray_DIMS(table_scx_obj)[2];
+    int ng0 = PyArray_DIMS(a_g_obj)[0];
+    int ng1 = PyArray_DIMS(a_g_obj)[1];
+    int ng2 = PyArray_DIMS(a_g_obj)[2];
+    int Ng0 = ng0 + o_c[0];
+    int Ng1 = ng1 + o_c[1];
+    int Ng2 = ng2 + o_c[2];
+    assert(nx == Ng0 + Ng1 + Ng2);
+
+    const double* a_g = (const double*)PyArray_DATA(a_g_obj);
+    double* b_g = (double*)PyArray_DATA(b_g_obj);
+
+    #pragma omp parallel for schedule(static)
+    for (int h0 = o_c[0]; h0 < Ng0; h0++)
+        for (int h1 = o_c[1]; h1 < Ng1; h1++) {
+            double* b_h = b_g + ((h0 - o_c[0]) * ng1 +
+                                 (h1 - o_c[1])) * ng2 - o_c[2];
+            for (int s = 0; s < nsym; s++) {
+                const int* T0 = table_scx + 3 * s * nx;
+                const int* T1 = T0 + nx;
+                const int* T2 = T1 + nx;
+                int q0 = T0[h0] + T0[Ng0 + h1];
+                int q1 = T1[h0] + T1[Ng0 + h1];
+                int q2 = T2[h0] + T2[Ng0 + h1];
+                if (q0 >= Ng0) q0 -= Ng0;
+                if (q1 >= Ng1) q1 -= Ng1;
+                if (q2 >= Ng2) q2 -= Ng2;
+                T0 += Ng0 + Ng1;
+                T1 += Ng0 + Ng1;
+                T2 += Ng0 + Ng1;
+                for (int h2 = o_c[2]; h2 < Ng2; h2++) {
+                    int p0 = q0 + T0[h2];
+                    int p1 = q1 + T1[h2];
+                    int p2 = q2 + T2[h2];
+                    if (p0 >= Ng0) p0 -= Ng0;
+                    if (p1 >= Ng1) p1 -= Ng1;
+                    if (p2 >= Ng2) p2 -= Ng2;
+                    b_h[h2] += a_g[((p0 - o_c[0]) * ng1 +
+                                    (p1 - o_c[1])) * ng2 +
+                                   p2 - o_c[2]];
+                }
+            }
+        }
+
+    Py_RETURN_NONE;
+}
+
+//
+// Tables for the point group operation C acting on the grid:
+//
+//   p  = (C[c] g  + C[3 + c] g  + C[6 + c] g ) mod N
+//    c          0             1             2       c
+//
+// is calculated as P_cx[c, g0] + P_cx[c, N0 + g1] + P_cx[c, N0 + N1 + g2]
+// followed by conditional subtractions of N_c, and the Bloch phase
+//
+//   exp(2 pi i (k1 . p / N - k0 . g / N))
+//
+// is a product of the per-axis factors e1_x[p] and e0_x[g].
+//
+static void wavefunction_symmetry_tables(const long* C,
+                                         const double* kpt0,
+                                         const double* kpt1,
+                                         const int* N_c,
+                                         int* P_cx,
+                                         double complex* e0_x,
+                                         double complex* e1_x)
+{
+    int nx = N_c[0] + N_c[1] + N_c[2];
+    int x = 0;
+    for (int d = 0; d < 3; d++) {
+        int N = N_c[d];
+        for (int g = 0; g < N; g++, x++) {
+            for (int c = 0; c < 3; c++)
+                P_cx[c * nx + x] = ((C[3 * d + c] * g) % N_c[c] +
+                                    N_c[c]) % N_c[c];
+            e0_x[x] = cexp(-I * 2. * M_PI * kpt0[d] / N * g);
+            e1_x[x] = cexp(I * 2. * M_PI * kpt1[d] / N * g);
+        }
+    }
+}
+
+//
+// Rotate Bloch functions from kpt0 to kpt1:
+//
+//   b (p(g)) += a (g) exp(2 pi i (k1 . p / N - k0 . g / N))
+//    x           x
+//
+// for all leading indices x (bands) of a_xg and b_xg.  The loop over x
+// is innermost so that the index and phase of a grid point are
+// calculated only once.  The map g -> p is one-to-one, so the g0
+// planes can be done in parallel.
+//
 PyObject* symmetrize_wavefunction(PyObject *self, PyObject *args)
 {
     PyArrayObject* a_g_obj;
@@ -204,31 +431,54 @@ PyObject* symmetrize_wavefunction(PyObject *self, PyObject *args)
     const long* C = (const long*)PyArray_DATA(op_cc_obj);
     const double* kpt0 = (const double*) PyArray_DATA(kpt0_obj);
     const double* kpt1 = (const double*) PyArray_DATA(kpt1_obj);
-    int ng0 = PyArray_DIMS(a_g_obj)[0];
-    int ng1 = PyArray_DIMS(a_g_obj)[1];
-    int ng2 = PyArray_DIMS(a_g_obj)[2];
-
-    const double complex* a_g = (const double complex*)PyArray_DATA(a_g_obj);
-    double complex* b_g = (double complex*)PyArray_DATA(b_g_obj);
-
+    int nd = PyArray_NDIM(a_g_obj);
+    int ng0 = PyArray_DIMS(a_g_obj)[nd - 3];
+    int ng1 = PyArray_DIMS(a_g_obj)[nd - 2];
+    int ng2 = PyArray_DIMS(a_g_obj)[nd - 1];
+    long ng = (long)ng0 * ng1 * ng2;
+    int nx = PyArray_SIZE(a_g_obj) / ng;
+
+    const double complex* a_xg = (const double complex*)PyArray_DATA(a_g_obj);
+    double complex* b_xg = (double complex*)PyArray_DATA(b_g_obj);
+
+    int N_c[3] = {ng0, ng1, ng2};
+    int nt = ng0 + ng1 + ng2;
+    int* P_cx = GPAW_MALLOC(int, 3 * nt);
+    double complex* e0_x = GPAW_MALLOC(double complex, nt);
+    double complex* e1_x = GPAW_MALLOC(double complex, nt);
+    wavefunction_symmetry_tables(C, kpt0, kpt1, N_c, P_cx, e0_x, e1_x);
+
+    #pragma omp parallel for schedule(static)
     for (int g0 = 0; g0 < ng0; g0++)
-        for (int g1 = 0; g1 < ng1; g1++)
-            for (int g2 = 0; g2 < ng2; g2++) {
-              int p0 = ((C[0] * g0 + C[3] * g1 + C[6] * g2) % ng0 + ng0) % ng0;
-              int p1 = ((C[1] * g0 + C[4] * g1 + C[7] * g2) % ng1 + ng1) % ng1;
-              int p2 = ((C[2] * g0 + C[5] * g1 + C[8] * g2) % ng2 + ng2) % ng2;
-
-              double complex phase = cexp(I * 2. * M_PI *
-                                          (kpt1[0]/ng0*p0 +
-                                           kpt1[1]/ng1*p1 +
-                                           kpt1[2]/ng2*p2 -
-                                           kpt0[0]/ng0*g0 -
-                                           kpt0[1]/ng1*g1 -
-                                           kpt0[2]/ng2*g2));
-              b_g[(p0 * ng1 + p1) * ng2 + p2] += (*a_g * phase);
-              a_g++;
+        for (int g1 = 0; g1 < ng1; g1++) {
+            int q_c[3];
+            for (int c = 0; c < 3; c++) {
+                q_c[c] = P_cx[c * nt + g0] + P_cx[c * nt + ng0 + g1];
+                if (q_c[c] >= N_c[c])
+                    q_c[c] -= N_c[c];
+            }
+            double complex phase01 = e0_x[g0] * e0_x[ng0 + g1];
+            long g = (g0 * (long)ng1 + g1) * ng2;
+            for (int g2 = 0; g2 < ng2; g2++, g++) {
+                int x = ng0 + ng1 + g2;
+                int p0 = q_c[0] + P_cx[x];
+                int p1 = q_c[1] + P_cx[nt + x];
+                int p2 = q_c[2] + P_cx[2 * nt + x];
+                if (p0 >= ng0) p0 -= ng0;
+                if (p1 >= ng1) p1 -= ng1;
+                if (p2 >= ng2) p2 -= ng2;
+                double complex phase = (phase01 * e0_x[x] *
+                                        e1_x[p0] * e1_x[ng0 + p1] *
+                                        e1_x[ng0 + ng1 + p2]);
+                long p = (p0 * (long)ng1 + p1) * ng2 + p2;
+                for (int n = 0; n < nx; n++)
+                    b_xg[n * ng + p] += a_xg[n * ng + g] * phase;
             }
+        }
 
+    free(P_cx);
+    free(e0_x);
+    free(e1_x);
     Py_RETURN_NONE;
 }
 
@@ -254,24 +504,41 @@ PyObject* symmetrize_return_index(PyObject *self, PyObject *args)
     unsigned long* a_g = (unsigned long*)PyArray_DATA(a_g_obj);
     double complex* b_g = (double complex*)PyArray_DATA(b_g_obj);
 
+    int N_c[3] = {ng0, ng1, ng2};
+    int nt = ng0 + ng1 + ng2;
+    int* P_cx = GPAW_MALLOC(int, 3 * nt);
+    double complex* e0_x = GPAW_MALLOC(double complex, nt);
+    double complex* e1_x = GPAW_MALLOC(double complex, nt);
+    wavefunction_symmetry_tables(C, kpt0, kpt1, N_c, P_cx, e0_x, e1_x);
+
+    #pragma omp parallel for schedule(static)
     for (int g0 = 0; g0 < ng0; g0++)
-        for (int g1 = 0; g1 < ng1; g1++)
-            for (int g2 = 0; g2 < ng2; g2++) {
-              int p0 = ((C[0] * g0 + C[3] * g1 + C[6] * g2) % ng0 + ng0) % ng0;
-              int p1 = ((C[1] * g0 + C[4] * g1 + C[7] * g2) % ng1 + ng1) % ng1;
-              int p2 = ((C[2] * g0 + C[5] * g1 + C[8] * g2) % ng2 + ng2) % ng2;
-
-              double complex phase = cexp(I * 2. * M_PI *
-                                          (kpt1[0]/ng0*p0 +
-                                           kpt1[1]/ng1*p1 +
-                                           kpt1[2]/ng2*p2 -
-                                           kpt0[0]/ng0*g0 -
-                                           kpt0[1]/ng1*g1 -
-                                           kpt0[2]/ng2*g2));
-              *a_g++ = (p0 * ng1 + p1) * ng2 + p2;
-              *b_g++ = phase;
+        for (int g1 = 0; g1 < ng1; g1++) {
+            int q_c[3];
+            for (int c = 0; c < 3; c++) {
+                q_c[c] = P_cx[c * nt + g0] + P_cx[c * nt + ng0 + g1];
+                if (q_c[c] >= N_c[c])
+                    q_c[c] -= N_c[c];
             }
+            double complex phase01 = e0_x[g0] * e0_x[ng0 + g1];
+            long g = (g0 * (long)ng1 + g1) * ng2;
+            for (int g2 = 0; g2 < ng2; g2++, g++) {
+                int x = ng0 + ng1 + g2;
+                int p0 = q_c[0] + P_cx[x];
+                int p1 = q_c[1] + P_cx[nt + x];
+                int p2 = q_c[2] + P_cx[2 * nt + x];
+                if (p0 >= ng0) p0 -= ng0;
+                if (p1 >= ng1) p1 -= ng1;
+                if (p2 >= ng2) p2 -= ng2;
+                a_g[g] = (p0 * ng1 + p1) * ng2 + p2;
+                b_g[g] = (phase01 * e0_x[x] *
+                          e1_x[p0] * e1_x[ng0 + p1] * e1_x[ng0 + ng1 + p2]);
+            }
+        }
 
+    free(P_cx);
+    free(e0_x);
+    free(e1_x);
     Py_RETURN_NONE;
 }
 
@@ -307,6 +574,26 @@ PyObject* symmetrize_with_index(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static inline bool same_k_point(const double* q, const double* k, double tol)
+{
+    for (int c = 0; c < 3; c++) {
+        double p = q[c] - k[c];
+        if (fabs(p - round(p)) > tol)
+            return false;
+    }
+    return true;
+}
+
+//
+// For each k1 in [ka, kb) and each operation s, find the first k2 such
+// that U_s k1 = k2 (modulo reciprocal lattice vectors).
+//
+// If the optional size_c and offset_c are given, k-points sitting on
+// the lattice offset_c + n / size_c (with n integer) are put in a lookup
+// table so that the match can be found directly.  All other k-points
+// (off-lattice points and duplicates) are searched linearly.  The result
+// is the same as without the table.
+//
 PyObject* map_k_points(PyObject *self, PyObject *args)
 {
     PyArrayObject* bzk_kc_obj;
@@ -314,9 +601,12 @@ PyObject* map_k_points(PyObject *self, PyObject *args)
     double tol;
     PyArrayObject* bz2bz_ks_obj;
     int ka, kb;
+    PyObject* size_c_obj = Py_None;
+    PyObject* offset_c_obj = Py_None;
 
-    if (!PyArg_ParseTuple(args, "OOdOii", &bzk_kc_obj, &U_scc_obj,
-                           &tol, &bz2bz_ks_obj, &ka, &kb))
+    if (!PyArg_ParseTuple(args, "OOdOii|OO", &bzk_kc_obj, &U_scc_obj,
+                          &tol, &bz2bz_ks_obj, &ka, &kb,
+                          &size_c_obj, &offset_c_obj))
         return NULL;
 
     const long* U_scc = (const long*)PyArray_DATA(U_scc_obj);
@@ -326,27 +616,83 @@ PyObject* map_k_points(PyObject *self, PyObject *args)
     int nbzkpts = PyArray_DIMS(bzk_kc_obj)[0];
     int nsym = PyArray_DIMS(U_scc_obj)[0];
 
+    long N_c[3] = {1, 1, 1};
+    double o_c[3] = {0.0, 0.0, 0.0};
+    if (size_c_obj != Py_None) {
+        const long* size_c = (const long*)PyArray_DATA(
+            (PyArrayObject*)size_c_obj);
+        const double* offset_c = (const double*)PyArray_DATA(
+            (PyArrayObject*)offset_c_obj);
+        for (int c = 0; c < 3; c++) {
+            N_c[c] = size_c[c];
+            o_c[c] = offset_c[c];
+            // Matching points must land on the same lattice site:
+            if (tol * N_c[c] >= 0.25) {
+                PyErr_SetString(PyExc_ValueError,
+                                "Tolerance too large for k-point lattice.");
+                return NULL;
+            }
+        }
+    }
+
+    // Lattice site (or -1) of a point:
+    #define K_POINT_SITE(q, site) do {                        \
+        site = 0;                                             \
+        for (int c = 0; c < 3; c++) {                         \
+            double x = ((q)[c] - o_c[c]) * N_c[c];            \
+            double n = round(x);                              \
+            if (fabs(x - n) >= 0.25) {                        \
+                site = -1;                                    \
+                break;                                        \
+            }                                                 \
+            long i = ((long)n % N_c[c] + N_c[c]) % N_c[c];    \
+            site = site * N_c[c] + i;                         \
+        }                                                     \
+    } while (0)
+
+    long nsites = N_c[0] * N_c[1] * N_c[2];
+    int* k_i = GPAW_MALLOC(int, nsites);
+    int* koff_k = GPAW_MALLOC(int, nbzkpts);
+    int noff = 0;
+    for (long i = 0; i < nsites; i++)
+        k_i[i] = -1;
+    for (int k = 0; k < nbzkpts; k++) {
+        long site;
+        K_POINT_SITE(bzk_kc + 3 * k, site);
+        if (site >= 0 && k_i[site] == -1)
+            k_i[site] = k;
+        else
+            koff_k[noff++] = k;
+    }
+
+    #pragma omp parallel for schedule(static)
     for (int k1 = ka; k1 < kb; k1++) {
         const double* q = bzk_kc + k1 * 3;
-         for (int s = 0; s < nsym; s++) {
-             const long* U = U_scc + s * 9;
-             double q0 = U[0] * q[0] + U[1] * q[1] + U[2] * q[2];
-             double q1 = U[3] * q[0] + U[4] * q[1] + U[5] * q[2];
-             double q2 = U[6] * q[0] + U[7] * q[1] + U[8] * q[2];
-             for (int k2 = 0; k2 < nbzkpts; k2++) {
-                 double p0 = q0 - bzk_kc[k2 * 3];
-                 if (fabs(p0 - round(p0)) > tol)
-                     continue;
-                 double p1 = q1 - bzk_kc[k2 * 3 + 1];
-                 if (fabs(p1 - round(p1)) > tol)
-                     continue;
-                 double p2 = q2 - bzk_kc[k2 * 3 + 2];
-                 if (fabs(p2 - round(p2)) > tol)
-                     continue;
-                 bz2bz_ks[k1 * nsym + s] = k2;
-                 break;
-             }
-         }
+        for (int s = 0; s < nsym; s++) {
+            const long* U = U_scc + s * 9;
+            double Uq[3] = {U[0] * q[0] + U[1] * q[1] + U[2] * q[2],
+                            U[3] * q[0] + U[4] * q[1] + U[5] * q[2],
+                            U[6] * q[0] + U[7] * q[1] + U[8] * q[2]};
+            int k2 = nbzkpts;
+            long site;
+            K_POINT_SITE(Uq, site);
+            if (site >= 0) {
+                int k = k_i[site];
+                if (k >= 0 && same_k_point(Uq, bzk_kc + 3 * k, tol))
+                    k2 = k;
+            }
+            for (int j = 0; j < noff && koff_k[j] < k2; j++)
+                if (same_k_point(Uq, bzk_kc + 3 * koff_k[j], tol)) {
+                    k2 = koff_k[j];
+                    break;
+                }
+            if (k2 < nbzkpts)
+                bz2bz_ks[k1 * nsym + s] = k2;
+        }
     }
+    #undef K_POINT_SITE
+
+    free(k_i);
+    free(koff_k);
     Py_RETURN_NONE;
 }
@@ -2,16 +2,79 @@
 #define PY_ARRAY_UNIQUE_SYMBOL GPAW_ARRAY_API
 #define NO_IMPORT_ARRAY
 #include <numpy/arrayobject.h>
+#include <math.h>
 #include "extensions.h"
 
-int compare_doubles (const void *a, const void *b)
+
+// Compare-exchange for the sorting network below:
+#define SORT2(a, b) {double t = fmin(a, b); b = fmax(a, b); a = t;}
+
+// Sort four numbers without branches:
+static inline void sort4(double* e)
+{
+    SORT2(e[0], e[1]);
+    SORT2(e[2], e[3]);
+    SORT2(e[0], e[2]);
+    SORT2(e[1], e[3]);
+    SORT2(e[1], e[2]);
+}
+
+
+// Weight of frequency omega for one simplex with sorted energies et_k,
+// times the simplex volume vol.  relk is the number of corners below
+// the energy of the k-point in question.
+static inline double tetra_weight(double omega, const double* et_k,
+                                  int relk, double delta, double vol)
 {
-  const double *da = (const double *) a;
-  const double *db = (const double *) b;
+    double f10 = (omega - et_k[0]) / (et_k[1] - et_k[0]);
+    double f20 = (omega - et_k[0]) / (et_k[2] - et_k[0]);
+    double f21 = (omega - et_k[1]) / (et_k[2] - et_k[1]);
+    double f30 = (omega - et_k[0]) / (et_k[3] - et_k[0]);
+    double f31 = (omega - et_k[1]) / (et_k[3] - et_k[1]);
+    double f32 = (omega - et_k[2]) / (et_k[3] - et_k[2]);
 
-  return (*da > *db) - (*da < *db);
+    double f01 = 1 - f10;
+    double f02 = 1 - f20;
+    double f03 = 1 - f30;
+    double f12 = 1 - f21;
+    double f13 = 1 - f31;
+    double f23 = 1 - f32;
+
+    double gw;
+    double Iw = 0.0;
+    if (et_k[1] != et_k[0] && et_k[0] <= omega && omega <= et_k[1]) {
+        gw = 3 * f20 * f30 / (et_k[1] - et_k[0]);
+        switch (relk) {
+        case 0: Iw = (f01 + f02 + f03) / 3; break;
+        case 1: Iw = f10 / 3; break;
+        case 2: Iw = f20 / 3; break;
+        case 3: Iw = f30 / 3; break;
+        }
+    }
+    else if (et_k[1] != et_k[2] && et_k[1] < omega && omega < et_k[2]) {
+        gw = 3 / delta * (f12 * f20 + f21 * f13);
+        switch (relk) {
+        case 0: Iw = f03 / 3 + f02 * f20 * f12 / (gw * delta); break;
+        case 1: Iw = f12 / 3 + f13 * f13 * f21 / (gw * delta); break;
+        case 2: Iw = f21 / 3 + f20 * f20 * f12 / (gw * delta); break;
+        case 3: Iw = f30 / 3 + f31 * f13 * f21 / (gw * delta); break;
+        }
+    }
+    else if (et_k[2] != et_k[3] && et_k[2] <= omega && omega <= et_k[3]) {
+        gw = 3 * f03 * f13 / (et_k[3] - et_k[2]);
+        switch (relk) {
+        case 0: Iw = f03 / 3; break;
+        case 1: Iw = f13 / 3; break;
+        case 2: Iw = f23 / 3; break;
+        case 3: Iw = (f30 + f31 + f32) / 3; break;
+        }
+    }
+    else
+        return 0.0;
+    return vol * Iw * gw;
 }
 
+
 PyObject* tetrahedron_weight(PyObject *self, PyObject *args)
 {
   PyArrayObject* epsilon_k;
@@ -22,125 +85,249 @@ PyObject* tetrahedron_weight(PyObject *self, PyObject *args)
   PyArrayObject* omega_w;
   PyArrayObject* vol_s;
 
-  double f10, f20, f21, f30, f31, f32;
-  double f01, f02, f12, f03, f13, f23;
-  double omega;
-  
   if (!PyArg_ParseTuple(args, "OOiOOOO",
                         &epsilon_k, &allsimplices_sk, &K,
                         &simplices_s, &Win_w, &omega_w,
                         &vol_s))
     return NULL;
-  
+
   int nsimplex = PyArray_DIMS(simplices_s)[0];
-  int nw = PyArray_DIMS(omega_w)[0];    
+  int nw = PyArray_DIMS(omega_w)[0];
   double* e_k = (double*)PyArray_DATA(epsilon_k);
   double* o_w = (double*)PyArray_DATA(omega_w);
   double* W_w = (double*)PyArray_DATA(Win_w);
   long* s_s = (long*)PyArray_DATA(simplices_s);
   int* alls_sk = (int*)PyArray_DATA(allsimplices_sk);
   double* v_s = (double*)PyArray_DATA(vol_s);
-  
-  double* et_k = GPAW_MALLOC(double, 4);
-  
-  double gw = 0;
-  double Iw = 0;
-  double delta = 0;  
-  int relk = 0;
-  double ek = 0;
-  
+
+  double ek = e_k[K];
   for (int s = 0; s < nsimplex; s++) {
-    relk = 0;
-    for (int k = 0; k < 4; k++) { 
-      et_k[k] = e_k[alls_sk[s_s[s] * 4 + k]];
+    const int* k_k = alls_sk + s_s[s] * 4;
+    double et_k[4] = {e_k[k_k[0]], e_k[k_k[1]], e_k[k_k[2]], e_k[k_k[3]]};
+    int relk = ((et_k[0] < ek) + (et_k[1] < ek) +
+                (et_k[2] < ek) + (et_k[3] < ek));
+    sort4(et_k);
+    double delta = et_k[3] - et_k[0];
+    for (int w = 0; w < nw; w++)
+      W_w[w] += tetra_weight(o_w[w], et_k, relk, delta, v_s[s]);
+  }
+  Py_RETURN_NONE;
+}
+
+
+// First index w in [w1, w2) with o_w[w] >= x (o_w sorted):
+static int lower_bound(const double* o_w, int w1, int w2, double x)
+{
+    while (w1 < w2) {
+        int w = (w1 + w2) / 2;
+        if (o_w[w] < x)
+            w1 = w + 1;
+        else
+            w2 = w;
     }
-    ek = e_k[K];
-    for (int k = 0; k < 4; k++) {
-      if (et_k[k] < ek) {
-        relk += 1;
-      }
+    return w1;
+}
+
+
+// First index w in [w1, w2) with o_w[w] > x (o_w sorted):
+static int upper_bound(const double* o_w, int w1, int w2, double x)
+{
+    while (w1 < w2) {
+        int w = (w1 + w2) / 2;
+        if (o_w[w] <= x)
+            w1 = w + 1;
+        else
+            w2 = w;
     }
-    qsort(et_k, 4, sizeof (double), compare_doubles);
-    delta = et_k[3] - et_k[0];
-    for (int w = 0; w < nw; w++) {
-      Iw = 0;
-      gw = 0;
-      omega = o_w[w];
-      
-      f10 = (omega - et_k[0]) / (et_k[1] - et_k[0]);
-      f20 = (omega - et_k[0]) / (et_k[2] - et_k[0]);
-      f21 = (omega - et_k[1]) / (et_k[2] - et_k[1]);
-      f30 = (omega - et_k[0]) / (et_k[3] - et_k[0]);
-      f31 = (omega - et_k[1]) / (et_k[3] - et_k[1]);
-      f32 = (omega - et_k[2]) / (et_k[3] - et_k[2]);
-      
-      f01 = 1 - f10;
-      f02 = 1 - f20;
-      f03 = 1 - f30;
-      f12 = 1 - f21;
-      f13 = 1 - f31;
-      f23 = 1 - f32;
-      
-      if (et_k[1] != et_k[0] && et_k[0] <= omega && omega <= et_k[1])
-        {
-          gw = 3 * f20 * f30 / (et_k[1] - et_k[0]);
-          switch (relk) {
-          case 0:
-            Iw = (f01 + f02 + f03) / 3;
-            break;
-          case 1:
-            Iw = f10 / 3;
-            break;
-          case 2:
-            Iw = f20 / 3;
-            break;
-          case 3:
-            Iw = f30 / 3;
-            break;
-          }
+    return w1;
+}
+
+
+// Add the weights of one simplex to W_w for sorted frequencies o_w.
+// The three energy intervals of tetra_weight() are found by bisection,
+// so the frequency loops have no interval tests and use precomputed
+// inverse energy differences.
+static void tetra_add_sorted(const double* o_w, int nw, const double* e,
+                             int relk, double vol, double* W_w)
+{
+    double delta = e[3] - e[0];
+    double i10 = 1.0 / (e[1] - e[0]);
+    double i20 = 1.0 / (e[2] - e[0]);
+    double i21 = 1.0 / (e[2] - e[1]);
+    double i30 = 1.0 / (e[3] - e[0]);
+    double i31 = 1.0 / (e[3] - e[1]);
+    double i32 = 1.0 / (e[3] - e[2]);
+
+    // e0 <= omega <= e1:
+    int w1 = lower_bound(o_w, 0, nw, e[0]);
+    int w2 = w1;
+    if (e[1] != e[0]) {
+        w2 = upper_bound(o_w, w1, nw, e[1]);
+        for (int w = w1; w < w2; w++) {
+            double f10 = (o_w[w] - e[0]) * i10;
+            double f20 = (o_w[w] - e[0]) * i20;
+            double f30 = (o_w[w] - e[0]) * i30;
+            double gw = 3 * f20 * f30 * i10;
+            double Iw;
+            switch (relk) {
+            case 0: Iw = (3 - f10 - f20 - f30) / 3; break;
+            case 1: Iw = f10 / 3; break;
+            case 2: Iw = f20 / 3; break;
+            default: Iw = f30 / 3; break;
+            }
+            W_w[w] += vol * Iw * gw;
         }
-      else if (et_k[1] != et_k[2] && et_k[1] < omega && omega < et_k[2])
-        {
-          gw = 3 / delta * (f12 * f20 + f21 * f13);
-          switch (relk) {
-          case 0:
-            Iw = f03 / 3 + f02 * f20 * f12 / (gw * delta);
-            break;
-          case 1:
-            Iw = f12 / 3 + f13 * f13 * f21 / (gw * delta);
-            break;
-          case 2:
-            Iw = f21 / 3 + f20 * f20 * f12 / (gw * delta);
-            break;
-          case 3:
-            Iw = f30 / 3 + f31 * f13 * f21 / (gw * delta);
-            break;
-          }
+    }
+
+    // e1 < omega < e2:
+    if (e[1] != e[2]) {
+        int w3 = upper_bound(o_w, w2, nw, e[1]);
+        int w4 = lower_bound(o_w, w3, nw, e[2]);
+        for (int w = w3; w < w4; w++) {
+            double f20 = (o_w[w] - e[0]) * i20;
+            double f21 = (o_w[w] - e[1]) * i21;
+            double f30 = (o_w[w] - e[0]) * i30;
+            double f31 = (o_w[w] - e[1]) * i31;
+            double f02 = 1 - f20;
+            double f03 = 1 - f30;
+            double f12 = 1 - f21;
+            double f13 = 1 - f31;
+            double gw = 3 / delta * (f12 * f20 + f21 * f13);
+            double Iw;
+            switch (relk) {
+            case 0: Iw = f03 / 3 + f02 * f20 * f12 / (gw * delta); break;
+            case 1: Iw = f12 / 3 + f13 * f13 * f21 / (gw * delta); break;
+            case 2: Iw = f21 / 3 + f20 * f20 * f12 / (gw * delta); break;
+            default: Iw = f30 / 3 + f31 * f13 * f21 / (gw * delta); break;
+            }
+            W_w[w] += vol * Iw * gw;
         }
-      else if (et_k[2] != et_k[3] && et_k[2] <= omega && omega <= et_k[3])
-        {
-          gw = 3 * f03 * f13 / (et_k[3] - et_k[2]);
-          switch (relk) {
-          case 0:
-            Iw = f03 / 3;
-            break;
-          case 1:
-            Iw = f13 / 3;
-            break;
-          case 2:
-            Iw = f23 / 3;
-            break;
-          case 3:
-            Iw = (f30 + f31 + f32) / 3;
-            break;
-          }
+    }
+
+    // e2 <= omega <= e3 (omega = e1 = e2 was done above):
+    if (e[2] != e[3]) {
+        int w5 = lower_bound(o_w, w2, nw, e[2]);
+        int w6 = upper_bound(o_w, w5, nw, e[3]);
+        for (int w = w5; w < w6; w++) {
+            double f30 = (o_w[w] - e[0]) * i30;
+            double f31 = (o_w[w] - e[1]) * i31;
+            double f32 = (o_w[w] - e[2]) * i32;
+            double f03 = 1 - f30;
+            double f13 = 1 - f31;
+            double gw = 3 * f03 * f13 * i32;
+            double Iw;
+            switch (relk) {
+            case 0: Iw = f03 / 3; break;
+            case 1: Iw = f13 / 3; break;
+            case 2: Iw = (1 - f32) / 3; break;
+            default: Iw = (f30 + f31 + f32) / 3; break;
+            }
+            W_w[w] += vol * Iw * gw;
         }
+    }
+}
+
+
+// Tetrahedron weights for all bands M of k-point K in one call:
+//
+//   W_Mw[M, w - i0_M[M]] for omega_w[w], i0_M[M] <= w < i1_M[M]
+//
+// is the same as what tetrahedron_weight(deps_Mk[M], ..., W_w,
+// omega_w[i0_M[M]:i1_M[M]], ...) gives.  W_Mw must have room for
+// max(i1_M - i0_M) frequencies and is overwritten.
+//
+// The corner energies of each simplex are sorted once with a sorting
+// network.  When omega_w is sorted (the normal case), only the
+// frequencies between the lowest and highest corner energy are
+// visited.  Bands are distributed over OpenMP threads.
+PyObject* tetrahedron_weight_batch(PyObject *self, PyObject *args)
+{
+  PyArrayObject* deps_Mk_obj;
+  PyArrayObject* allsimplices_sk;
+  int K;
+  PyArrayObject* simplices_s;
+  PyArrayObject* vol_s;
+  PyArrayObject* omega_w;
+  PyArrayObject* i0_M_obj;
+  PyArrayObject* i1_M_obj;
+  PyArrayObject* W_Mw_obj;
+
+  if (!PyArg_ParseTuple(args, "OOiOOOOOO",
+                        &deps_Mk_obj, &allsimplices_sk, &K,
+                        &simplices_s, &vol_s, &omega_w,
+                        &i0_M_obj, &i1_M_obj, &W_Mw_obj))
+    return NULL;
+
+  if (PyArray_NDIM(deps_Mk_obj) != 2 || PyArray_NDIM(W_Mw_obj) != 2 ||
+      PyArray_TYPE(deps_Mk_obj) != NPY_DOUBLE ||
+      PyArray_TYPE(W_Mw_obj) != NPY_DOUBLE ||
+      PyArray_TYPE(i0_M_obj) != NPY_LONG ||
+      PyArray_TYPE(i1_M_obj) != NPY_LONG ||
+      !PyArray_IS_C_CONTIGUOUS(deps_Mk_obj) ||
+      !PyArray_IS_C_CONTIGUOUS(W_Mw_obj) ||
+      !PyArray_IS_C_CONTIGUOUS(i0_M_obj) ||
+      !PyArray_IS_C_CONTIGUOUS(i1_M_obj)) {
+    PyErr_SetString(PyExc_TypeError,
+                    "Expected contiguous float arrays deps_Mk and W_Mw "
+                    "and integer arrays i0_M and i1_M.");
+    return NULL;
+  }
+
+  int nM = PyArray_DIMS(deps_Mk_obj)[0];
+  int nk = PyArray_DIMS(deps_Mk_obj)[1];
+  int nwmax = PyArray_DIMS(W_Mw_obj)[1];
+  int nsimplex = PyArray_DIMS(simplices_s)[0];
+  int nw = PyArray_DIMS(omega_w)[0];
+  const double* o_w = (double*)PyArray_DATA(omega_w);
+  const long* s_s = (long*)PyArray_DATA(simplices_s);
+  const int* alls_sk = (int*)PyArray_DATA(allsimplices_sk);
+  const double* v_s = (double*)PyArray_DATA(vol_s);
+  const long* i0_M = (long*)PyArray_DATA(i0_M_obj);
+  const long* i1_M = (long*)PyArray_DATA(i1_M_obj);
+
+  if (PyArray_SIZE(i0_M_obj) != nM || PyArray_SIZE(i1_M_obj) != nM ||
+      PyArray_DIMS(W_Mw_obj)[0] != nM) {
+    PyErr_SetString(PyExc_TypeError, "Unmatched number of bands.");
+    return NULL;
+  }
+  for (int M = 0; M < nM; M++)
+    if (i0_M[M] < 0 || i1_M[M] > nw || i1_M[M] - i0_M[M] > nwmax) {
+      PyErr_SetString(PyExc_ValueError, "Bad frequency range.");
+      return NULL;
+    }
+
+  int sorted = 1;
+  for (int w = 1; w < nw; w++)
+    if (o_w[w] < o_w[w - 1])
+      sorted = 0;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int M = 0; M < nM; M++) {
+    const double* e_k = (double*)PyArray_DATA(deps_Mk_obj) + (size_t)M * nk;
+    double* W_w = (double*)PyArray_DATA(W_Mw_obj) + (size_t)M * nwmax;
+    int w1 = i0_M[M];
+    int w2 = i1_M[M];
+    const double* om_w = o_w + w1;
+    for (int w = 0; w < nwmax; w++)
+      W_w[w] = 0.0;
+    if (w1 >= w2)
+      continue;
+    double ek = e_k[K];
+    for (int s = 0; s < nsimplex; s++) {
+      const int* k_k = alls_sk + s_s[s] * 4;
+      double et_k[4] = {e_k[k_k[0]], e_k[k_k[1]],
+                        e_k[k_k[2]], e_k[k_k[3]]};
+      int relk = ((et_k[0] < ek) + (et_k[1] < ek) +
+                  (et_k[2] < ek) + (et_k[3] < ek));
+      sort4(et_k);
+      if (sorted)
+        tetra_add_sorted(om_w, w2 - w1, et_k, relk, v_s[s], W_w);
       else {
-        continue;
+        double delta = et_k[3] - et_k[0];
+        for (int w = 0; w < w2 - w1; w++)
+          W_w[w] += tetra_weight(om_w[w], et_k, relk, delta, v_s[s]);
       }
-      W_w[w] += v_s[s] * Iw * gw;
     }
   }
-  free(et_k);
   Py_RETURN_NONE;
 }
@@ -9,6 +9,7 @@
 #define NO_IMPORT_ARRAY
 #include <numpy/arrayobject.h>
 #include "extensions.h"
+#include "bmgs/bmgs.h"
 #include <math.h>
 #include <stdlib.h>
 #ifdef __DARWIN_UNIX03
@@ -354,6 +355,104 @@ PyObject* add_to_density(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+// Equivalent to:
+//
+//     for f, psit_R in zip(f_n, psit_nR):
+//         nt_R += f * abs(psit_R)**2
+//
+// in one pass over nt_R.  psit_nR must have four dimensions, but may be
+// a strided view (only the last axis must be contiguous).  Lines of
+// grid points are distributed over OpenMP threads and all bands are
+// accumulated into a line before moving on to the next.
+PyObject* add_to_density_batch(PyObject *self, PyObject *args)
+{
+    PyArrayObject* f_n_obj;
+    PyArrayObject* psit_nR_obj;
+    PyArrayObject* nt_R_obj;
+    if (!PyArg_ParseTuple(args, "OOO", &f_n_obj, &psit_nR_obj, &nt_R_obj))
+        return NULL;
+
+    if (!PyArray_Check(psit_nR_obj))
+    {
+        // Must be cupy
+        #ifdef GPAW_GPU
+        return add_to_density_gpu(self, args);
+        #else
+        PyErr_SetString(PyExc_RuntimeError,
+                        "Unknown array type to add_to_density_batch.");
+        return NULL;
+        #endif
+    }
+
+    if (PyArray_NDIM(psit_nR_obj) != 4 ||
+        (PyArray_TYPE(psit_nR_obj) != NPY_DOUBLE &&
+         PyArray_TYPE(psit_nR_obj) != NPY_CDOUBLE) ||
+        PyArray_STRIDE(psit_nR_obj, 3) != PyArray_ITEMSIZE(psit_nR_obj)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "psit_nR must be a 4-d float64 or complex128 array "
+                        "with a contiguous last axis");
+        return NULL;
+    }
+    if (!PyArray_Check(nt_R_obj) ||
+        PyArray_TYPE(nt_R_obj) != NPY_DOUBLE ||
+        !PyArray_IS_C_CONTIGUOUS(nt_R_obj) ||
+        PyArray_SIZE(nt_R_obj) != (PyArray_DIM(psit_nR_obj, 1) *
+                                   PyArray_DIM(psit_nR_obj, 2) *
+                                   PyArray_DIM(psit_nR_obj, 3))) {
+        PyErr_SetString(PyExc_ValueError,
+                        "nt_R must be a contiguous float64 array "
+                        "of the same grid shape as psit_nR");
+        return NULL;
+    }
+    if (!PyArray_Check(f_n_obj) ||
+        PyArray_TYPE(f_n_obj) != NPY_DOUBLE ||
+        !PyArray_IS_C_CONTIGUOUS(f_n_obj) ||
+        PyArray_SIZE(f_n_obj) < PyArray_DIM(psit_nR_obj, 0)) {
+        PyErr_SetString(PyExc_ValueError,
+                        "f_n must be a contiguous float64 array "
+                        "with a weight for each band");
+        return NULL;
+    }
+
+    const double* f_n = PyArray_DATA(f_n_obj);
+    const double* psit_nR = PyArray_DATA(psit_nR_obj);
+    double* nt_R = PyArray_DATA(nt_R_obj);
+    int nbands = PyArray_DIM(psit_nR_obj, 0);
+    int n0 = PyArray_DIM(psit_nR_obj, 1);
+    int n1 = PyArray_DIM(psit_nR_obj, 2);
+    int n2 = PyArray_DIM(psit_nR_obj, 3);
+    int is_complex = PyArray_ITEMSIZE(psit_nR_obj) == 16;
+    // Strides in units of doubles:
+    npy_intp sn = PyArray_STRIDE(psit_nR_obj, 0) / 8;
+    npy_intp s0 = PyArray_STRIDE(psit_nR_obj, 1) / 8;
+    npy_intp s1 = PyArray_STRIDE(psit_nR_obj, 2) / 8;
+
+#pragma omp parallel for schedule(static)
+    for (int l = 0; l < n0 * n1; l++) {
+        int i0 = l / n1;
+        int i1 = l % n1;
+        double* nt = nt_R + (size_t)l * n2;
+        for (int n = 0; n < nbands; n++) {
+            double f = f_n[n];
+            if (f == 0.0)
+                continue;
+            const double* a = psit_nR + n * sn + i0 * s0 + i1 * s1;
+            if (is_complex) {
+#pragma omp simd
+                for (int k = 0; k < n2; k++)
+                    nt[k] += f * (a[2 * k] * a[2 * k] +
+                                  a[2 * k + 1] * a[2 * k + 1]);
+            }
+            else {
+#pragma omp simd
+                for (int k = 0; k < n2; k++)
+                    nt[k] += f * a[k] * a[k];
+            }
+        }
+    }
+    Py_RETURN_NONE;
+}
+
 
 PyObject* utilities_gaussian_wave(PyObject *self, PyObject *args)
 {
@@ -523,6 +622,211 @@ PyObject* unpack_complex(PyObject *self, PyObject *args)
   Py_RETURN_NONE;
 }
 
+// Offsets of the atoms' blocks in a buffer of full (ni x ni) matrices
+// and in a buffer of packed (ni (ni + 1) / 2) matrices.
+static void packed_offsets(int na, const long* ni_a, long* M_a, long* P_a)
+{
+  M_a[0] = 0;
+  P_a[0] = 0;
+  for (int a = 0; a < na; a++)
+    {
+      M_a[a + 1] = M_a[a] + ni_a[a] * ni_a[a];
+      P_a[a + 1] = P_a[a] + ni_a[a] * (ni_a[a] + 1) / 2;
+    }
+}
+
+PyObject* pack_many(PyObject *self, PyObject *args)
+{
+  // Pack the matrices of all atoms: A_xM -> P_xP.  The atoms' ni x ni
+  // blocks are stored one after the other along the last axis of A_xM
+  // (like the data of an AtomArrays object).  Off-diagonal elements
+  // are a_rc + a_cr (density) or (a_rc + a_cr*) / 2 (hermitian).  If
+  // add is true, the packed matrices are added to P_xP.
+  PyArrayObject* A_obj;
+  PyArrayObject* ni_obj;
+  PyArrayObject* P_obj;
+  int density;
+  int add;
+  if (!PyArg_ParseTuple(args, "OOOii", &A_obj, &ni_obj, &P_obj,
+                        &density, &add))
+    return NULL;
+  int na = PyArray_DIM(ni_obj, 0);
+  const long* ni_a = LONGP(ni_obj);
+  long nM = PyArray_DIM(A_obj, PyArray_NDIM(A_obj) - 1);
+  long nP = PyArray_DIM(P_obj, PyArray_NDIM(P_obj) - 1);
+  int nx = PyArray_SIZE(A_obj) / MAX(nM, 1);
+  int cplx = PyArray_TYPE(A_obj) == NPY_COMPLEX128;
+  long* M_a = GPAW_MALLOC(long, 2 * (na + 1));
+  long* P_a = M_a + na + 1;
+  packed_offsets(na, ni_a, M_a, P_a);
+  double f = density ? 1.0 : 0.5;
+
+#pragma omp parallel for schedule(dynamic) collapse(2)
+  for (int a = 0; a < na; a++)
+    for (int x = 0; x < nx; x++)
+      {
+        int n = ni_a[a];
+        if (cplx)
+          {
+            const double_complex* A = COMPLEXP(A_obj) + x * nM + M_a[a];
+            double_complex* P = COMPLEXP(P_obj) + x * nP + P_a[a];
+            for (int r = 0; r < n; r++)
+              {
+                *P = A[r * n + r] + (add ? *P : 0.0);
+                P++;
+                for (int c = r + 1; c < n; c++)
+                  {
+                    double_complex ac = A[c * n + r];
+                    *P = (f * (A[r * n + c] + (density ? ac : conj(ac))) +
+                          (add ? *P : 0.0));
+                    P++;
+                  }
+              }
+          }
+        else
+          {
+            const double* A = DOUBLEP(A_obj) + x * nM + M_a[a];
+            double* P = DOUBLEP(P_obj) + x * nP + P_a[a];
+            for (int r = 0; r < n; r++)
+              {
+                *P = A[r * n + r] + (add ? *P : 0.0);
+                P++;
+                for (int c = r + 1; c < n; c++)
+                  {
+                    *P = f * (A[r * n + c] + A[c * n + r]) + (add ? *P : 0.0);
+                    P++;
+                  }
+              }
+          }
+      }
+  free(M_a);
+  Py_RETURN_NONE;
+}
+
+PyObject* unpack_many(PyObject *self, PyObject *args)
+{
+  // Inverse of pack_many(): P_xP -> A_xM.  The lower triangles are
+  // complex conjugated and for density-packed matrices the
+  // off-diagonal elements are halved.
+  PyArrayObject* P_obj;
+  PyArrayObject* ni_obj;
+  PyArrayObject* A_obj;
+  int density;
+  if (!PyArg_ParseTuple(args, "OOOi", &P_obj, &ni_obj, &A_obj, &density))
+    return NULL;
+  int na = PyArray_DIM(ni_obj, 0);
+  const long* ni_a = LONGP(ni_obj);
+  long nM = PyArray_DIM(A_obj, PyArray_NDIM(A_obj) - 1);
+  long nP = PyArray_DIM(P_obj, PyArray_NDIM(P_obj) - 1);
+  int nx = PyArray_SIZE(A_obj) / MAX(nM, 1);
+  int cplx = PyArray_TYPE(A_obj) == NPY_COMPLEX128;
+  long* M_a = GPAW_MALLOC(long, 2 * (na + 1));
+  long* P_a = M_a + na + 1;
+  packed_offsets(na, ni_a, M_a, P_a);
+  double f = density ? 0.5 : 1.0;
+
+#pragma omp parallel for schedule(dynamic) collapse(2)
+  for (int a = 0; a < na; a++)
+    for (int x = 0; x < nx; x++)
+      {
+        int n = ni_a[a];
+        if (cplx)
+          {
+            const double_complex* P = COMPLEXP(P_obj) + x * nP + P_a[a];
+            double_complex* A = COMPLEXP(A_obj) + x * nM + M_a[a];
+            for (int r = 0; r < n; r++)
+              {
+                A[r * n + r] = *P++;
+                for (int c = r + 1; c < n; c++)
+                  {
+                    double_complex p = f * *P++;
+                    A[r * n + c] = p;
+                    A[c * n + r] = conj(p);
+                  }
+              }
+          }
+        else
+          {
+            const double* P = DOUBLEP(P_obj) + x * nP + P_a[a];
+            double* A = DOUBLEP(A_obj) + x * nM + M_a[a];
+            for (int r = 0; r < n; r++)
+              {
+                A[r * n + r] = *P++;
+                for (int c = r + 1; c < n; c++)
+                  {
+                    double p = f * *P++;
+                    A[r * n + c] = p;
+                    A[c * n + r] = p;
+                  }
+              }
+          }
+      }
+  free(M_a);
+  Py_RETURN_NONE;
+}
+
+PyObject* packed_dot(PyObject *self, PyObject *args)
+{
+  // Calculate sum_x sum_ij A_xij B_xij (real part) for each atom
+  // directly from the packed forms.  B_xP must be packed as hermitian
+  // and A_xP as hermitian (density=0) or, for real matrices, as
+  // density (density=1).
+  PyArrayObject* A_obj;
+  PyArrayObject* B_obj;
+  PyArrayObject* ni_obj;
+  PyArrayObject* out_obj;
+  int density;
+  if (!PyArg_ParseTuple(args, "OOOOi", &A_obj, &B_obj, &ni_obj, &out_obj,
+                        &density))
+    return NULL;
+  int na = PyArray_DIM(ni_obj, 0);
+  const long* ni_a = LONGP(ni_obj);
+  long nP = PyArray_DIM(A_obj, PyArray_NDIM(A_obj) - 1);
+  int nx = PyArray_SIZE(A_obj) / MAX(nP, 1);
+  int cplx = PyArray_TYPE(A_obj) == NPY_COMPLEX128;
+  double* out_a = DOUBLEP(out_obj);
+  long* M_a = GPAW_MALLOC(long, 2 * (na + 1));
+  long* P_a = M_a + na + 1;
+  packed_offsets(na, ni_a, M_a, P_a);
+  double f = density ? 1.0 : 2.0;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int a = 0; a < na; a++)
+    {
+      int n = ni_a[a];
+      double diag = 0.0;
+      double offdiag = 0.0;
+      for (int x = 0; x < nx; x++)
+        {
+          long p = x * nP + P_a[a];
+          for (int r = 0; r < n; r++)
+            {
+              if (cplx)
+                {
+                  const double_complex* A = COMPLEXP(A_obj) + p;
+                  const double_complex* B = COMPLEXP(B_obj) + p;
+                  diag += creal(A[0] * B[0]);
+                  for (int c = 1; c < n - r; c++)
+                    offdiag += creal(A[c] * B[c]);
+                }
+              else
+                {
+                  const double* A = DOUBLEP(A_obj) + p;
+                  const double* B = DOUBLEP(B_obj) + p;
+                  diag += A[0] * B[0];
+#pragma omp simd reduction(+:offdiag)
+                  for (int c = 1; c < n - r; c++)
+                    offdiag += A[c] * B[c];
+                }
+              p += n - r;
+            }
+        }
+      out_a[a] = diag + f * offdiag;
+    }
+  free(M_a);
+  Py_RETURN_NONE;
+}
+
 PyObject* hartree(PyObject *self, PyObject *args)
 {
     int l;
@@ -637,6 +941,151 @@ PyObject* localize(PyObject *self, PyObject *args)
 }
 
 
+// Same as localize(), but the sweep over all pairs (a, b) is done in
+// round-robin order: n - 1 (or n) rounds of disjoint pairs, so that all
+// rotations of a round can be applied at the same time.  Z_nnc must be
+// symmetric; only its upper triangle is read (like in localize()) and
+// the full matrix is updated.  In each round, a thread owns the rows a
+// and b of its pairs and applies the rotations from both sides to the
+// 2x2 blocks of those rows in a single pass over contiguous memory.
+PyObject* localize_parallel(PyObject *self, PyObject *args)
+{
+  PyArrayObject* Z_nnc;
+  PyArrayObject* U_nn;
+  if (!PyArg_ParseTuple(args, "OO", &Z_nnc, &U_nn))
+    return NULL;
+
+  int n = PyArray_DIMS(U_nn)[0];
+  double complex* Z = COMPLEXP(Z_nnc);
+  double* U = DOUBLEP(U_nn);
+  long nrow = 3 * (long)n;
+
+  // Copy upper triangle to lower triangle:
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < i; j++)
+      for (int c = 0; c < 3; c++)
+        Z[i * nrow + 3 * j + c] = Z[j * nrow + 3 * i + c];
+
+  int m = n + n % 2;  // add a dummy if n is odd
+  int* a_p = GPAW_MALLOC(int, m);
+  int* b_p = a_p + m / 2;
+  double* C_p = GPAW_MALLOC(double, m);
+  double* S_p = C_p + m / 2;
+  for (int r = 0; r < m - 1; r++)
+    {
+      // Circle method: 0 is fixed and the others rotate
+      int np = 0;
+      int idle = -1;  // index without partner (n odd)
+      for (int k = 0; k < m / 2; k++)
+        {
+          int a = k == 0 ? 0 : 1 + (k - 1 + r) % (m - 1);
+          int b = 1 + (m - 2 - k + r) % (m - 1);
+          if (a >= n || b >= n)
+            {
+              idle = a < b ? a : b;
+              continue;
+            }
+          a_p[np] = a < b ? a : b;
+          b_p[np++] = a < b ? b : a;
+        }
+#pragma omp parallel
+      {
+#pragma omp for schedule(static)
+        for (int p = 0; p < np; p++)
+          {
+            const double complex* Zaa = Z + a_p[p] * nrow + 3 * a_p[p];
+            const double complex* Zab = Z + a_p[p] * nrow + 3 * b_p[p];
+            const double complex* Zbb = Z + b_p[p] * nrow + 3 * b_p[p];
+            double x = 0.0;
+            double y = 0.0;
+            for (int c = 0; c < 3; c++)
+              {
+                x += (0.25 * creal(Zbb[c] * conj(Zbb[c])) +
+                      0.25 * creal(Zaa[c] * conj(Zaa[c])) -
+                      0.5 * creal(Zaa[c] * conj(Zbb[c])) -
+                      creal(Zab[c] * conj(Zab[c])));
+                y += creal((Zaa[c] - Zbb[c]) * conj(Zab[c]));
+              }
+            double t = 0.25 * atan2(y, x);
+            C_p[p] = cos(t);
+            S_p[p] = sin(t);
+          }
+        // Z <- R^T Z R (rows of pair p, or the idle row for p == np):
+#pragma omp for schedule(static)
+        for (int p = 0; p < np + (idle >= 0); p++)
+          {
+            int a = p < np ? a_p[p] : idle;
+            double complex* Za = Z + a * nrow;
+            double complex* Zb = p < np ? Z + b_p[p] * nrow : NULL;
+            double C = p < np ? C_p[p] : 1.0;
+            double S = p < np ? S_p[p] : 0.0;
+            for (int q = 0; q < np; q++)
+              {
+                double Cq = C_p[q];
+                double Sq = S_p[q];
+                double complex* Zac = Za + 3 * a_p[q];
+                double complex* Zad = Za + 3 * b_p[q];
+                if (Zb == NULL)
+                  {
+                    for (int c = 0; c < 3; c++)
+                      {
+                        double complex zac = Zac[c];
+                        Zac[c] = Cq * zac + Sq * Zad[c];
+                        Zad[c] = Cq * Zad[c] - Sq * zac;
+                      }
+                    continue;
+                  }
+                double complex* Zbc = Zb + 3 * a_p[q];
+                double complex* Zbd = Zb + 3 * b_p[q];
+                for (int c = 0; c < 3; c++)
+                  {
+                    double complex tac = Cq * Zac[c] + Sq * Zad[c];
+                    double complex tad = Cq * Zad[c] - Sq * Zac[c];
+                    double complex tbc = Cq * Zbc[c] + Sq * Zbd[c];
+                    double complex tbd = Cq * Zbd[c] - Sq * Zbc[c];
+                    Zac[c] = C * tac + S * tbc;
+                    Zbc[c] = C * tbc - S * tac;
+                    Zad[c] = C * tad + S * tbd;
+                    Zbd[c] = C * tbd - S * tad;
+                  }
+              }
+            if (Zb != NULL && idle >= 0)
+              for (int c = 0; c < 3; c++)
+                {
+                  double complex zai = Za[3 * idle + c];
+                  Za[3 * idle + c] = C * zai + S * Zb[3 * idle + c];
+                  Zb[3 * idle + c] = C * Zb[3 * idle + c] - S * zai;
+                }
+          }
+        // U <- U R:
+#pragma omp for schedule(static)
+        for (int i = 0; i < n; i++)
+          {
+            double* Ui = U + i * (long)n;
+            for (int p = 0; p < np; p++)
+              {
+                double ua = Ui[a_p[p]];
+                Ui[a_p[p]] = C_p[p] * ua + S_p[p] * Ui[b_p[p]];
+                Ui[b_p[p]] = C_p[p] * Ui[b_p[p]] - S_p[p] * ua;
+              }
+          }
+      }
+    }
+  free(a_p);
+  free(C_p);
+
+  double value = 0.0;
+  for (int a = 0; a < n; a++)
+    for (int c = 0; c < 3; c++)
+      {
+        double complex Zaac = Z[a * nrow + 3 * a + c];
+        value += creal(Zaac * conj(Zaac));
+      }
+  return Py_BuildValue("d", value);
+}
+
+
 PyObject* spherical_harmonics(PyObject *self, PyObject *args)
 {
   int l;
@@ -744,8 +1193,10 @@ PyObject* spherical_harmonics(PyObject *self, PyObject *args)
             }
           else
             {
-              PyErr_SetString(PyExc_RuntimeError, "l>7 not implemented");
-              return NULL;
+              double* Y_L = GPAW_MALLOC(double, (l + 1) * (l + 1));
+              bmgs_solid_harmonics(l, 1, &x, &y, &z, 1, Y_L, NULL);
+              memcpy(Y_m, Y_L + l * l, (2 * l + 1) * sizeof(double));
+              free(Y_L);
             }
         }
     }
@@ -753,6 +1204,48 @@ PyObject* spherical_harmonics(PyObject *self, PyObject *args)
 }
 
 
+// Batched version of the above: all real solid harmonics r^l Y_L with
+// l <= lmax for many vectors (R_vx has shape (3, nx)).  The gradients
+// are calculated if an output array of shape (3, nL, nx) is given.
+PyObject* solid_harmonics(PyObject *self, PyObject *args)
+{
+  int lmax;
+  PyArrayObject* R_vx_obj;
+  PyArrayObject* Y_Lx_obj;
+  PyObject* dY_vLx_obj = Py_None;
+  if (!PyArg_ParseTuple(args, "iOO|O", &lmax, &R_vx_obj, &Y_Lx_obj,
+                        &dY_vLx_obj))
+    return NULL;
+
+  long nx = PyArray_DIM(R_vx_obj, 1);
+  if (lmax < 0 ||
+      PyArray_DIM(R_vx_obj, 0) != 3 ||
+      PyArray_DIM(Y_Lx_obj, 0) != (lmax + 1) * (lmax + 1) ||
+      PyArray_DIM(Y_Lx_obj, 1) != nx) {
+    PyErr_SetString(PyExc_ValueError, "Bad array shapes");
+    return NULL;
+  }
+  const double* x = DOUBLEP(R_vx_obj);
+  const double* y = x + nx;
+  const double* z = y + nx;
+  double* Y_Lx = DOUBLEP(Y_Lx_obj);
+  double* dY_vLx = NULL;
+  if (dY_vLx_obj != Py_None)
+    dY_vLx = DOUBLEP((PyArrayObject*)dY_vLx_obj);
+
+  // Blocks of vectors small enough for all L-rows to stay in cache:
+  const long nb = 128;
+#pragma omp parallel for schedule(static)
+  for (long x0 = 0; x0 < nx; x0 += nb)
+    {
+      int n = nx - x0 < nb ? nx - x0 : nb;
+      bmgs_solid_harmonics(lmax, n, x + x0, y + x0, z + x0, nx,
+                           Y_Lx + x0, dY_vLx == NULL ? NULL : dY_vLx + x0);
+    }
+  Py_RETURN_NONE;
+}
+
+
 PyObject* integrate_outwards(PyObject *self, PyObject *args)
 {
     int g0;
@@ -1,7 +1,6 @@
 #include "extensions.h"
 #include <stdlib.h>
-
-double distance(double *a, double *b);
+#include <math.h>
 
 // returns the squared distance between a 3d double vector
 // and a 3d int vector
@@ -14,52 +13,104 @@ double distance3d2_di(double *a, int *b)
     sum += diff*diff;
   }
   return sum;
-} 
+}
+
+// Range [*i0, *i1) of grid points (beg + i) * h within x +- r
+static void bounding_range(double x, double r, long beg, double h, int n,
+                           int *i0, int *i1)
+{
+  // One extra point on each side guards against rounding; the
+  // points are tested individually anyway.
+  *i0 = MAX((int)floor((x - r) / h) - beg, 0);
+  *i1 = MIN((int)ceil((x + r) / h) - beg + 1, n);
+}
 
 PyObject *exterior_electron_density_region(PyObject *self, PyObject *args)
 {
+  // Mark grid points outside all van der Waals spheres with 1 and those
+  // inside with 0 (integer output array).  For a float output array,
+  // the signed distance to the nearest sphere surface is calculated
+  // instead (negative inside), cut off at dmax.
+  //
+  // Each sphere is only rasterized into its bounding box of grid
+  // points.  The planes of the grid are distributed over threads, so
+  // no two threads write the same point.
   PyArrayObject* ai;
   PyArrayObject* aatom_c;
   PyArrayObject* beg_c;
   PyArrayObject* end_c;
   PyArrayObject* hh_c;
   PyArrayObject* vdWrad;
-  if (!PyArg_ParseTuple(args, "OOOOOO", &ai, &aatom_c, 
-			&beg_c, &end_c, &hh_c, &vdWrad))
+  double dmax = 0.0;
+  if (!PyArg_ParseTuple(args, "OOOOOO|d", &ai, &aatom_c,
+                        &beg_c, &end_c, &hh_c, &vdWrad, &dmax))
     return NULL;
 
-  long *aindex = LONGP(ai);
+  int signed_distance = PyArray_TYPE(ai) == NPY_DOUBLE;
+  long *aindex = signed_distance ? NULL : LONGP(ai);
+  double *dist = signed_distance ? DOUBLEP(ai) : NULL;
   int natoms = PyArray_DIM(aatom_c, 0);
   double *atom_c = DOUBLEP(aatom_c);
   long *beg = LONGP(beg_c);
   long *end = LONGP(end_c);
   double *h_c = DOUBLEP(hh_c);
   double *vdWradius = DOUBLEP(vdWrad);
+  if (!signed_distance)
+    dmax = 0.0;
 
-  int n[3], ij;
-  double pos[3];
+  int n[3];
   for (int c = 0; c < 3; c++) { n[c] = end[c] - beg[c]; }
-  // loop over all points
+
+  // Bounding boxes:
+  int *box_ac = GPAW_MALLOC(int, 6 * natoms);
+  for (int a = 0; a < natoms; a++)
+    for (int c = 0; c < 3; c++)
+      bounding_range(atom_c[3 * a + c], vdWradius[a] + dmax,
+                     beg[c], h_c[c], n[c],
+                     box_ac + 6 * a + 2 * c, box_ac + 6 * a + 2 * c + 1);
+
+#pragma omp parallel for schedule(dynamic)
   for (int i = 0; i < n[0]; i++) {
-    pos[0] = (beg[0] + i) * h_c[0];
-    for (int j = 0; j < n[1]; j++) {
-      pos[1] = (beg[1] + j) * h_c[1];
-      ij = (i*n[1] + j)*n[2];
-      for (int k = 0; k < n[2]; k++) {
-	pos[2] = (beg[2] + k) * h_c[2];
-	aindex[ij + k] = (long) 1; /* assume outside the structure */
-	// loop over all atoms
-	for (int a=0; a < natoms; a++) {
-	  double d = distance(atom_c + a*3, pos);
-	  if (d < vdWradius[a]) {
-	    aindex[ij + k] = (long) 0; /* this is inside */
-	    a = natoms;
-	  }
-	}
+    long *aindex_jk = signed_distance ? NULL : aindex + (long)i * n[1] * n[2];
+    double *dist_jk = signed_distance ? dist + (long)i * n[1] * n[2] : NULL;
+    // assume outside the structure
+    for (long jk = 0; jk < (long)n[1] * n[2]; jk++) {
+      if (signed_distance)
+        dist_jk[jk] = dmax;
+      else
+        aindex_jk[jk] = 1;
+    }
+    double x = (beg[0] + i) * h_c[0];
+    for (int a = 0; a < natoms; a++) {
+      const int *box_c = box_ac + 6 * a;
+      if (i < box_c[0] || i >= box_c[1])
+        continue;
+      const double *R_c = atom_c + 3 * a;
+      double r = vdWradius[a];
+      double rcut2 = (r + dmax) * (r + dmax);
+      double dx2 = (x - R_c[0]) * (x - R_c[0]);
+      for (int j = box_c[2]; j < box_c[3]; j++) {
+        double y = (beg[1] + j) * h_c[1];
+        double dxy2 = dx2 + (y - R_c[1]) * (y - R_c[1]);
+        if (dxy2 >= rcut2)
+          continue;
+        long jk0 = (long)j * n[2];
+        for (int k = box_c[4]; k < box_c[5]; k++) {
+          double z = (beg[2] + k) * h_c[2];
+          double d2 = dxy2 + (z - R_c[2]) * (z - R_c[2]);
+          if (signed_distance) {
+            if (d2 < rcut2) {
+              double d = sqrt(d2) - r;
+              if (d < dist_jk[jk0 + k])
+                dist_jk[jk0 + k] = d;
+            }
+          }
+          else if (d2 < rcut2)
+            aindex_jk[jk0 + k] = 0; /* this is inside */
+        }
       }
     }
   }
-
+  free(box_ac);
   Py_RETURN_NONE;
 }
-
@@ -4,6 +4,10 @@
 
 #include "../extensions.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 double vdwkernel(double D, double d1, double d2, int nD, int ndelta,
                  double dD, double ddelta,
                  const double (*phi)[nD])
@@ -161,6 +165,272 @@ PyObject * vdw(PyObject* self, PyObject *args)
   return PyFloat_FromDouble(energy);
 }
 
+/* Asymptotic form of the kernel for large D (d1, d2 >> 1). */
+static inline double vdwtail(double d1, double d2)
+{
+  double d12 = d1 * d1;
+  double d22 = d2 * d2;
+  const double C = -1024.0 / 243.0 * M_PI * M_PI * M_PI * M_PI;
+  return C / (d12 * d22 * (d12 + d22));
+}
+
+/* Same double sum as vdw(), but with a cell list.
+ *
+ * The points are sorted into boxes with sides of at least rcut.  For a
+ * point i1, the kernel is evaluated exactly for all partners in the 27
+ * boxes around it.  Partners in the other boxes are lumped together:
+ * the box is replaced by its total density sitting at the
+ * density-weighted center with the density-weighted q0, and the
+ * asymptotic tail of the kernel is used.
+ *
+ * All partners i2 are visited for each i1 in [iA, iB), so the work is
+ * split evenly by splitting the points.  Returns the exact (near) and
+ * the approximate (far) contributions as a tuple. */
+PyObject * vdw_cells(PyObject* self, PyObject *args)
+{
+  PyArrayObject* n_obj;
+  PyArrayObject* q0_obj;
+  PyArrayObject* R_obj;
+  PyArrayObject* cell_obj;
+  PyArrayObject* pbc_obj;
+  PyArrayObject* repeat_obj;
+  PyArrayObject* phi_obj;
+  double ddelta;
+  double dD;
+  int iA;
+  int iB;
+  PyArrayObject* rhistogram_obj;
+  double drhist;
+  PyArrayObject* Dhistogram_obj;
+  double dDhist;
+  double rcut;
+  if (!PyArg_ParseTuple(args, "OOOOOOOddiiOdOdd", &n_obj, &q0_obj, &R_obj,
+                        &cell_obj, &pbc_obj, &repeat_obj,
+                        &phi_obj, &ddelta, &dD, &iA, &iB,
+                        &rhistogram_obj, &drhist,
+                        &Dhistogram_obj, &dDhist, &rcut))
+    return NULL;
+
+  int ndelta = PyArray_DIMS(phi_obj)[0];
+  int nD = PyArray_DIMS(phi_obj)[1];
+  const double* n = (const double*)DOUBLEP(n_obj);
+  const int ni = PyArray_SIZE(n_obj);
+  const double* q0 = (const double*)DOUBLEP(q0_obj);
+  const double (*R)[3] = (const double (*)[3])DOUBLEP(R_obj);
+  const double* cell = (const double*)DOUBLEP(cell_obj);
+  const char* pbc = (const char*)(PyArray_DATA(pbc_obj));
+  const long* repeat = (const long*)(PyArray_DATA(repeat_obj));
+  const double (*phi)[nD] = (const double (*)[nD])DOUBLEP(phi_obj);
+  double* rhistogram = (double*)DOUBLEP(rhistogram_obj);
+  double* Dhistogram = (double*)DOUBLEP(Dhistogram_obj);
+
+  int nbinsr = PyArray_DIMS(rhistogram_obj)[0];
+  int nbinsD = PyArray_DIMS(Dhistogram_obj)[0];
+
+  // Without repeat, pairs are found with the minimum image convention:
+  bool mic = (repeat[0] == 0 && repeat[1] == 0 && repeat[2] == 0);
+  // The i1 == i2 term is halved only in the minimum image case (as in vdw):
+  double xself = mic ? 0.5 : 1.0;
+
+  int nb_c[3];
+  double h_c[3];
+  for (int c = 0; c < 3; c++)
+    {
+      nb_c[c] = MAX(1, (int)(cell[c] / rcut));
+      h_c[c] = cell[c] / nb_c[c];
+    }
+  int nb = nb_c[0] * nb_c[1] * nb_c[2];
+
+  // Sort points into boxes:
+  int* b_i = GPAW_MALLOC(int, ni);
+  int* i_j = GPAW_MALLOC(int, ni);
+  int* b_bc = GPAW_MALLOC(int, 3 * nb);
+  int* j_b = GPAW_MALLOC(int, nb + 1);
+  double* N_b = GPAW_MALLOC(double, nb);
+  double* q_b = GPAW_MALLOC(double, nb);
+  double (*R_bc)[3] = (double (*)[3])GPAW_MALLOC(double, 3 * nb);
+  for (int b = 0; b <= nb; b++)
+    j_b[b] = 0;
+  for (int i = 0; i < ni; i++)
+    {
+      int b = 0;
+      for (int c = 0; c < 3; c++)
+        {
+          int bc = (int)floor(R[i][c] / h_c[c]);
+          bc = MIN(MAX(bc, 0), nb_c[c] - 1);
+          b = b * nb_c[c] + bc;
+        }
+      b_i[i] = b;
+      j_b[b + 1]++;
+    }
+  for (int b = 0; b < nb; b++)
+    {
+      j_b[b + 1] += j_b[b];
+      b_bc[3 * b + 0] = b / (nb_c[1] * nb_c[2]);
+      b_bc[3 * b + 1] = (b / nb_c[2]) % nb_c[1];
+      b_bc[3 * b + 2] = b % nb_c[2];
+      N_b[b] = 0.0;
+      q_b[b] = 0.0;
+      R_bc[b][0] = R_bc[b][1] = R_bc[b][2] = 0.0;
+    }
+  int* fill_b = GPAW_MALLOC(int, nb);
+  for (int b = 0; b < nb; b++)
+    fill_b[b] = j_b[b];
+  for (int i = 0; i < ni; i++)
+    {
+      int b = b_i[i];
+      i_j[fill_b[b]++] = i;
+      N_b[b] += n[i];
+      q_b[b] += n[i] * q0[i];
+      for (int c = 0; c < 3; c++)
+        R_bc[b][c] += n[i] * R[i][c];
+    }
+  free(fill_b);
+  for (int b = 0; b < nb; b++)
+    if (N_b[b] != 0.0)
+      {
+        q_b[b] /= N_b[b];
+        for (int c = 0; c < 3; c++)
+          R_bc[b][c] /= N_b[b];
+      }
+
+#ifdef _OPENMP
+  int nthreads = omp_get_max_threads();
+#else
+  int nthreads = 1;
+#endif
+  // Private histograms for each thread:
+  double* rhist_t = GPAW_MALLOC(double, nthreads * nbinsr);
+  double* Dhist_t = GPAW_MALLOC(double, nthreads * nbinsD);
+  for (int x = 0; x < nthreads * nbinsr; x++)
+    rhist_t[x] = 0.0;
+  for (int x = 0; x < nthreads * nbinsD; x++)
+    Dhist_t[x] = 0.0;
+
+  double enear = 0.0;
+  double efar = 0.0;
+
+  #pragma omp parallel reduction(+:enear,efar)
+  {
+#ifdef _OPENMP
+    int thread_id = omp_get_thread_num();
+#else
+    int thread_id = 0;
+#endif
+    double* rhist = rhist_t + thread_id * nbinsr;
+    double* Dhist = Dhist_t + thread_id * nbinsD;
+
+    #pragma omp for schedule(dynamic, 16)
+    for (int i1 = iA; i1 < iB; i1++)
+      {
+        const double* R1 = R[i1];
+        double q01 = q0[i1];
+        double n1 = n[i1];
+        const int* b1_c = b_bc + 3 * b_i[i1];
+        for (int a1 = -repeat[0]; a1 <= repeat[0]; a1++)
+          for (int a2 = -repeat[1]; a2 <= repeat[1]; a2++)
+            for (int a3 = -repeat[2]; a3 <= repeat[2]; a3++)
+              {
+                long a_c[3] = {a1, a2, a3};
+                double R1a[3];
+                int b1a_c[3];
+                for (int c = 0; c < 3; c++)
+                  {
+                    R1a[c] = R1[c] + a_c[c] * cell[c];
+                    b1a_c[c] = b1_c[c] + a_c[c] * nb_c[c];
+                  }
+                for (int b = 0; b < nb; b++)
+                  {
+                    if (N_b[b] == 0.0)
+                      continue;
+                    bool near = true;
+                    for (int c = 0; c < 3; c++)
+                      {
+                        int d = abs(b_bc[3 * b + c] - b1a_c[c]);
+                        if (mic && pbc[c])
+                          d = MIN(d, nb_c[c] - d);
+                        if (d > 1)
+                          near = false;
+                      }
+                    if (!near)
+                      {
+                        double rr = 0.0;
+                        for (int c = 0; c < 3; c++)
+                          {
+                            double f = R_bc[b][c] - R1a[c];
+                            if (mic && pbc[c])
+                              f = fmod(f + 1.5 * cell[c], cell[c]) -
+                                0.5 * cell[c];
+                            rr += f * f;
+                          }
+                        double r = sqrt(rr);
+                        double d1 = r * q01;
+                        double d2 = r * q_b[b];
+                        double D = 0.5 * (d1 + d2);
+                        double e12 = 0.5 * vdwtail(d1, d2) * n1 * N_b[b];
+                        int bin = (int)(r / drhist);
+                        if (bin < nbinsr)
+                          rhist[bin] += e12;
+                        bin = (int)(D / dDhist);
+                        if (bin < nbinsD)
+                          Dhist[bin] += e12;
+                        efar += e12;
+                        continue;
+                      }
+                    for (int j = j_b[b]; j < j_b[b + 1]; j++)
+                      {
+                        int i2 = i_j[j];
+                        double rr = 0.0;
+                        for (int c = 0; c < 3; c++)
+                          {
+                            double f = R[i2][c] - R1a[c];
+                            if (mic && pbc[c])
+                              f = fmod(f + 1.5 * cell[c], cell[c]) -
+                                0.5 * cell[c];
+                            rr += f * f;
+                          }
+                        double r = sqrt(rr);
+                        double d1 = r * q01;
+                        double d2 = r * q0[i2];
+                        double D = 0.5 * (d1 + d2);
+                        double x = 0.5;
+                        if (i2 == i1 && a1 == 0 && a2 == 0 && a3 == 0)
+                          x = xself;
+                        double e12 = (vdwkernel(D, d1, d2,
+                                                nD, ndelta, dD, ddelta, phi) *
+                                      n1 * n[i2] * x);
+                        int bin = (int)(r / drhist);
+                        if (bin < nbinsr)
+                          rhist[bin] += e12;
+                        bin = (int)(D / dDhist);
+                        if (bin < nbinsD)
+                          Dhist[bin] += e12;
+                        enear += e12;
+                      }
+                  }
+              }
+      }
+  }
+
+  for (int t = 0; t < nthreads; t++)
+    {
+      for (int x = 0; x < nbinsr; x++)
+        rhistogram[x] += rhist_t[t * nbinsr + x];
+      for (int x = 0; x < nbinsD; x++)
+        Dhistogram[x] += Dhist_t[t * nbinsD + x];
+    }
+  free(rhist_t);
+  free(Dhist_t);
+  free(b_i);
+  free(i_j);
+  free(b_bc);
+  free(j_b);
+  free(N_b);
+  free(q_b);
+  free(R_bc);
+  return Py_BuildValue("(dd)", enear, efar);
+}
+
 PyObject * vdw2(PyObject* self, PyObject *args)
 {
   PyArrayObject* phi_jp_obj;
@@ -191,3 +461,64 @@ PyObject * vdw2(PyObject* self, PyObject *args)
     }
   Py_RETURN_NONE;
 }
+
+/* Batched version of vdw2():
+ *
+ *   F_ak[a, k] += sum_b phi_ab(|k|) theta_bk[b, k]
+ *
+ * for all (local) b in one pass.  The spline coefficients are stored as
+ * phi_jabp[j, a, b, p] so that everything needed for one k is a single
+ * contiguous block.  F_ak holds the rows a0, a0 + 1, ... only, so that
+ * the caller can limit memory by doing a few alphas at a time. */
+PyObject * vdw2_batch(PyObject* self, PyObject *args)
+{
+  PyArrayObject* phi_jabp_obj;
+  PyArrayObject* j_k_obj;
+  PyArrayObject* dk_k_obj;
+  PyArrayObject* theta_bk_obj;
+  PyArrayObject* F_ak_obj;
+  int a0 = 0;
+  if (!PyArg_ParseTuple(args, "OOOOO|i", &phi_jabp_obj, &j_k_obj, &dk_k_obj,
+                        &theta_bk_obj, &F_ak_obj, &a0))
+    return NULL;
+
+  const double* phi_jabp = (const double*)PyArray_DATA(phi_jabp_obj);
+  const long* j_k = (const long*)PyArray_DATA(j_k_obj);
+  const double* dk_k = (const double*)PyArray_DATA(dk_k_obj);
+  const complex double* theta_bk = (const complex double*)PyArray_DATA(theta_bk_obj);
+  complex double* F_ak = (complex double*)PyArray_DATA(F_ak_obj);
+
+  int na = PyArray_DIMS(phi_jabp_obj)[1];
+  int nb = PyArray_DIMS(phi_jabp_obj)[2];
+  int nk = PyArray_SIZE(j_k_obj);
+  int nF = PyArray_DIMS(F_ak_obj)[0];
+  assert(PyArray_DIMS(theta_bk_obj)[0] == nb);
+  assert(a0 >= 0 && a0 + nF <= na);
+
+  #pragma omp parallel
+  {
+    complex double* theta_b = GPAW_MALLOC(complex double, nb);
+    #pragma omp for schedule(static)
+    for (int k = 0; k < nk; k++)
+      {
+        const double* phi_abp = phi_jabp + 4 * na * nb * j_k[k];
+        double x = dk_k[k];
+        for (int b = 0; b < nb; b++)
+          theta_b[b] = theta_bk[b * (long)nk + k];
+        for (int a = 0; a < nF; a++)
+          {
+            const double* phi_bp = phi_abp + 4 * nb * (a0 + a);
+            complex double F = 0.0;
+            for (int b = 0; b < nb; b++)
+              {
+                const double* phi_p = phi_bp + 4 * b;
+                F += theta_b[b] * (phi_p[0] + x * (phi_p[1] + x *
+                                                   (phi_p[2] + x * phi_p[3])));
+              }
+            F_ak[a * (long)nk + k] += F;
+          }
+      }
+    free(theta_b);
+  }
+  Py_RETURN_NONE;
+}
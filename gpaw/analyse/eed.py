@@ -23,17 +23,27 @@ class ExteriorElectronDensity:
         self.gd = gd
 
         n = len(atoms)
-        atom_c = atoms.positions / Bohr
-        vdWradius = np.empty(n)
+        self.atom_c = atoms.positions / Bohr
+        self.vdWradius = np.empty(n)
         for a, atom in enumerate(atoms):
-            vdWradius[a] = self.get_vdWradius(atom.number)
+            self.vdWradius[a] = self.get_vdWradius(atom.number)
 
         # define the exterior region mask
         mask = gd.empty(dtype=int)
-        cgpaw.eed_region(mask, atom_c, gd.beg_c, gd.end_c,
-                         gd.h_cv.diagonal().copy(), vdWradius)
+        cgpaw.eed_region(mask, self.atom_c, gd.beg_c, gd.end_c,
+                         gd.h_cv.diagonal().copy(), self.vdWradius)
         self.mask = mask
 
+    def get_signed_distance(self, dmax):
+        """Distance to the nearest van der Waals sphere (in Bohr).
+
+        Negative inside the spheres and cut off at dmax outside."""
+        gd = self.gd
+        d_G = gd.empty()
+        cgpaw.eed_region(d_G, self.atom_c, gd.beg_c, gd.end_c,
+                         gd.h_cv.diagonal().copy(), self.vdWradius, dmax)
+        return d_G
+
     def get_weight(self, psit_G):
         """Get the weight of a wave function in the exterior region
         (outside of the van der Waals radius). The augmentation sphere
@@ -361,6 +361,16 @@ class PWArray(DistributedArrays[PWDesc]):
         assert comm.size == out.desc.comm.size, (comm, out.desc.comm)
 
         plan = plan or out.desc.fft_plans(xp=xp)
+        if (xp is np and self.dims and comm.size == 1 and
+            out.desc.comm.size == 1 and out.data.flags.c_contiguous):
+            coef_bG = np.ascontiguousarray(self.data)
+            plan.ifft_spheres(coef_bG.reshape((-1, coef_bG.shape[-1])),
+                              self.desc,
+                              out.data.reshape((-1,) + out.data.shape[-3:]))
+            if not periodic:
+                out.multiply_by_eikr()
+            return out
+
         this = self.gather()
         if this is not None:
             for coef_G, out1 in zips(this._arrays(), out.flat()):
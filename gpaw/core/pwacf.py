@@ -11,8 +11,9 @@ from gpaw.ffbt import rescaled_fourier_bessel_transform
 from gpaw.gpu import cupy_is_fake
 from gpaw.lfc import BaseLFC
 from gpaw.new import prod
-from gpaw.new.c import pwlfc_expand, pwlfc_expand_gpu
-from gpaw.spherical_harmonics import Y, nablarlYL
+from gpaw.new.c import (pwlfc_add, pwlfc_expand, pwlfc_expand_gpu,
+                        pwlfc_integrate)
+from gpaw.spherical_harmonics import solid_harmonics
 from gpaw.utilities.blas import mmm
 
 if TYPE_CHECKING:
@@ -72,6 +73,23 @@ class PWAtomCenteredFunctions(AtomCenteredFunctions):
         self._lfc = None
 
 
+def structure_factors(i_cG, spos_ac, xp=np):
+    """Calculate exp(-2 pi i n_G.s_a) from one small table per axis.
+
+    Three complex multiplications per (G, a) pair instead of a
+    matrix-matrix product and a complex exponential.
+    """
+    emiGR_Ga = xp.ones((i_cG.shape[1], len(spos_ac)), complex)
+    if i_cG.shape[1] == 0:
+        return emiGR_Ga
+    for i_G, s_a in zip(i_cG, np.asarray(spos_ac).T):
+        i0 = i_G.min()
+        n_i = np.arange(i0, i_G.max() + 1)
+        t_ia = np.exp(-2j * pi * n_i[:, np.newaxis] * s_a)
+        emiGR_Ga *= xp.asarray(t_ia)[xp.asarray(i_G - i0)]
+    return emiGR_Ga
+
+
 class PWLFC(BaseLFC):
     def __init__(self,
                  functions,
@@ -164,9 +182,8 @@ class PWLFC(BaseLFC):
 
         # Spherical harmonics:
         G_Gv = self.pw.G_plus_k_Gv
-        self.Y_GL = xp.empty((len(G_Gv), (self.lmax + 1)**2))
-        for L in range((self.lmax + 1)**2):
-            self.Y_GL[:, L] = xp.asarray(Y(L, *G_Gv.T))
+        self.Y_GL = xp.asarray(
+            solid_harmonics(self.lmax, G_Gv.T).T.copy())
 
         self.l_s = xp.asarray(self.l_s)
         self.a_J = xp.asarray(self.a_J)
@@ -192,9 +209,11 @@ class PWLFC(BaseLFC):
 
         self.pos_av = np.dot(spos_ac, self.pw.cell)
 
-        Gk_Gv = xp.asarray(self.pw.G_plus_k_Gv)
-        GkR_Ga = Gk_Gv @ xp.asarray(self.pos_av.T)
-        self.emiGR_Ga = xp.exp(-1j * GkR_Ga) * self.eikR_a
+        # exp(-i(G+k).R) * exp(ik.R) = exp(-2 pi i n.s), where n are the
+        # integer components of G.  Only the phase tables depend on
+        # the positions:
+        i_cG = self.pw.indices_cG[:, self.pw.ng1:self.pw.ng2]
+        self.emiGR_Ga = structure_factors(i_cG, spos_ac, xp)
 
         rank_a = atomdist.rank_a
 
@@ -299,6 +318,14 @@ class PWLFC(BaseLFC):
         c_xI = c_xI.reshape((nx, self.nI))
         a_xG = a_xG.reshape((nx, a_xG.shape[-1])).view(self.dtype)
 
+        if self.xp is np:
+            # Expand and multiply one cache-sized block of G-vectors
+            # at a time:
+            pwlfc_add(self.f_Gs, self.emiGR_Ga, self.Y_GL,
+                      self.l_s, self.a_J, self.s_J,
+                      c_xI, 1.0 / self.pw.dv, a_xG)
+            return
+
         for G1, G2 in self.block():
             f_GI = self.expand(G1, G2, cc=False)
 
@@ -307,13 +334,9 @@ class PWLFC(BaseLFC):
                 G1 *= 2
                 G2 *= 2
 
-            if self.xp is np:
-                mmm(1.0 / self.pw.dv, c_xI, 'N', f_GI, 'T',
-                    1.0, a_xG[:, G1:G2])
-            else:
-                self.xp.cublas.gemm('N', 'T',
-                                    c_xI, f_GI, a_xG[:, G1:G2],
-                                    1.0 / self.pw.dv, 1.0)
+            self.xp.cublas.gemm('N', 'T',
+                                c_xI, f_GI, a_xG[:, G1:G2],
+                                1.0 / self.pw.dv, 1.0)
 
     def integrate(self, a_xG, c_axi=None, q=-1):
         xp = self.xp
@@ -335,21 +358,27 @@ class PWLFC(BaseLFC):
         if c_axi is None:
             c_axi = self.dict(a_xG.shape[:-1])
 
-        x = 0.0
-        for G1, G2 in self.block():
-            f_GI = self.expand(G1, G2, cc=self.dtype == complex)
-            if self.dtype == float:
-                if G1 == 0 and self.comm.rank == 0:
-                    f_GI[0] *= 0.5
-                G1 *= 2
-                G2 *= 2
-            if xp is np:
-                mmm(alpha, a_xG[:, G1:G2], 'N', f_GI, 'N', x, b_xI)
-            else:
+        if xp is np:
+            # Expand and multiply one cache-sized block of G-vectors
+            # at a time:
+            pwlfc_integrate(self.f_Gs, self.emiGR_Ga, self.Y_GL,
+                            self.l_s, self.a_J, self.s_J,
+                            a_xG, alpha,
+                            self.dtype == float and self.comm.rank == 0,
+                            b_xI)
+        else:
+            x = 0.0
+            for G1, G2 in self.block():
+                f_GI = self.expand(G1, G2, cc=self.dtype == complex)
+                if self.dtype == float:
+                    if G1 == 0 and self.comm.rank == 0:
+                        f_GI[0] *= 0.5
+                    G1 *= 2
+                    G2 *= 2
                 xp.cublas.gemm('N', 'N',
                                a_xG[:, G1:G2], f_GI, b_xI,
                                alpha, x)
-            x = 1.0
+                x = 1.0
 
         self.comm.sum(b_xI)
         for a, I1, I2 in self.my_indices:
@@ -457,8 +486,8 @@ class PWLFC(BaseLFC):
         stress_vv = xp.zeros((3, 3))
         for G1, G2 in self.block(ensure_same_number_of_blocks=True):
             G_Gv = G0_Gv[G1:G2]
-            Z_LvG = xp.array([nablarlYL(L, G_Gv.T)
-                              for L in range((lmax + 1)**2)])
+            Z_LvG = xp.asarray(solid_harmonics(
+                lmax, G_Gv.T, derivatives=True)[1].transpose((1, 0, 2)))
             G_Gv = xp.asarray(G_Gv)
             aa_xG = a_xG[..., G1:G2]
             for v1 in range(3):
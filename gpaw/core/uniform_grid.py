@@ -15,7 +15,9 @@ from gpaw.mpi import MPIComm, serial_comm
 from gpaw.new import zips
 from gpaw.typing import (Array1D, Array2D, Array3D, Array4D, ArrayLike1D,
                          ArrayLike2D, Vector)
-from gpaw.new.c import add_to_density, add_to_density_gpu, symmetrize_ft
+from gpaw.new.c import (add_to_density, add_to_density_batch,
+                        add_to_density_gpu)
+from gpaw.symmetry import get_grid_symmetrizer
 from gpaw.fd_operators import Gradient
 
 
@@ -723,8 +725,13 @@ class UGArray(DistributedArrays[UGDesc]):
         assert out is not None
 
         if self.xp is np:
-            for f, psit_R in zips(weights, self.data):
-                add_to_density(f, psit_R, out.data)
+            if self.data.ndim == 4:
+                assert len(weights) == len(self.data)
+                add_to_density_batch(np.asarray(weights, float),
+                                     self.data, out.data)
+            else:
+                for f, psit_R in zips(weights, self.data):
+                    add_to_density(f, psit_R, out.data)
         elif cupy_is_fake:
             for f, psit_R in zips(weights, self.data):
                 add_to_density(f, psit_R._data, out.data._data)  # type: ignore
@@ -746,10 +753,11 @@ class UGArray(DistributedArrays[UGDesc]):
             b_xR = a_xR.new()
             t_sc = (translation_sc * self.desc.size_c).round().astype(int)
             offset_c = np.array(self.desc.zerobc_c, dtype=int)
+            symmetrizer = get_grid_symmetrizer(rotation_scc, t_sc,
+                                               self.desc.size_c, offset_c)
             for a_R, b_R in zips(a_xR._arrays(), b_xR._arrays()):
                 b_R[:] = 0.0
-                for r_cc, t_c in zips(rotation_scc, t_sc):
-                    symmetrize_ft(a_R, b_R, r_cc, t_c, offset_c)
+                symmetrizer(a_R, b_R)
             if self.xp is not np:
                 b_xR = b_xR.to_xp(self.xp)
         self.scatter_from(b_xR)
@@ -811,11 +819,12 @@ class UGArray(DistributedArrays[UGDesc]):
         grad_v = [
             Gradient(self.desc._gd, v, n=3, dtype=self.desc.dtype)
             for v in range(3)]
-        tmp_R = self.desc.empty()
+        tmp_vR = self.desc.empty(3)
         for f, psit_R in zips(occ_n, self):
-            for grad in grad_v:
+            for grad, tmp_R in zips(grad_v, tmp_vR):
                 grad(psit_R, tmp_R)
-                add_to_density(0.5 * f, tmp_R.data, taut_R.data)
+            add_to_density_batch(np.full(3, 0.5 * f), tmp_vR.data,
+                                 taut_R.data)
 
     def redist(self,
                domain: UGDesc,
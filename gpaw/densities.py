@@ -9,7 +9,7 @@ from ase.units import Bohr
 from gpaw.core.atom_arrays import AtomArrays, AtomArraysLayout
 from gpaw.core.uniform_grid import UGArray
 from gpaw.setup import Setups
-from gpaw.spherical_harmonics import Y
+from gpaw.spherical_harmonics import solid_harmonics
 from gpaw.spline import Spline
 from gpaw.typing import Array1D, Array3D, Vector, Array2D
 from gpaw.new import zips
@@ -168,7 +168,7 @@ def add(R_v: Vector,
                 a_sr = np.zeros((ncomponents, npoints))
                 d_rv = d_Rv[mask_R]
                 d_r = d_R[mask_R]
-                Y_Lr = [Y(L, *d_rv.T) for L in range((lmax + 1)**2)]
+                Y_Lr = solid_harmonics(lmax, d_rv.T)
                 phi_jr = [phi.map(d_r) for phi in phi_j]
                 phit_jr = [phit.map(d_r) for phit in phit_j]
                 l_j = [phi.l for phi in phi_j]
@@ -102,14 +102,8 @@ class WaveFunctions:
                 phase_cd = np.exp(2j * pi * gd.sdisp_cd * k_c[:, np.newaxis])
 
                 psit_nG = gd.empty(nbands, dtype=self.dtype)
-
-                for n, psit_G in enumerate(psit_nG):
-                    # XXX Seems to corrupt my memory somehow ???
-                    psit_G[:] = kd.symmetry.symmetrize_wavefunction(
-                        kpt_.psit_nG[n], ik_c, k_c, op_cc, time_reversal)
-                    # Choose gauge
-                    # psit_0 = psit_G[0, 0, 0]
-                    # psit_G *= psit_0.conj() / (abs(psit_0))
+                psit_nG[:] = kd.symmetry.symmetrize_wavefunction(
+                    kpt_.psit_nG[:nbands], ik_c, k_c, op_cc, time_reversal)
 
                 kpt = KPointContainer(weight=weight,
                                       k=k,
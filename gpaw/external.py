@@ -209,7 +209,10 @@ class PointChargePotential(ExternalPotential):
         has matching value, first derivative, second derivative and integral.
 
         For rc2 - width < r < rc2, 1 / r is multiplied by a smooth cutoff
-        function (a third order polynomium in r).
+        function (a third order polynomium in r).  With the default
+        rc2=inf, every charge contributes at every grid point.  For many
+        charges, a finite rc2 makes the cost depend only on the number
+        of charges near each grid point.
 
         You can also give rc a negative value.  In that case, this formula
         is used::
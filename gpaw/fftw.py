@@ -7,7 +7,10 @@ Python wrapper for FFTW3 library
 """
 from __future__ import annotations
 
+import os
+import tempfile
 import weakref
+from pathlib import Path
 from types import ModuleType
 
 import numpy as np
@@ -15,6 +18,7 @@ from scipy.fft import fftn, ifftn, irfftn, rfftn
 import warnings
 
 import gpaw.cgpaw as cgpaw
+from gpaw.new.c import pw_insert
 from gpaw.typing import Array1D, Array3D, DTypeLike, IntVector
 
 ESTIMATE = 64
@@ -30,6 +34,40 @@ def have_fftw() -> bool:
     return hasattr(cgpaw, 'FFTWPlan')
 
 
+def wisdom_file(size_c: IntVector, dtype: DTypeLike) -> Path | None:
+    """FFTW wisdom file for grid shape (None if not enabled).
+
+    Set the ``GPAW_FFTW_WISDOM`` environment variable to a directory
+    to keep wisdom between calculations.
+    """
+    folder = os.environ.get('GPAW_FFTW_WISDOM')
+    if not folder:
+        return None
+    kind = 'real' if dtype == float else 'complex'
+    shape = 'x'.join(str(int(N)) for N in size_c)
+    nthreads = cgpaw.get_num_threads()
+    return Path(folder) / f'{shape}-{kind}-{nthreads}.wisdom'
+
+
+def import_wisdom(path: Path) -> None:
+    if path.is_file():
+        cgpaw.FFTWImportWisdom(path.read_text())
+
+
+def export_wisdom(path: Path) -> None:
+    """Write wisdom to file if planning has created new wisdom."""
+    if not cgpaw.FFTWNewWisdom():
+        return
+    path.parent.mkdir(parents=True, exist_ok=True)
+    # Several processes may write the same file, so we write to a
+    # temporary file and rename it:
+    with tempfile.NamedTemporaryFile('w', dir=path.parent,
+                                     prefix=path.name,
+                                     delete=False) as fd:
+        fd.write(cgpaw.FFTWExportWisdom())
+    os.replace(fd.name, path)
+
+
 def check_fft_size(n: int, factors=[2, 3, 5, 7]) -> bool:
     """Check if n is an efficient fft size.
 
@@ -63,6 +101,14 @@ def get_efficient_fft_size(N: int, n=1, factors=[2, 3, 5, 7]) -> int:
     return N
 
 
+def sphere_block_size(size_c: IntVector) -> int:
+    """Number of bands to transform together with batched sphere FFTs.
+
+    Keeps a block of 3d arrays around 16 MB.
+    """
+    return min(max(2**20 // int(np.prod(size_c)), 1), 16)
+
+
 def empty(shape, dtype=float):
     """numpy.empty() equivalent with 16 byte alignment."""
     assert dtype == complex
@@ -138,23 +184,56 @@ class FFTPlans:
         if coef_G is None:
             out_R.scatter_from(None)
             return
-        pw.paste(coef_G, self.tmp_Q)
-        if pw.dtype == float:
-            t = self.tmp_Q[:, :, 0]
-            n, m = (s // 2 - 1 for s in out_R.desc.size_c[:2])
-            t[0, -m:] = t[0, m:0:-1].conj()
-            t[n:0:-1, -m:] = t[-n:, m:0:-1].conj()
-            t[-n:, -m:] = t[n:0:-1, m:0:-1].conj()
-            t[-n:, 0] = t[n:0:-1, 0].conj()
+        self._paste_sphere(coef_G, pw)
         self.ifft()
         out_R.scatter_from(self.tmp_R)
 
+    def _paste_sphere(self, coef_G, pw):
+        # Insert coefficients, zero the rest of the box and (for real
+        # functions) complete the Q_z=0 plane in one go:
+        pw_insert(coef_G, pw.indices(self.shape), 1.0, self.tmp_Q,
+                  pw.dtype == float)
+
     def fft_sphere(self, in_R, pw):
         self.tmp_R[:] = in_R.data
         self.fft()
         coefs = pw.cut(self.tmp_Q) * (1 / self.tmp_R.size)
         return coefs
 
+    def ifft_spheres(self, coef_bG, pw, out_bR):
+        """Inverse FFT of a block of sphere coefficients.
+
+        ``coef_bG`` and ``out_bR`` are plain arrays of shape (nb, nG) and
+        (nb, N0, N1, N2).
+        """
+        for coef_G, out_R in zip(coef_bG, out_bR):
+            self._paste_sphere(coef_G, pw)
+            self.ifft()
+            out_R[:] = self.tmp_R
+
+    def fft_spheres(self, in_bR, pw, coef_bG):
+        """FFT of a block of real-space arrays to sphere coefficients."""
+        for in_R, coef_G in zip(in_bR, coef_bG):
+            self.tmp_R[:] = in_R
+            self.fft()
+            coef_G[:] = pw.cut(self.tmp_Q) * (1 / self.tmp_R.size)
+
+    def apply_potential_spheres(self, psit_bG, pw, vt_R, ekin_G, out_bG):
+        """Apply kinetic energy and local potential to a block of bands.
+
+        ``out_bG = ekin_G * psit_bG + FFT[vt_R * IFFT[psit_bG]]``.
+        """
+        B = sphere_block_size(vt_R.shape)
+        tmp_bR = np.empty((min(B, len(psit_bG)),) + vt_R.shape,
+                          self.tmp_R.dtype)
+        for b1 in range(0, len(psit_bG), B):
+            b2 = min(b1 + B, len(psit_bG))
+            a_bR = tmp_bR[:b2 - b1]
+            self.ifft_spheres(psit_bG[b1:b2], pw, a_bR)
+            a_bR *= vt_R
+            self.fft_spheres(a_bR, pw, out_bG[b1:b2])
+            out_bG[b1:b2] += ekin_G * psit_bG[b1:b2]
+
 
 class FFTWPlans(FFTPlans):
     """FFTW3 3d transforms."""
@@ -162,25 +241,130 @@ class FFTWPlans(FFTPlans):
         if not have_fftw():
             raise ImportError('Not compiled with FFTW.')
         super().__init__(size_c, dtype)
+        self.wisdom = wisdom_file(size_c, dtype)
+        if self.wisdom:
+            import_wisdom(self.wisdom)
         self._fftplan = cgpaw.FFTWPlan(self.tmp_R, self.tmp_Q, -1, flags)
         self._ifftplan = cgpaw.FFTWPlan(self.tmp_Q, self.tmp_R, 1, flags)
+        if self.wisdom:
+            export_wisdom(self.wisdom)
+
+        self.flags = flags
+        # Work buffers and FFTW plans shared by all k-points:
+        self.sphere_box: FFTWSphereBox | None = None
+        # Index tables go away with the PWDesc objects:
+        self.sphere_plans: weakref.WeakKeyDictionary = (
+            weakref.WeakKeyDictionary())
 
     def fft(self):
-        cgpaw.FFTWExecute(self._fftplan)
+        self._fftplan.execute()
 
     def ifft(self):
-        cgpaw.FFTWExecute(self._ifftplan)
+        self._ifftplan.execute()
 
-    def __del__(self):
-        # Attributes will not exist if execution stops during FFTW planning
-        if hasattr(self, '_fftplan'):
-            cgpaw.FFTWDestroy(self._fftplan)
-        if hasattr(self, '_ifftplan'):
-            cgpaw.FFTWDestroy(self._ifftplan)
+    def _sphere_plan(self, pw) -> FFTWSpherePlan:
+        plan = self.sphere_plans.get(pw)
+        if plan is None:
+            if self.sphere_box is None:
+                self.sphere_box = FFTWSphereBox(self.tmp_R.shape, pw.dtype,
+                                                flags=self.flags)
+            plan = FFTWSpherePlan(pw.indices(self.shape), self.sphere_box)
+            if self.wisdom:
+                export_wisdom(self.wisdom)
+            self.sphere_plans[pw] = plan
+        return plan
+
+    def ifft_spheres(self, coef_bG, pw, out_bR):
+        self._sphere_plan(pw).ifft(coef_bG, out_bR)
+
+    def fft_spheres(self, in_bR, pw, coef_bG):
+        self._sphere_plan(pw).fft(in_bR, coef_bG)
+
+    def apply_potential_spheres(self, psit_bG, pw, vt_R, ekin_G, out_bG):
+        self._sphere_plan(pw).apply_potential(psit_bG, vt_R, ekin_G, out_bG)
+
+
+class FFTWSphereBox:
+    """Work buffers and FFTW plans for batched sphere transforms.
+
+    Shared by all spheres (k-points) with the same box shape, dtype and
+    block size of ``nbands``.
+    """
+    def __init__(self,
+                 size_c: IntVector,
+                 dtype: DTypeLike,
+                 nbands: int | None = None,
+                 flags: int = MEASURE):
+        if nbands is None:
+            nbands = sphere_block_size(size_c)
+        self.nbands = nbands
+        self.dtype = dtype
+        self._box = cgpaw.FFTWSphereBox(
+            tuple(int(N) for N in size_c), nbands, dtype == float, flags)
+
+
+class FFTWSpherePlan:
+    """Batched FFTW3 transforms between G-spheres and 3d grids.
+
+    Bands are transformed in blocks of ``box.nbands``.  The first 1d pass
+    only touches the lines of the box that contain coefficients inside
+    the cutoff sphere and the second pass only the planes crossed by
+    those lines.
+    """
+    def __init__(self, Q_G: Array1D, box: FFTWSphereBox):
+        self.nbands = box.nbands
+        self.nG = len(Q_G)
+        self.dtype = box.dtype
+        self._plan = cgpaw.FFTWSpherePlan(
+            np.ascontiguousarray(Q_G, dtype=np.int32), box._box)
+
+    def ifft(self, coef_bG, out_bR):
+        """Transform coef_bG (nb, nG) to out_bR (nb, N0, N1, N2)."""
+        assert coef_bG.flags.c_contiguous and out_bR.flags.c_contiguous
+        assert coef_bG.dtype == complex and out_bR.dtype == self.dtype
+        B = self.nbands
+        for b1 in range(0, len(coef_bG), B):
+            self._plan.ifft(coef_bG[b1:b1 + B], out_bR[b1:b1 + B])
+
+    def fft(self, in_bR, coef_bG):
+        """Transform in_bR (nb, N0, N1, N2) to coef_bG (nb, nG)."""
+        assert coef_bG.flags.c_contiguous and in_bR.flags.c_contiguous
+        assert coef_bG.dtype == complex and in_bR.dtype == self.dtype
+        B = self.nbands
+        for b1 in range(0, len(coef_bG), B):
+            self._plan.fft(in_bR[b1:b1 + B], coef_bG[b1:b1 + B])
+
+    def apply_potential(self, psit_bG, vt_R, ekin_G, out_bG):
+        """out_bG = ekin_G * psit_bG + FFT[vt_R * IFFT[psit_bG]]."""
+        assert psit_bG.flags.c_contiguous and out_bG.flags.c_contiguous
+        assert psit_bG.dtype == complex and out_bG.dtype == complex
+        vt_R = np.ascontiguousarray(vt_R, dtype=float)
+        ekin_G = np.ascontiguousarray(ekin_G, dtype=float)
+        B = self.nbands
+        for b1 in range(0, len(psit_bG), B):
+            self._plan.apply_potential(psit_bG[b1:b1 + B], vt_R, ekin_G,
+                                       out_bG[b1:b1 + B])
 
 
 class NumpyFFTPlans(FFTPlans):
     """Numpy fallback."""
+    def ifft_spheres(self, coef_bG, pw, out_bR):
+        B = sphere_block_size(out_bR.shape[1:])
+        Q_G = pw.indices(self.shape)
+        for b1 in range(0, len(coef_bG), B):
+            c_bG = coef_bG[b1:b1 + B]
+            tmp_bQ = np.empty((len(c_bG),) + self.shape, complex)
+            pw_insert(c_bG, Q_G, 1.0, tmp_bQ, pw.dtype == float)
+            if pw.dtype == float:
+                out_bR[b1:b1 + B] = irfftn(tmp_bQ, out_bR.shape[1:],
+                                           axes=(1, 2, 3),
+                                           norm='forward',
+                                           overwrite_x=True)
+            else:
+                out_bR[b1:b1 + B] = ifftn(tmp_bQ, axes=(1, 2, 3),
+                                          norm='forward',
+                                          overwrite_x=True)
+
     def fft(self):
         if self.tmp_R.dtype == float:
             self.tmp_Q[:] = rfftn(self.tmp_R, overwrite_x=True)
@@ -269,7 +453,7 @@ class CuPyFFTPlans(FFTPlans):
         else:
             # We need a GPU kernel for this stuff:
             t = array_Q[:, :, 0]
-            n, m = (s // 2 - 1 for s in out_R.desc.size_c[:2])
+            n, m = ((s - 1) // 2 for s in out_R.desc.size_c[:2])
             t[0, -m:] = t[0, m:0:-1].conj()
             t[n:0:-1, -m:] = t[-n:, m:0:-1].conj()
             t[-n:, -m:] = t[n:0:-1, m:0:-1].conj()
@@ -336,16 +520,11 @@ class FFTWPlan(FFTPlan):
     def __init__(self, in_R, out_R, sign, flags=MEASURE):
         if not have_fftw():
             raise ImportError('Not compiled with FFTW.')
-        self._ptr = cgpaw.FFTWPlan(in_R, out_R, sign, flags)
+        self._plan = cgpaw.FFTWPlan(in_R, out_R, sign, flags)
         FFTPlan.__init__(self, in_R, out_R, sign, flags)
 
     def execute(self):
-        cgpaw.FFTWExecute(self._ptr)
-
-    def __del__(self):
-        if getattr(self, '_ptr', None):
-            cgpaw.FFTWDestroy(self._ptr)
-        self._ptr = None
+        self._plan.execute()
 
 
 class NumpyFFTPlan(FFTPlan):
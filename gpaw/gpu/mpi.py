@@ -12,15 +12,16 @@ class CuPyMPI:
     def __repr__(self):
         return f'CuPyMPI({self.comm})'
 
-    def sum(self, array, root=-1):
+    def sum(self, array, root=-1, block=True, hierarchical=False):
         if isinstance(array, (float, int)):
             1 / 0
             return self.comm.sum(array, root)
         if isinstance(array, np.ndarray):
-            self.comm.sum(array, root)
-            return
+            return self.comm.sum(array, root, block, hierarchical)
         a = array.get()
-        self.comm.sum(a, root)
+        request = self.comm.sum(a, root, block, hierarchical)
+        if not block:
+            return CuPyRequest(request, a, array)
         array.set(a)
 
     def sum_scalar(self, a, root=-1):
@@ -35,8 +36,8 @@ class CuPyMPI:
     def max(self, array):
         self.comm.max(array)
 
-    def all_gather(self, a, b):
-        self.comm.all_gather(a, b)
+    def all_gather(self, a, b, block=True):
+        return self.comm.all_gather(a, b, block)
 
     def gather(self, a, rank, b):
         if isinstance(a, np.ndarray):
@@ -62,12 +63,13 @@ class CuPyMPI:
         self.comm.scatter(a, b, root)
         to[:] = cp.asarray(b)
 
-    def broadcast(self, a, root):
+    def broadcast(self, a, root, block=True):
         if isinstance(a, np.ndarray):
-            self.comm.broadcast(a, root)
-            return
+            return self.comm.broadcast(a, root, block)
         b = a.get()
-        self.comm.broadcast(b, root)
+        request = self.comm.broadcast(b, root, block)
+        if not block:
+            return CuPyRequest(request, b, a)
         a[...] = cp.asarray(b)
 
     def receive(self, a, rank, tag=0, block=True):
@@ -96,10 +98,12 @@ class CuPyMPI:
 
     def alltoallv(self,
                   fro, ssizes, soffsets,
-                  to, rsizes, roffsets):
+                  to, rsizes, roffsets, block=True):
         a = np.empty(to.shape, to.dtype)
-        self.comm.alltoallv(fro.get(), ssizes, soffsets,
-                            a, rsizes, roffsets)
+        request = self.comm.alltoallv(fro.get(), ssizes, soffsets,
+                                      a, rsizes, roffsets, block)
+        if not block:
+            return CuPyRequest(request, a, to)
         to[:] = cp.asarray(a)
 
     def wait(self, request):
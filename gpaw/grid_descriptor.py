@@ -18,10 +18,10 @@ import numpy as np
 
 from scipy.ndimage import map_coordinates
 
-import gpaw.cgpaw as cgpaw
 import gpaw.mpi as mpi
 from gpaw.domain import Domain
 from gpaw.new import prod
+from gpaw.symmetry import get_grid_symmetrizer
 from gpaw.typing import Array1D, Array3D, Vector
 from gpaw.utilities.blas import mmm, r2k, rk
 
@@ -462,14 +462,14 @@ class GridDescriptor(Domain):
 
         A_g = self.collect(a_g)
         if self.comm.rank == 0:
+            if ft_sc is None:
+                t_sc = np.zeros((len(op_scc), 3), int)
+            else:
+                t_sc = (ft_sc * self.N_c).round().astype(int)
+            symmetrizer = get_grid_symmetrizer(op_scc, t_sc, self.N_c,
+                                               1 - self.pbc_c)
             B_g = np.zeros_like(A_g)
-            for s, op_cc in enumerate(op_scc):
-                if ft_sc is None:
-                    cgpaw.symmetrize(A_g, B_g, op_cc, 1 - self.pbc_c)
-                else:
-                    t_c = (ft_sc[s] * self.N_c).round().astype(int)
-                    cgpaw.symmetrize_ft(A_g, B_g, op_cc, t_c,
-                                        1 - self.pbc_c)
+            symmetrizer(A_g, B_g)
         else:
             B_g = None
         self.distribute(B_g, a_g)
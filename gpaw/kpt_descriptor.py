@@ -323,7 +323,8 @@ class KPointDescriptor:
     def transform_wave_function(self, psit_G, k, index_G=None, phase_G=None):
         """Transform wave function from IBZ to BZ.
 
-        k is the index of the desired k-point in the full BZ.
+        k is the index of the desired k-point in the full BZ.  Without
+        index_G and phase_G, psit_G can have leading dimensions (bands).
         """
 
         s = self.sym_k[k]
@@ -53,7 +53,7 @@ from ase.units import Bohr
 import gpaw.cgpaw as cgpaw
 from gpaw.ffbt import ffbt, FourierBesselTransformer
 from gpaw.gaunt import gaunt
-from gpaw.spherical_harmonics import Yl, nablarlYL
+from gpaw.spherical_harmonics import Yl, nablarlYL, solid_harmonics
 from gpaw.spline import Spline
 from gpaw.utilities.tools import tri2full
 from gpaw.utilities.timing import nulltimer
@@ -95,6 +95,12 @@ class OverlapExpansion(BaseOverlapExpansionSet):
                           True, Rhat_c, drlYdR_Lc, dxdR_cmi)
         # timer.stop('deriv')
 
+    def evaluate_many(self, R_pc, rlY_Lp, G_LLL, x_pmi,
+                      drlYdR_cLp=None, dxdR_pcmi=None):
+        """Evaluate overlaps (or derivatives) for many displacements."""
+        cgpaw.tci_overlap_many(self.la, self.lb, G_LLL, self.cspline_l,
+                               R_pc, rlY_Lp, x_pmi, drlYdR_cLp, dxdR_pcmi)
+
 
 class TwoSiteOverlapExpansions(BaseOverlapExpansionSet):
     def __init__(self, la_j, lb_j, oe_jj):
@@ -142,6 +148,29 @@ class TwoSiteOverlapExpansions(BaseOverlapExpansionSet):
             oe.derivative(r, Rhat, rlY_L, G_LLL, drlYdR_Lc, x_cmm)
         return x_cMM
 
+    def evaluate_many(self, R_pc, derivative=False):
+        """Overlaps x_pMM (or derivatives x_pcMM) for displacements R_pc.
+
+        The solid harmonics are calculated once for all displacements and
+        all (j1, j2) blocks are written directly into the output array.
+        """
+        R_pc = np.ascontiguousarray(R_pc, dtype=float).reshape((-1, 3))
+        G_LLL = gaunt(self.lmaxgaunt)
+        lmax = max(self.lmaxspline - 1, 0)
+        if derivative:
+            x_pcMM = self.zeros((len(R_pc), 3))
+            rlY_Lp, drlYdR_cLp = solid_harmonics(lmax, R_pc.T,
+                                                 derivatives=True)
+            for x_pcmm, oe in self.slice(x_pcMM):
+                oe.evaluate_many(R_pc, rlY_Lp, G_LLL, None,
+                                 drlYdR_cLp, x_pcmm)
+            return x_pcMM
+        x_pMM = self.zeros((len(R_pc),))
+        rlY_Lp = solid_harmonics(lmax, R_pc.T)
+        for x_pmm, oe in self.slice(x_pMM):
+            oe.evaluate_many(R_pc, rlY_Lp, G_LLL, x_pmm)
+        return x_pMM
+
 
 class ManySiteOverlapExpansions(BaseOverlapExpansionSet):
     def __init__(self, tsoe_II, I1_a, I2_a):
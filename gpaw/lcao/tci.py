@@ -1,3 +1,5 @@
+from math import pi
+
 import numpy as np
 import scipy.sparse as sparse
 from ase.neighborlist import PrimitiveNeighborList
@@ -6,9 +8,7 @@ from gpaw.utilities.tools import tri2full
 
 # from gpaw import debug
 from gpaw.lcao.overlap import (FourierTransformer, TwoSiteOverlapCalculator,
-                               ManySiteOverlapCalculator,
-                               AtomicDisplacement, NullPhases, BlochPhases,
-                               DerivativeAtomicDisplacement)
+                               ManySiteOverlapCalculator)
 
 
 def get_cutoffs(f_Ij):
@@ -150,16 +150,15 @@ class TCICalculator:
         self.a1a2 = AtomPairRegistry(cutoff_a, pbc_c, cell_cv, spos_ac)
 
         self.ibzk_qc = ibzk_qc
-        if ibzk_qc.any():
-            self.get_phases = BlochPhases
-        else:
-            self.get_phases = NullPhases
 
         self.O_T = self._tci_shortcut(False, False)
         self.P = self._tci_shortcut(True, False)
         self.dOdR_dTdR = self._tci_shortcut(False, True)
         self.dPdR = self._tci_shortcut(True, True)
 
+    # Maximum number of displacements evaluated in one go:
+    batch_size = 1024
+
     def _tci_shortcut(self, P, derivative):
         def calculate(a1, a2):
             return self._calculate(a1, a2, P, derivative)
@@ -167,62 +166,88 @@ class TCICalculator:
 
     def _calculate(self, a1, a2, P=False, derivative=False):
         """Calculate overlap of functions between atoms a1 and a2."""
+        return self.calculate_many([(a1, a2)], P, derivative).get(
+            (a1, a2), None if P else (None, None))
+
+    def calculate_many(self, pairs, P=False, derivative=False):
+        """Calculate overlaps for many pairs of atoms.
+
+        Returns dict mapping (a1, a2) to the same objects as returned by
+        P(a1, a2), O_T(a1, a2), dPdR(a1, a2) or dOdR_dTdR(a1, a2).  Pairs
+        without overlap are left out.
+
+        All displacements between atoms of the same two species are
+        evaluated together (in batches), so that each expansion is done
+        with one call to C for many displacement vectors.
+        """
+        I_a = self.tciexpansions.I_a
+        rcut1_a = self.pt_rcmax_a if P else self.phit_rcmax_a
+        groups = {}
+        for a1, a2 in pairs:
+            # We want to see quickly if there is no overlap because distance
+            # outside bounding spheres.
+            R_c_and_offset_a = self.a1a2.get(a1, a2)
+            if R_c_and_offset_a is None:
+                continue
 
-        # We want to see quickly if there is no overlap because distance
-        # outside bounding spheres.
-
-        R_c_and_offset_a = self.a1a2.get(a1, a2)
-        if R_c_and_offset_a is None:
-            return None if P else (None, None)
-
-        rcut1 = self.pt_rcmax_a[a1] if P else self.phit_rcmax_a[a1]
-        rcut2 = self.phit_rcmax_a[a2]
-        maxdist = rcut1 + rcut2
-
-        # Filter out displacements larger than maxdist:
-        R_c_and_offset_a = [obj for obj in R_c_and_offset_a
-                            if np.linalg.norm(obj[0]) < maxdist]
-        if not R_c_and_offset_a:  # There was no overlap after all
-            return None if P else (None, None)
-
-        dtype = self.dtype
-        get_phases = self.get_phases
-
-        displacement = (DerivativeAtomicDisplacement
-                        if derivative
-                        else AtomicDisplacement)
-        ibzk_qc = self.ibzk_qc
-        nq = len(ibzk_qc)
-        phit_rcmax_a = self.phit_rcmax_a
-        pt_rcmax_a = self.pt_rcmax_a
+            maxdist = rcut1_a[a1] + self.phit_rcmax_a[a2]
 
-        shape = (nq, 3) if derivative else (nq,)
+            # Filter out displacements larger than maxdist:
+            R_c_and_offset_a = [obj for obj in R_c_and_offset_a
+                                if np.linalg.norm(obj[0]) < maxdist]
+            if not R_c_and_offset_a:  # There was no overlap after all
+                continue
 
+            groups.setdefault((I_a[a1], I_a[a2]), []).append(
+                (a1, a2, R_c_and_offset_a))
+
+        results = {}
+        for group in groups.values():
+            batch = []
+            ndisp = 0
+            for pair in group:
+                batch.append(pair)
+                ndisp += len(pair[2])
+                if ndisp >= self.batch_size:
+                    self._calculate_batch(batch, P, derivative, results)
+                    batch = []
+                    ndisp = 0
+            if batch:
+                self._calculate_batch(batch, P, derivative, results)
+        return results
+
+    def _calculate_batch(self, batch, P, derivative, results):
+        a1, a2 = batch[0][:2]
         if P:
-            P_expansion = self.tciexpansions.P_expansions.get(a1, a2)
-            obj = P_qim = P_expansion.zeros(shape, dtype=dtype)
+            expansions = [self.tciexpansions.P_expansions.get(a1, a2)]
         else:
-            O_expansion = self.tciexpansions.O_expansions.get(a1, a2)
-            T_expansion = self.tciexpansions.T_expansions.get(a1, a2)
-            O_qmm = O_expansion.zeros(shape, dtype=dtype)
-            T_qmm = T_expansion.zeros(shape, dtype=dtype)
-            obj = O_qmm, T_qmm
-
-        for R_c, offset in R_c_and_offset_a:
-            norm = np.linalg.norm(R_c)
-            phases = get_phases(ibzk_qc, offset)
-
-            disp = displacement(None, a1, a2, R_c, offset, phases)
-
-            if P:
-                assert norm < pt_rcmax_a[a1] + phit_rcmax_a[a2]
-                disp.evaluate_overlap(P_expansion, P_qim)
-            else:
-                assert norm < phit_rcmax_a[a1] + phit_rcmax_a[a2]
-                disp.evaluate_overlap(O_expansion, O_qmm)
-                disp.evaluate_overlap(T_expansion, T_qmm)
+            expansions = [self.tciexpansions.O_expansions.get(a1, a2),
+                          self.tciexpansions.T_expansions.get(a1, a2)]
+
+        R_pc = np.array([R_c
+                         for _, _, R_c_and_offset_a in batch
+                         for R_c, offset in R_c_and_offset_a])
+        offset_pc = np.array([offset
+                              for _, _, R_c_and_offset_a in batch
+                              for R_c, offset in R_c_and_offset_a])
+        x_epxmm = [expansion.evaluate_many(R_pc, derivative)
+                   for expansion in expansions]
+
+        # Bloch phases:
+        if self.ibzk_qc.any():
+            phase_qp = np.exp(-2j * pi * self.ibzk_qc @ offset_pc.T)
+        else:
+            phase_qp = np.ones((len(self.ibzk_qc), len(R_pc)))
 
-        return obj
+        p1 = 0
+        for a1, a2, R_c_and_offset_a in batch:
+            p2 = p1 + len(R_c_and_offset_a)
+            X_eqxmm = [np.einsum('qp, p... -> q...',
+                                 phase_qp[:, p1:p2], x_pxmm[p1:p2]).astype(
+                                     self.dtype, copy=False)
+                       for x_pxmm in x_epxmm]
+            results[a1, a2] = X_eqxmm[0] if P else tuple(X_eqxmm)
+            p1 = p2
 
 
 class ManyTCICalculator:
@@ -245,25 +270,26 @@ class ManyTCICalculator:
     def P_aqMi(self, my_atom_indices, derivative=False):
         P_axMi = {}
         if derivative:
-            P = self.tci.dPdR
-
             def empty(nI):
                 return np.empty((self.nq, 3, self.nao, nI), self.dtype)
         else:
-            P = self.tci.P
-
             def empty(nI):
                 return np.empty((self.nq, self.nao, nI), self.dtype)
 
         Mindices = self.Mindices
 
+        P_a1a2 = self.tci.calculate_many([(a1, a2)
+                                          for a1 in my_atom_indices
+                                          for a2 in range(self.natoms)],
+                                         P=True, derivative=derivative)
+
         for a1 in my_atom_indices:
             P_xMi = empty(self.setups[a1].ni)
 
             for a2 in range(self.natoms):
                 N1, N2 = Mindices[a2]
                 P_xmi = P_xMi[..., N1:N2, :]
-                P_xim = P(a1, a2)
+                P_xim = P_a1a2.get((a1, a2))
                 if P_xim is None:
                     P_xmi[:] = 0.0
                 else:
@@ -278,22 +304,21 @@ class ManyTCICalculator:
     # @timer('tci-sparseprojectors')
     def P_qIM(self, my_atom_indices):
         nq = self.nq
-        P = self.tci.P
         P_qIM = [sparse.dok_matrix((self.Pindices.max, self.Mindices.max),
                                    dtype=self.dtype)
                  for _ in range(nq)]
 
-        for a1 in my_atom_indices:
+        # We can stride a2 over e.g. bd.comm and then do bd.comm.sum().
+        # How should we do comm.sum() on a sparse matrix though?
+        P_a1a2 = self.tci.calculate_many([(a1, a2)
+                                          for a1 in my_atom_indices
+                                          for a2 in range(self.natoms)],
+                                         P=True)
+        for (a1, a2), P_qim in P_a1a2.items():
             I1, I2 = self.Pindices[a1]
-
-            # We can stride a2 over e.g. bd.comm and then do bd.comm.sum().
-            # How should we do comm.sum() on a sparse matrix though?
-            for a2 in range(self.natoms):
-                M1, M2 = self.Mindices[a2]
-                P_qim = P(a1, a2)
-                if P_qim is not None:
-                    for q in range(nq):
-                        P_qIM[q][I1:I2, M1:M2] = P_qim[q]
+            M1, M2 = self.Mindices[a2]
+            for q in range(nq):
+                P_qIM[q][I1:I2, M1:M2] = P_qim[q]
         P_qIM = [P_IM.tocsr() for P_IM in P_qIM]
         return P_qIM
 
@@ -304,41 +329,40 @@ class ManyTCICalculator:
         Mindices = self.Mindices
 
         if derivative:
-            O_T = self.tci.dOdR_dTdR
             shape = (self.nq, 3, mynao, self.nao)
         else:
-            O_T = self.tci.O_T
             shape = (self.nq, mynao, self.nao)
 
         O_xMM = np.zeros(shape, self.dtype)
         T_xMM = np.zeros(shape, self.dtype)
 
         # XXX the a1/a2 loops are not yet well load balanced.
+        pairs = []
         for a1 in range(self.natoms):
             M1, M2 = Mindices[a1]
             if M2 <= Mstart or M1 >= Mstop:
                 continue
+            a2max = a1 + 1  # if not derivative else self.natoms
+            pairs += [(a1, a2) for a2 in range(gdcomm.rank, a2max,
+                                               gdcomm.size)]
+
+        O_T_a1a2 = self.tci.calculate_many(pairs, derivative=derivative)
 
+        for (a1, a2), (O_xmm, T_xmm) in O_T_a1a2.items():
+            M1, M2 = Mindices[a1]
             myM1 = max(M1 - Mstart, 0)
             myM2 = min(M2 - Mstart, mynao)
             nM = myM2 - myM1
 
             assert nM > 0, nM
 
-            a2max = a1 + 1  # if not derivative else self.natoms
-
-            for a2 in range(gdcomm.rank, a2max, gdcomm.size):
-                O_xmm, T_xmm = O_T(a1, a2)
-                if O_xmm is None:
-                    continue
-
-                N1, N2 = Mindices[a2]
-                m1 = max(Mstart - M1, 0)
-                m2 = m1 + nM  # (Slice may go beyond end of matrix but OK)
-                O_xmm = O_xmm[..., m1:m2, :]
-                T_xmm = T_xmm[..., m1:m2, :]
-                O_xMM[..., myM1:myM2, N1:N2] = O_xmm
-                T_xMM[..., myM1:myM2, N1:N2] = T_xmm
+            N1, N2 = Mindices[a2]
+            m1 = max(Mstart - M1, 0)
+            m2 = m1 + nM  # (Slice may go beyond end of matrix but OK)
+            O_xmm = O_xmm[..., m1:m2, :]
+            T_xmm = T_xmm[..., m1:m2, :]
+            O_xMM[..., myM1:myM2, N1:N2] = O_xmm
+            T_xMM[..., myM1:myM2, N1:N2] = T_xmm
 
         if not ignore_upper and O_xMM.size:  # reshape() fails on size-0 arrays
             assert mynao == self.nao
@@ -104,7 +104,7 @@ class _Communicator:
         else:
             return _Communicator(comm, parent=self)
 
-    def sum(self, a, root=-1):
+    def sum(self, a, root=-1, block=True, hierarchical=False):
         """Perform summation by MPI reduce operations of numerical data.
 
         Parameters:
@@ -120,10 +120,19 @@ class _Communicator:
             Rank of the root process, on which the outcome of the reduce
             operation is valid. A root rank of -1 signifies that the result
             will be distributed back to all processes, i.e. a broadcast.
+        block: bool (default True)
+            If False, start the reduction of the array and return an MPI
+            request immediately.  The array must not be touched until
+            the request has been waited for.
+        hierarchical: bool (default False)
+            Sum int, float and complex arrays in shared memory on each node
+            first, then among one rank per node.  Used for blocking
+            sums with root=-1 only.
 
         """
         if isinstance(a, (int, float, complex)):
             warnings.warn('Please use sum_scalar(...)', stacklevel=2)
+            assert block
             return self.comm.sum_scalar(a, root)
         else:
             # assert a.ndim != 0
@@ -131,7 +140,17 @@ class _Communicator:
             assert tc == int or tc == float or tc == complex
             assert is_contiguous(a, tc)
             assert root == -1 or 0 <= root < self.size
-            self.comm.sum(a, root)
+            return self.comm.sum(a, root, block, hierarchical)
+
+    def setup_hierarchical(self, fake_nodes=1):
+        """Create node communicators and buffers for hierarchical sums.
+
+        Done automatically by the first hierarchical sum.  With
+        ``fake_nodes > 1``, each node is split into that many groups of
+        ranks, so that the communication between node leaders can be
+        tested on a single node.  Must be called by all ranks.
+        """
+        self.comm.setup_hierarchical(fake_nodes)
 
     def sum_scalar(self, a, root=-1):
         assert isinstance(a, (int, float, complex))
@@ -282,7 +301,8 @@ class _Communicator:
         assert 0 <= root < self.size
         self.comm.scatter(a, b, root)
 
-    def alltoallv(self, sbuffer, scounts, sdispls, rbuffer, rcounts, rdispls):
+    def alltoallv(self, sbuffer, scounts, sdispls, rbuffer, rcounts, rdispls,
+                  block=True):
         """All-to-all in a group.
 
         Parameters:
@@ -305,6 +325,8 @@ class _Communicator:
             Integer array (of length group size). Entry i specifies the
             displacement (relative to recvbuf at which to place the incoming
             data from process i
+        block: bool (default True)
+            If False, return an MPI request immediately.
         """
         assert sbuffer.flags.c_contiguous
         assert scounts.flags.c_contiguous
@@ -322,10 +344,10 @@ class _Communicator:
         assert np.all(0 <= rdispls)
         assert np.all(sdispls + scounts <= sbuffer.size)
         assert np.all(rdispls + rcounts <= rbuffer.size)
-        self.comm.alltoallv(sbuffer, scounts, sdispls,
-                            rbuffer, rcounts, rdispls)
+        return self.comm.alltoallv(sbuffer, scounts, sdispls,
+                                   rbuffer, rcounts, rdispls, block)
 
-    def all_gather(self, a, b):
+    def all_gather(self, a, b, block=True):
         """Gather data from all ranks onto all processes in a group.
 
         Parameters:
@@ -336,6 +358,8 @@ class _Communicator:
             Destination of the distributed data, i.e. receive buffer.
             The size of this array must match the size of the distributed
             source arrays multiplied by the number of process in the group.
+        block: bool (default True)
+            If False, return an MPI request immediately.
 
         Example::
 
@@ -368,7 +392,7 @@ class _Communicator:
         assert b.dtype == a.dtype
         assert (b.shape[0] == self.size and a.shape == b.shape[1:] or
                 a.size * self.size == b.size)
-        self.comm.all_gather(a, b)
+        return self.comm.all_gather(a, b, block)
 
     def gather(self, a, root, b=None):
         """Gather data from all ranks onto a single process in a group.
@@ -424,7 +448,7 @@ class _Communicator:
             assert b is None
             self.comm.gather(a, root)
 
-    def broadcast(self, a, root):
+    def broadcast(self, a, root, block=True):
         """Share data from a single process to all ranks in a group.
 
         Parameters:
@@ -434,6 +458,8 @@ class _Communicator:
             Note that after the broadcast, all ranks have the same data.
         root: int
             Rank of the root process, from which the data is to be shared.
+        block: bool (default True)
+            If False, return an MPI request immediately.
 
         Example::
 
@@ -467,7 +493,7 @@ class _Communicator:
         """
         assert 0 <= root < self.size
         assert is_contiguous(a)
-        self.comm.broadcast(a, root)
+        return self.comm.broadcast(a, root, block)
 
     def sendreceive(self, a, dest, b, src, sendtag=123, recvtag=123):
         assert 0 <= dest < self.size
@@ -505,7 +531,8 @@ class _Communicator:
         Parameters:
 
         request: MPI request
-            Request e.g. returned from send/receive when block=False is used.
+            Request e.g. returned from send/receive/sum/broadcast/all_gather/
+            alltoallv when block=False is used.
 
         """
         return self.comm.test(request)
@@ -518,7 +545,8 @@ class _Communicator:
         Parameters:
 
         request: MPI request
-            Request e.g. returned from send/receive when block=False is used.
+            Request e.g. returned from send/receive/sum/broadcast/all_gather/
+            alltoallv when block=False is used.
 
         """
         return self.comm.testall(requests)  # may deallocate requests!
@@ -529,7 +557,8 @@ class _Communicator:
         Parameters:
 
         request: MPI request
-            Request e.g. returned from send/receive when block=False is used.
+            Request e.g. returned from send/receive/sum/broadcast/all_gather/
+            alltoallv when block=False is used.
 
         """
         self.comm.wait(request)
@@ -541,7 +570,8 @@ class _Communicator:
 
         requests: list
             List of MPI requests e.g. aggregated from returned requests of
-            multiple send/receive calls where block=False was used.
+            multiple send/receive/sum/broadcast calls where block=False was
+            used.
 
         """
         self.comm.waitall(requests)
@@ -621,6 +651,23 @@ class _Communicator:
         """
         return self.comm.get_members()
 
+    def split_shared(self):
+        """Create a communicator for the ranks sharing memory with this one.
+
+        The ranks of the returned communicator are all on the same node.
+        """
+        return _Communicator(self.comm.split_shared(), parent=self)
+
+    def allocate_shared(self, nbytes):
+        """Allocate a uint8 array shared by all ranks of a node communicator.
+
+        Must be called by all ranks of a communicator created with
+        split_shared().  The memory is released by free_shared() or at
+        MPI_Finalize().
+        """
+        assert nbytes >= 0
+        return self.comm.allocate_shared(nbytes)
+
     def get_c_object(self):
         """Return the C-object wrapped by this debug interface.
 
@@ -639,6 +686,17 @@ class _Communicator:
 MPIComm = _Communicator  # for type hints
 
 
+class SerialRequest:
+    """Completed request returned by non-blocking serial collectives."""
+    status = 0
+
+    def wait(self):
+        pass
+
+    def test(self):
+        return True
+
+
 # Serial communicator
 class SerialCommunicator:
     size = 1
@@ -650,10 +708,15 @@ class SerialCommunicator:
     def __repr__(self):
         return 'SerialCommunicator()'
 
-    def sum(self, array, root=-1):
+    def sum(self, array, root=-1, block=True, hierarchical=False):
         if isinstance(array, (int, float, complex)):
             warnings.warn('Please use sum_scalar(...)', stacklevel=2)
             return array
+        if not block:
+            return SerialRequest()
+
+    def setup_hierarchical(self, fake_nodes=1):
+        pass
 
     def sum_scalar(self, a, root=-1):
         return a
@@ -677,8 +740,9 @@ class SerialCommunicator:
     def max_scalar(self, value, root=-1):
         return value
 
-    def broadcast(self, buf, root):
-        pass
+    def broadcast(self, buf, root, block=True):
+        if not block:
+            return SerialRequest()
 
     def send(self, buff, dest, tag=123, block=True):
         pass
@@ -689,10 +753,13 @@ class SerialCommunicator:
     def gather(self, a, root, b):
         b[:] = a
 
-    def all_gather(self, a, b):
+    def all_gather(self, a, b, block=True):
         b[:] = a
+        if not block:
+            return SerialRequest()
 
-    def alltoallv(self, sbuffer, scounts, sdispls, rbuffer, rcounts, rdispls):
+    def alltoallv(self, sbuffer, scounts, sdispls, rbuffer, rcounts, rdispls,
+                  block=True):
         assert len(scounts) == 1
         assert len(sdispls) == 1
         assert len(rcounts) == 1
@@ -701,6 +768,8 @@ class SerialCommunicator:
 
         rbuffer[rdispls[0]:rdispls[0] + rcounts[0]] = \
             sbuffer[sdispls[0]:sdispls[0] + scounts[0]]
+        if not block:
+            return SerialRequest()
 
     def new_communicator(self, ranks):
         if self.rank not in ranks:
@@ -716,11 +785,13 @@ class SerialCommunicator:
         return 1
 
     def wait(self, request):
+        if isinstance(request, SerialRequest):
+            return
         raise NotImplementedError('Calls to mpi wait should not happen in '
                                   'serial mode')
 
     def waitall(self, requests):
-        if not requests:
+        if all(isinstance(request, SerialRequest) for request in requests):
             return
         raise NotImplementedError('Calls to mpi waitall should not happen in '
                                   'serial mode')
@@ -744,6 +815,12 @@ class SerialCommunicator:
         raise NotImplementedError(
             'Translate non-trivial ranks with serial comm')
 
+    def split_shared(self):
+        return SerialCommunicator(parent=self)
+
+    def allocate_shared(self, nbytes):
+        return np.zeros(nbytes, np.uint8)
+
     def get_c_object(self):
         if gpaw.dry_run:
             return None  # won't actually be passed to C
@@ -905,6 +982,48 @@ def broadcast_array(array: np.ndarray, *communicators) -> np.ndarray:
     return array
 
 
+def share_on_node(create, comm=world) -> np.ndarray:
+    """Create a read-only array once per node and share it.
+
+    ``create()`` is only called on the first rank of each node.  The
+    array it returns is copied to memory shared by all the node's ranks
+    of ``comm``, so that the other ranks don't hold a copy of their own.
+    Must be called by all ranks of ``comm``.  The shared memory lives
+    until all the node's ranks call free_shared() on the array (or until
+    MPI_Finalize), so this is only worth it for large tables that are
+    created once.
+    """
+    node_comm = comm.split_shared()
+    array = None
+    meta = None
+    if node_comm.rank == 0:
+        array = np.ascontiguousarray(create())
+        meta = (array.shape, array.dtype.str)
+    shape, dtype = broadcast(meta, 0, node_comm)
+    dtype = np.dtype(dtype)
+    nbytes = int(np.prod(shape)) * dtype.itemsize
+    shared = node_comm.allocate_shared(nbytes).view(dtype).reshape(shape)
+    if node_comm.rank == 0:
+        shared[:] = array
+    node_comm.barrier()
+    shared.flags.writeable = False
+    return shared
+
+
+def free_shared(array: np.ndarray) -> None:
+    """Release memory from allocate_shared() or share_on_node().
+
+    Must be called by all ranks sharing the memory.  The array and all
+    other views of the memory must not be used afterwards.  Does nothing
+    for ordinary arrays (serial runs).
+    """
+    base = array
+    while isinstance(base, np.ndarray):
+        base = base.base
+    if base is not None and hasattr(base, 'free'):
+        base.free()
+
+
 def send(obj, rank: int, comm: MPIComm) -> None:
     """Send object to rank on the MPI communicator comm."""
     b = pickle.dumps(obj, pickle.HIGHEST_PROTOCOL)
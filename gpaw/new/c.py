@@ -1,5 +1,7 @@
 from typing import TYPE_CHECKING
 
+import numpy as np
+
 from gpaw.typing import Array1D, ArrayND
 from gpaw.gpu import cupy as cp
 import gpaw.cgpaw as cgpaw
@@ -16,22 +18,47 @@ def add_to_density(f: float,
     nt_X += f * abs(psit_X)**2
 
 
+def add_to_density_batch(f_n: Array1D,
+                         psit_nX: ArrayND,
+                         nt_X: ArrayND) -> None:
+    for f, psit_X in zip(f_n, psit_nX):
+        nt_X += f * abs(psit_X)**2
+
+
 def pw_precond(G2_G: Array1D,
-               r_G: Array1D,
-               ekin: float,
-               o_G: Array1D) -> None:
-    x = 1 / ekin / 3 * G2_G
+               r_G: ArrayND,
+               ekin: float | Array1D,
+               o_G: ArrayND) -> None:
+    if np.isscalar(ekin):
+        ekin_b = np.asarray(ekin, float)
+    else:
+        # Block of bands (one kinetic energy per band):
+        ekin_b = np.asarray(ekin, float).reshape((-1, 1))
+        r_G = r_G.reshape((len(ekin_b), -1))
+        o_G = o_G.reshape((len(ekin_b), -1))
+    x = 1 / ekin_b / 3 * G2_G
     a = 27.0 + x * (18.0 + x * (12.0 + x * 8.0))
     xx = x * x
-    o_G[:] = -4.0 / 3 / ekin * a / (a + 16.0 * xx * xx) * r_G
+    o_G[:] = -4.0 / 3 / ekin_b * a / (a + 16.0 * xx * xx) * r_G
 
 
 def pw_insert(coef_G: Array1D,
               Q_G: Array1D,
               x: float,
-              array_Q: Array1D) -> None:
-    array_Q[:] = 0.0
-    array_Q.ravel()[Q_G] = x * coef_G
+              array_Q: Array1D,
+              hermitian: bool = False) -> None:
+    nb = len(coef_G) if coef_G.ndim == 2 else 1
+    array_bQ = array_Q.reshape((nb, -1))
+    array_bQ[:] = 0.0
+    array_bQ[:, Q_G] = x * coef_G.reshape((nb, -1))
+    if hermitian:
+        # Complete the Q_z=0 plane of the half-complex box:
+        shape = array_Q.shape[-3:]
+        i0, i1, i2 = np.unravel_index(Q_G, shape)
+        mask = (i2 == 0) & ((i0 != 0) | (i1 != 0))
+        Qm = np.ravel_multi_index((-i0[mask], -i1[mask], i2[mask]), shape,
+                                  mode='wrap')
+        array_bQ[:, Qm] = array_bQ[:, Q_G[mask]].conj()
 
 
 def pw_insert_gpu(psit_nG,
@@ -66,6 +93,35 @@ def pwlfc_expand(f_Gs, emiGR_Ga, Y_GL,
     raise NotImplementedError
 
 
+def pwlfc_integrate(f_Gs, emiGR_Ga, Y_GL,
+                    l_s, a_J, s_J,
+                    a_xG, alpha, g0, b_xI):
+    """b_xI += alpha * a_xG @ f_GI (f_GI complex conjugated)."""
+    nG, nI = len(emiGR_Ga), b_xI.shape[-1]
+    if a_xG.dtype == float:
+        f_GI = np.empty((2 * nG, nI))
+    else:
+        f_GI = np.empty((nG, nI), complex)
+    pwlfc_expand(f_Gs, emiGR_Ga, Y_GL, l_s, a_J, s_J,
+                 a_xG.dtype == complex, f_GI)
+    if g0 and a_xG.dtype == float:
+        f_GI[0] *= 0.5
+    b_xI += alpha * a_xG @ f_GI
+
+
+def pwlfc_add(f_Gs, emiGR_Ga, Y_GL,
+              l_s, a_J, s_J,
+              c_xI, alpha, a_xG):
+    """a_xG += alpha * c_xI @ f_GI.T."""
+    nG, nI = len(emiGR_Ga), c_xI.shape[-1]
+    if a_xG.dtype == float:
+        f_GI = np.empty((2 * nG, nI))
+    else:
+        f_GI = np.empty((nG, nI), complex)
+    pwlfc_expand(f_Gs, emiGR_Ga, Y_GL, l_s, a_J, s_J, False, f_GI)
+    a_xG += alpha * c_xI @ f_GI.T
+
+
 def pwlfc_expand_gpu(f_Gs, emiGR_Ga, Y_GL,
                      l_s, a_J, s_J,
                      cc, f_GI, I_J):
@@ -112,8 +168,10 @@ def evaluate_pbe_gpu(nt_sr, vxct_sr, e_r, sigma_xr, dedsigma_xr) -> None:
 
 if not TYPE_CHECKING:
     from gpaw.cgpaw import (  # noqa
-        add_to_density, pw_precond, pw_insert,
+        add_to_density, add_to_density_batch, pw_precond, pw_insert,
         pwlfc_expand, symmetrize_ft)
+    if hasattr(cgpaw, 'pwlfc_integrate'):  # needs BLAS
+        from gpaw.cgpaw import pwlfc_integrate, pwlfc_add  # noqa
 
     if GPU_ENABLED:
         from gpaw.cgpaw import (  # noqa
@@ -17,7 +17,7 @@ from typing import DefaultDict
 
 import numpy as np
 from gpaw.core.arrays import DistributedArrays
-from gpaw.core.atom_arrays import AtomArrays
+from gpaw.core.atom_arrays import AtomArrays, AtomArraysLayout
 from gpaw.core.uniform_grid import UGArray
 from gpaw.new import trace, zips
 from gpaw.new.potential import Potential
@@ -25,7 +25,8 @@ from gpaw.new.xc import Functional
 from gpaw.setup import Setup
 from gpaw.spinorbit import soc as soc_terms
 from gpaw.typing import Array1D, Array2D, Array3D
-from gpaw.utilities import pack_hermitian, pack_density, unpack_hermitian
+from gpaw.utilities import (pack_hermitian, pack_many, packed_dot,
+                            unpack_many)
 from gpaw.new.logger import indent
 from gpaw.mpi import MPIComm, serial_comm
 from gpaw.new.external_potential import ExternalPotential
@@ -142,26 +143,38 @@ def calculate_non_local_potential(setups,
                                   kpt_band_comm: MPIComm
                                   ) -> tuple[AtomArrays,
                                              dict[str, float]]:
-    dtype = float if density.ncomponents < 4 else complex
+    ncomponents = density.ncomponents
+    dtype = float if ncomponents < 4 else complex
     D_asii = density.D_asii.to_xp(np)
-    dH_asii = D_asii.layout.new(dtype=dtype).empty(density.ncomponents)
+    ni_a = [setups[a].ni for a in D_asii.keys()]
+
+    # All atoms are (un)packed in one go and the atomic corrections
+    # work on the packed matrices only:
+    packed_layout = AtomArraysLayout(
+        [setup.ni * (setup.ni + 1) // 2 for setup in setups],
+        atomdist=D_asii.layout.atomdist)
+    D_asp = packed_layout.empty(ncomponents)
+    pack_many(D_asii.data.real, ni_a, D_asp.data, density=True)
+    dH_asp = packed_layout.new(dtype=dtype).zeros(ncomponents)
+
     Q_aL = Q_aL.to_xp(np)
     energy_corrections: DefaultDict[str, float] = defaultdict(float)
     rank = 0
     for a, D_sii in D_asii.items():
         if rank % kpt_band_comm.size == kpt_band_comm.rank:
-            Q_L = Q_aL[a]
-            setup = setups[a]
-            dH_sii, corrections = calculate_non_local_potential1(
-                setup, xc, ext_pot, D_sii, Q_L, soc)
-            dH_asii[a][:] = dH_sii
+            dH_sp, corrections = calculate_packed_non_local_potential1(
+                setups[a], xc, ext_pot, D_sii, D_asp[a].copy(), Q_aL[a], soc)
+            dH_asp[a][:] = dH_sp
             for key, e in corrections.items():
                 energy_corrections[key] += e
-        else:
-            dH_asii[a][:] = 0.0
         rank += 1
 
-    kpt_band_comm.sum(dH_asii.data)
+    energy_corrections['kinetic'] -= kinetic_energy_corrections(
+        D_asii.data, D_asp.data, dH_asp.data, ni_a).sum()
+
+    kpt_band_comm.sum(dH_asp.data)
+    dH_asii = D_asii.layout.new(dtype=dtype).empty(ncomponents)
+    unpack_many(dH_asp.data, ni_a, dH_asii.data)
 
     # Sum over domain:
     names = ['kinetic', 'coulomb', 'zero', 'xc', 'external', 'spinorbit']
@@ -173,6 +186,21 @@ def calculate_non_local_potential(setups,
             dict(zips(names, energies)))
 
 
+def kinetic_energy_corrections(D_xM: np.ndarray,
+                               D_xP: np.ndarray,
+                               dH_xP: np.ndarray,
+                               ni_a: list[int]) -> Array1D:
+    """Calculate sum_sij D_sij dH_sij for each atom.
+
+    ``D_xP`` is the density packed real part of ``D_xM`` and
+    ``dH_xP`` is packed as hermitian.
+    """
+    if D_xM.dtype == complex:
+        return packed_dot(pack_many(D_xM, ni_a), dH_xP, ni_a)
+    return packed_dot(D_xP, np.ascontiguousarray(dH_xP.real), ni_a,
+                      density=True)
+
+
 def calculate_non_local_potential1(setup: Setup,
                                    xc: Functional,
                                    ext_pot,
@@ -180,9 +208,34 @@ def calculate_non_local_potential1(setup: Setup,
                                    Q_L: Array1D,
                                    soc: bool) -> tuple[Array3D,
                                                        dict[str, float]]:
+    ni_a = [setup.ni]
+    D_sM = D_sii.reshape((len(D_sii), -1))
+    D_sp = pack_many(D_sM.real, ni_a, density=True)
+    dH_sp, corrections = calculate_packed_non_local_potential1(
+        setup, xc, ext_pot, D_sii, D_sp, Q_L, soc)
+    corrections['kinetic'] -= kinetic_energy_corrections(
+        D_sM, D_sp, dH_sp, ni_a)[0]
+    dH_sii = unpack_many(dH_sp, ni_a).reshape(D_sii.shape)
+    return dH_sii, corrections
+
+
+def calculate_packed_non_local_potential1(setup: Setup,
+                                          xc: Functional,
+                                          ext_pot,
+                                          D_sii: Array3D,
+                                          D_sp: Array2D,
+                                          Q_L: Array1D,
+                                          soc: bool
+                                          ) -> tuple[Array2D,
+                                                     dict[str, float]]:
+    """Atomic corrections to the Hamiltonian in packed form.
+
+    ``D_sp`` is ``D_sii.real`` packed as a density.  The kinetic energy
+    correction does not include the -sum_sij D_sij dH_sij term (see
+    kinetic_energy_corrections()).
+    """
     ncomponents = len(D_sii)
     ndensities = 2 if ncomponents == 2 else 1
-    D_sp = np.array([pack_density(D_ii.real) for D_ii in D_sii])
 
     D_p = D_sp[:ndensities].sum(0)
 
@@ -206,18 +259,15 @@ def calculate_non_local_potential1(setup: Setup,
 
     e_external = ext_pot.add_paw_correction(setup.Delta_pL[:, 0], dH_sp)
 
-    dH_sii = unpack_hermitian(dH_sp)
-
     if setup.hubbard_u is not None:
         eU, dHU_sii = setup.hubbard_u.calculate(setup, D_sii)
         e_xc += eU
-        dH_sii += dHU_sii
-
-    e_kinetic -= (D_sii * dH_sii).sum().real
-
-    return dH_sii, {'kinetic': e_kinetic,
-                    'coulomb': e_coulomb,
-                    'zero': e_zero,
-                    'xc': e_xc,
-                    'external': e_external,
-                    'spinorbit': e_soc}
+        dHU_sM = dHU_sii.reshape((len(dHU_sii), -1)).astype(dH_sp.dtype)
+        pack_many(dHU_sM, [setup.ni], dH_sp, add=True)
+
+    return dH_sp, {'kinetic': e_kinetic,
+                   'coulomb': e_coulomb,
+                   'zero': e_zero,
+                   'xc': e_xc,
+                   'external': e_external,
+                   'spinorbit': e_soc}
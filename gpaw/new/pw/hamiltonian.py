@@ -34,6 +34,14 @@ class PWHamiltonian(Hamiltonian):
         if xp is not np and pw.comm.size == 1 and pw.dtype == complex:
             return apply_local_potential_gpu(vt_R, psit_nG, out_nG)
         vt_R = vt_R.gather(broadcast=True)
+        if (pw.comm.size == 1 and xp is np and
+            psit_nG.data.flags.c_contiguous and
+            out_nG.data.flags.c_contiguous):
+            # Kinetic energy and local potential for blocks of bands
+            # with batched FFTs:
+            self.plan.apply_potential_spheres(psit_nG.data, pw, vt_R.data,
+                                              pw.ekin_G, out_nG.data)
+            return
         tmp_R = self.grid_local.empty(xp=xp)
         if pw.comm.size == 1:
             pw_local = pw
@@ -107,10 +115,7 @@ def precondition(psit_nG: PWArray,
     ekin_n = psit_nG.norm2('kinetic')
 
     if xp is np:
-        for r_G, o_G, ekin in zips(residual_nG.data,
-                                   out.data,
-                                   ekin_n):
-            pw_precond(G2_G, r_G, ekin, o_G)
+        pw_precond(G2_G, residual_nG.data, ekin_n, out.data)
         return
 
     out.data[:] = gpu_prec(ekin_n[:, np.newaxis],
@@ -128,11 +133,9 @@ def gpu_prec(ekin, G2, residual):
 
 def spinor_precondition(psit_nsG, residual_nsG, out):
     G2_G = psit_nsG.desc.ekin_G * 2
-    for r_sG, o_sG, ekin in zips(residual_nsG.data,
-                                 out.data,
-                                 psit_nsG.norm2('kinetic').sum(1)):
-        for r_G, o_G in zips(r_sG, o_sG):
-            pw_precond(G2_G, r_G, ekin, o_G)
+    ekin_n = psit_nsG.norm2('kinetic').sum(1)
+    # Same kinetic energy for both spinor components:
+    pw_precond(G2_G, residual_nsG.data, ekin_n.repeat(2), out.data)
 
 
 class SpinorPWHamiltonian(Hamiltonian):
@@ -13,6 +13,9 @@ class SpiralPWDesc:
         self.maxmysize = pw.maxmysize
         self.comm = pw.comm
         self.myshape = pw.myshape
+        self.indices_cG = pw.indices_cG
+        self.ng1 = pw.ng1
+        self.ng2 = pw.ng2
         self.G_plus_k_Gv = pw.G_plus_k_Gv + qspiral_v
         self.ekin_G = 0.5 * (self.G_plus_k_Gv**2).sum(1)
         self.kpt = pw.kpt_c + pw.cell_cv @ qspiral_v / (2 * pi)
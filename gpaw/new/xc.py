@@ -8,8 +8,8 @@ import numpy as np
 from gpaw.core import UGArray, UGDesc
 from gpaw.gpu import einsum
 from gpaw.new import zips
-from gpaw.new.c import (add_to_density, add_to_density_gpu, evaluate_lda_gpu,
-                        evaluate_pbe_gpu)
+from gpaw.new.c import (add_to_density_batch, add_to_density_gpu,
+                        evaluate_lda_gpu, evaluate_pbe_gpu)
 from gpaw.new.calculation import DFTState
 from gpaw.new.ibzwfs import IBZWaveFunctions
 from gpaw.new.pwfd.wave_functions import PWFDWaveFunctions
@@ -259,8 +259,7 @@ def dot_product(a_vr, b_vr, out_r):
     if b_vr is None:
         out_r.data[:] = 0.0
         if xp is np:
-            for a_r in a_vr.data:
-                add_to_density(1.0, a_r, out_r.data)
+            add_to_density_batch(np.ones(3), a_vr.data, out_r.data)
         else:
             add_to_density_gpu(xp.ones(3), a_vr.data, out_r.data)
     else:
@@ -3,7 +3,7 @@ from math import pi
 import gpaw.cgpaw as cgpaw
 import numpy as np
 from gpaw.lfc import BaseLFC
-from gpaw.spherical_harmonics import Y, nablarlYL
+from gpaw.spherical_harmonics import solid_harmonics
 from gpaw.ffbt import rescaled_fourier_bessel_transform
 from gpaw.utilities.blas import mmm
 
@@ -99,9 +99,7 @@ class PWLFC(BaseLFC):
         # Spherical harmonics:
         for q, K_v in enumerate(self.pd.K_qv):
             G_Gv = self.pd.get_reciprocal_vectors(q=q)
-            Y_GL = np.empty((len(G_Gv), (self.lmax + 1)**2))
-            for L in range((self.lmax + 1)**2):
-                Y_GL[:, L] = Y(L, *G_Gv.T)
+            Y_GL = solid_harmonics(self.lmax, G_Gv.T).T.copy()
             self.Y_qGL.append(Y_GL)
 
         self.initialized = True
@@ -385,8 +383,8 @@ class PWLFC(BaseLFC):
         stress_vv = np.zeros((3, 3))
         for G1, G2 in self.block(q, ensure_same_number_of_blocks=True):
             G_Gv = G0_Gv[G1:G2]
-            Z_LvG = np.array([nablarlYL(L, G_Gv.T)
-                              for L in range((lmax + 1)**2)])
+            Z_LvG = solid_harmonics(lmax, G_Gv.T,
+                                    derivatives=True)[1].transpose((1, 0, 2))
             aa_xG = a_xG[..., G1:G2]
             for v1 in range(3):
                 for v2 in range(3):
@@ -393,6 +393,23 @@ class KPointTesselation:
             deps_k, self._td.simplices, K, simplices_s, W_w, omega_w, vol_s)
         return W_w
 
+    def tetrahedron_weights(self, K, deps_Mk, omega_w, i0_M, i1_M):
+        """Weights for all bands at once.
+
+        Row M of the returned array has the weights for
+        omega_w[i0_M[M]:i1_M[M]] in its first i1_M[M] - i0_M[M] elements.
+        """
+        simplices_s = self.pts_k[K]
+        i0_M = np.ascontiguousarray(i0_M, dtype=int)
+        i1_M = np.ascontiguousarray(i1_M, dtype=int)
+        nw = max(i1_M - i0_M, default=0)
+        W_Mw = np.empty((len(deps_Mk), max(nw, 0)))
+        vol_s = self.simplex_volumes[simplices_s]
+        cgpaw.tetrahedron_weight_batch(
+            np.ascontiguousarray(deps_Mk), self._td.simplices, K,
+            simplices_s, vol_s, omega_w, i0_M, i1_M, W_Mw)
+        return W_Mw
+
     @cached_property
     def pts_k(self):
         pts_k = [[] for n in range(self.nkpts)]
@@ -461,11 +478,10 @@ class TetrahedronIntegrator(Integrator):
             # Generate frequency weights
             i0_M, i1_M = wd.get_index_range(teteps_Mk.min(1), teteps_Mk.max(1))
             with self.context.timer('tetrahedron weight'):
-                W_Mw = []
-                for deps_k, i0, i1 in zip(deps_Mk, i0_M, i1_M):
-                    W_w = tesselation.tetrahedron_weight(
-                        point.K, deps_k, wd.omega_w[i0:i1])
-                    W_Mw.append(W_w)
+                W_Mw = tesselation.tetrahedron_weights(
+                    point.K, deps_Mk, wd.omega_w, i0_M, i1_M)
+                W_Mw = [W_w[:i1 - i0]
+                        for W_w, i0, i1 in zip(W_Mw, i0_M, i1_M)]
 
             task.run(n_MG, deps_Mk, W_Mw, i0_M, i1_M, out_wxx)
 
@@ -1,6 +1,6 @@
 import numpy as np
 
-from gpaw.cgpaw import GG_shuffle
+from gpaw.cgpaw import GG_shuffle_batch
 
 from gpaw.response.symmetry import QSymmetries
 from gpaw.response.pair_functions import SingleQPWDescriptor
@@ -33,16 +33,18 @@ class BodySymmetryOperators:
 
     def symmetrize_wGG(self, A_wGG):
         """Symmetrize an array in GG'."""
+        sign_s = np.array(self.sign_s, dtype=np.int32)
+        tmp_GG = np.empty_like(A_wGG[0], order='C')
         for A_GG in A_wGG:
-            tmp_GG = np.zeros_like(A_GG, order='C')
-            for G_G, sign in zip(self.G_sG, self.sign_s):
-                # Numpy:
-                # if sign == 1:
-                #     tmp_GG += A_GG[G_G, :][:, G_G]
-                # if sign == -1:
-                #     tmp_GG += A_GG[G_G, :][:, G_G].T
-                # C:
-                GG_shuffle(G_G, sign, A_GG, tmp_GG)
+            # Numpy:
+            # for G_G, sign in zip(self.G_sG, self.sign_s):
+            #     if sign == 1:
+            #         tmp_GG += A_GG[G_G, :][:, G_G]
+            #     if sign == -1:
+            #         tmp_GG += A_GG[G_G, :][:, G_G].T
+            # C (all symmetries in one pass over tmp_GG):
+            tmp_GG[:] = 0.0
+            GG_shuffle_batch(self.G_sG, sign_s, A_GG, tmp_GG)
             A_GG[:] = tmp_GG / self.nsym
 
     # Set up complex frequency alias
@@ -24,8 +24,9 @@ import numpy as np
 from math import pi
 from collections import defaultdict
 from gpaw.cgpaw import spherical_harmonics as Yl
+import gpaw.cgpaw as cgpaw
 
-__all__ = ['Y', 'YL', 'nablarlYL', 'Yl']
+__all__ = ['Y', 'YL', 'nablarlYL', 'Yl', 'solid_harmonics']
 
 names = [['1'],
          ['y', 'z', 'x'],
@@ -66,6 +67,26 @@ def nablarlYL(L, R):
     return dYdx, dYdy, dYdz
 
 
+def solid_harmonics(lmax, R_vx, derivatives=False):
+    """Calculate all real solid harmonics r^l Y_L(R) with l <= lmax.
+
+    R_vx must have shape (3, ...).  Returns Y_Lx of shape (nL, ...) with
+    nL = (lmax + 1)**2 and, if derivatives=True, also the gradients
+    dYdR_vLx of shape (3, nL, ...).  Works for any lmax.
+    """
+    shape = R_vx.shape[1:]
+    R_vx = np.ascontiguousarray(R_vx, dtype=float).reshape((3, -1))
+    nL = (lmax + 1)**2 if lmax >= 0 else 0
+    Y_Lx = np.empty((nL, R_vx.shape[1]))
+    dYdR_vLx = np.empty((3, nL, R_vx.shape[1])) if derivatives else None
+    if nL > 0:
+        cgpaw.solid_harmonics(lmax, R_vx, Y_Lx, dYdR_vLx)
+    Y_Lx = Y_Lx.reshape((nL,) + shape)
+    if derivatives:
+        return Y_Lx, dYdR_vLx.reshape((3, nL) + shape)
+    return Y_Lx
+
+
 g = [1.0]
 for l in range(11):
     g.append(g[-1] * (l + 0.5))
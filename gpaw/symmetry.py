@@ -256,8 +256,8 @@ class Symmetry:
         nsym = len(U_scc)
 
         time_reversal = self.time_reversal and not self.has_inversion
-        bz2bz_ks = map_k_points_fast(bzk_kc, U_scc, time_reversal,
-                                     comm, self.tol)
+        bz2bz_ks = map_k_points(bzk_kc, U_scc, time_reversal,
+                                comm, self.tol)
 
         bz2bz_k = -np.ones(nbzkpts + 1, int)
         ibz2bz_k = []
@@ -344,7 +344,9 @@ class Symmetry:
         """Generate Bloch function from symmetry related function in the IBZ.
 
         a_g: ndarray
-            Array with Bloch function from the irreducible BZ.
+            Array with Bloch function from the irreducible BZ.  Can have
+            leading dimensions (e.g. bands) which are all transformed in
+            one go.
         kibz_c: ndarray
             Corresponding k-point coordinates.
         kbz_c: ndarray
@@ -421,6 +423,61 @@ class Symmetry:
         return '\n'.join(lines)
 
 
+class GridSymmetrizer:
+    def __init__(self, op_scc, t_sc, N_c, offset_c):
+        """Symmetrize real-space arrays with all operations in one go.
+
+        The operations map the grid point g to p = op^T g - t (modulo
+        N_c).  The inverse maps are tabulated once per axis so that
+        the symmetrization can be done as a gather (no modulo
+        operations and no write conflicts).
+
+        op_scc: int ndarray
+            Symmetry operations.
+        t_sc: int ndarray
+            Fractional translations in units of grid spacings.
+        N_c: int ndarray
+            Number of grid points (including the zero boundary points).
+        offset_c: int ndarray
+            1 for directions with zero boundary conditions, otherwise 0.
+        """
+        N_c = np.asarray(N_c)
+        self.offset_c = np.asarray(offset_c, dtype=int)
+        D_scc = np.linalg.inv(op_scc).transpose((0, 2, 1)).round()
+        D_scc = D_scc.astype(int)
+        u_sc = np.einsum('scd, sd -> sc', D_scc, t_sc)
+        self.table_scx = np.empty((len(op_scc), 3, N_c.sum()), np.intc)
+        x = 0
+        for d, N in enumerate(N_c):
+            T_scx = D_scc[:, :, d, np.newaxis] * np.arange(N)
+            if d == 0:
+                T_scx += u_sc[:, :, np.newaxis]
+            self.table_scx[:, :, x:x + N] = T_scx % N_c[:, np.newaxis]
+            x += N
+
+    def __call__(self, a_g, b_g):
+        """Add sum over symmetry operations of a_g to b_g."""
+        cgpaw.symmetrize_gather(a_g, b_g, self.table_scx, self.offset_c)
+
+
+_grid_symmetrizers: dict = {}
+
+
+def get_grid_symmetrizer(op_scc, t_sc, N_c, offset_c) -> GridSymmetrizer:
+    """Cached GridSymmetrizer object."""
+    op_scc = np.asarray(op_scc, dtype=int)
+    t_sc = np.asarray(t_sc, dtype=int)
+    key = (op_scc.tobytes(), t_sc.tobytes(),
+           tuple(N_c), tuple(int(o) for o in offset_c))
+    symmetrizer = _grid_symmetrizers.get(key)
+    if symmetrizer is None:
+        if len(_grid_symmetrizers) > 10:
+            _grid_symmetrizers.clear()
+        symmetrizer = GridSymmetrizer(op_scc, t_sc, N_c, offset_c)
+        _grid_symmetrizers[key] = symmetrizer
+    return symmetrizer
+
+
 def map_k_points(bzk_kc, U_scc, time_reversal, comm=None, tol=1e-11):
     """Find symmetry relations between k-points.
 
@@ -444,7 +501,7 @@ def map_k_points(bzk_kc, U_scc, time_reversal, comm=None, tol=1e-11):
     bz2bz_ks[k1, s] = -1.
     """
 
-    if comm is None or isinstance(comm, mpi.DryRunCommunicator):
+    if comm is None:
         comm = mpi.serial_comm
 
     nbzkpts = len(bzk_kc)
@@ -455,14 +512,41 @@ def map_k_points(bzk_kc, U_scc, time_reversal, comm=None, tol=1e-11):
     if time_reversal:
         U_scc = np.concatenate([U_scc, -U_scc])
 
+    bzk_kc = np.ascontiguousarray(bzk_kc)
+    size_c, offset_c = k_point_lattice(bzk_kc)
+    if (tol * size_c >= 0.25).any() or size_c.prod() > 8 * nbzkpts:
+        # Irregular k-points (random points or band paths): the lookup
+        # table would be much larger than the list of k-points.
+        size_c = offset_c = None
+
     bz2bz_ks = np.zeros((nbzkpts, len(U_scc)), int)
     bz2bz_ks[ka:kb] = -1
-    cgpaw.map_k_points(np.ascontiguousarray(bzk_kc),
-                       np.ascontiguousarray(U_scc), tol, bz2bz_ks, ka, kb)
+    cgpaw.map_k_points(bzk_kc, np.ascontiguousarray(U_scc), tol,
+                       bz2bz_ks, ka, kb, size_c, offset_c)
     comm.sum(bz2bz_ks)
     return bz2bz_ks
 
 
+def k_point_lattice(bzk_kc):
+    """Guess the lattice that the k-points sit on.
+
+    Returns size_c and offset_c such that most k-points are at
+    offset_c + n_c / size_c, where n_c is a vector of integers.  This is
+    only used for speeding up map_k_points(): points that are not on
+    the lattice are handled correctly, just slower.
+    """
+    size_c = np.ones(3, int)
+    offset_c = bzk_kc[0].copy()
+    for c in range(3):
+        x_k = np.sort((bzk_kc[:, c] - offset_c[c]) % 1.0)
+        dx_k = np.diff(x_k)
+        dx_k = dx_k[dx_k > 1e-6]
+        if len(dx_k) > 0:
+            size_c[c] = max(1, min(int(round(1 / dx_k.min())),
+                                   len(bzk_kc)))
+    return size_c, offset_c
+
+
 def map_k_points_fast(bzk_kc, U_scc, time_reversal, comm=None, tol=1e-7):
     """Find symmetry relations between k-points.
 
@@ -3,6 +3,7 @@ from time import time
 import numpy as np
 import pytest
 
+import gpaw.cgpaw as cgpaw
 from gpaw.core import PWDesc, UGDesc
 from gpaw.gpu import cupy as cp
 
@@ -38,6 +39,60 @@ def test_pw_abs_square(xp, nbands):
     abs_square(a=2.5, N=6, B=nbands, xp=xp)
 
 
+@pytest.mark.parametrize('dtype', [float, complex])
+@pytest.mark.parametrize('view', [False, True])
+def test_add_to_density_batch(dtype, view):
+    rng = np.random.default_rng(3)
+    shape = (9, 7, 10)
+    nbands = 13
+    a_nR = rng.random((nbands,) + shape).astype(dtype)
+    if dtype == complex:
+        a_nR += 1j * rng.random((nbands,) + shape)
+    if view:
+        a_nR = a_nR[::2, :, 1:, :6]
+        shape = a_nR.shape[1:]
+    f_n = rng.random(len(a_nR))
+    f_n[1] = 0.0
+    nt_R = rng.random(shape)
+    ref_R = nt_R + np.einsum('n, nxyz -> xyz', f_n, abs(a_nR)**2)
+    cgpaw.add_to_density_batch(f_n, a_nR, nt_R)
+    assert nt_R == pytest.approx(ref_R, abs=1e-13)
+
+
+def test_add_to_density_batch_checks():
+    a_nR = np.ones((2, 3, 4, 5))
+    f_n = np.ones(2)
+    with pytest.raises(ValueError):
+        cgpaw.add_to_density_batch(f_n, a_nR[0], np.zeros((4, 5)))
+    with pytest.raises(ValueError):
+        cgpaw.add_to_density_batch(f_n, a_nR, np.zeros((3, 4, 5), np.float32))
+    with pytest.raises(ValueError):
+        cgpaw.add_to_density_batch(f_n, a_nR, np.zeros((3, 4, 10))[..., ::2])
+    with pytest.raises(ValueError):
+        cgpaw.add_to_density_batch(f_n, a_nR, np.zeros((3, 4, 6)))
+    with pytest.raises(ValueError):
+        cgpaw.add_to_density_batch(f_n[:1], a_nR, np.zeros((3, 4, 5)))
+
+
+def test_ug_abs_square():
+    grid = UGDesc(cell=[3, 3, 3], size=[40, 40, 40])
+    nbands = 40
+    psit_nR = grid.empty(nbands)
+    psit_nR.data[:] = np.random.default_rng(5).random(psit_nR.data.shape)
+    weight_n = np.linspace(2, 0, nbands)
+    nt1_R = grid.zeros()
+    t0 = time()
+    for weight, psit_R in zip(weight_n, psit_nR.data):
+        cgpaw.add_to_density(weight, psit_R, nt1_R.data)
+    t1 = time()
+    nt2_R = grid.zeros()
+    psit_nR.abs_square(weight_n, nt2_R)
+    t2 = time()
+    assert nt2_R.data == pytest.approx(nt1_R.data, abs=1e-12)
+    print(f'{nbands} bands: band by band {t1 - t0:.4f} s, '
+          f'batched {t2 - t1:.4f} s')
+
+
 def main():
     """Test speedup for larger system."""
     abs_square(6.0, 32, 100, cp)  # GPU-warmup
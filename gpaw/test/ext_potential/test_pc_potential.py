@@ -0,0 +1,82 @@
+import numpy as np
+import pytest
+
+import gpaw.cgpaw as cgpaw
+
+
+def pc_potential_py(beg_v, h_v, q_p, R_pv, rc, rc2, width, shape,
+                    dcom_pv=None, rhot_G=None):
+    """Equivalent slow Python code (potential and forces)."""
+    r_Gv = (np.indices(shape).reshape((3, -1)).T + beg_v) * h_v
+    d_Gpv = R_pv - r_Gv[:, np.newaxis]
+    d_Gp = (d_Gpv**2).sum(2)**0.5
+    if dcom_pv is None:
+        dc_Gp = d_Gp
+        dc_Gpv = d_Gpv
+    else:
+        dc_Gp = np.broadcast_to((dcom_pv**2).sum(1)**0.5, d_Gp.shape)
+        dc_Gpv = np.broadcast_to(dcom_pv, d_Gpv.shape)
+    rc12 = rc2 - width
+    x_Gp = np.clip((dc_Gp - rc12) / width, 0, 1)
+    s2_Gp = (d_Gp / rc)**2
+    if rc < 0:
+        v_Gp = (d_Gp**4 - rc**4) / (d_Gp**5 + rc**5)
+        x5_Gp = d_Gp**5 + rc**5
+        w_Gp = (d_Gp**4 - rc**4) / x5_Gp**2 * 5 * d_Gp**3 - 4 * d_Gp**2 / x5_Gp
+        o_Gp = 0.0 * d_Gp
+    else:
+        inner_Gp = (3.28125 +
+                    s2_Gp * (-5.46875 +
+                             s2_Gp * (4.59375 + s2_Gp * -1.40625))) / rc
+        v_Gp = np.where(d_Gp > rc, 1 / d_Gp, inner_Gp)
+        v_Gp = np.where(dc_Gp > rc12, (1 - x_Gp**2 * (3 - 2 * x_Gp)) / d_Gp,
+                        v_Gp)
+        v_Gp[dc_Gp > rc2] = 0.0
+        inner_Gp = -2 * (-5.46875 +
+                         s2_Gp * (2 * 4.59375 + s2_Gp * 3 * -1.40625)) / rc**3
+        w_Gp = np.where(d_Gp > rc, 1 / d_Gp**3, inner_Gp)
+        w_Gp = np.where(dc_Gp > rc12,
+                        (1 - x_Gp**2 * (3 - 2 * x_Gp)) / d_Gp**3, w_Gp)
+        o_Gp = np.where(dc_Gp > rc12,
+                        6 * x_Gp * (1 - x_Gp) / (width * dc_Gp * d_Gp), 0.0)
+        w_Gp[dc_Gp > rc2] = 0.0
+        o_Gp[dc_Gp > rc2] = 0.0
+    vext_G = -(v_Gp * q_p).sum(1).reshape(shape)
+    if rhot_G is None:
+        return vext_G
+    f_Gp = q_p * rhot_G.reshape((-1, 1)) * np.prod(h_v)
+    F_pv = -np.einsum('Gp, Gpv -> pv', w_Gp * f_Gp, d_Gpv)
+    F_pv -= np.einsum('Gp, Gpv -> pv', o_Gp * f_Gp, dc_Gpv)
+    return F_pv
+
+
+@pytest.mark.parametrize('rc, rc2, com',
+                         [(0.3, 1.2, False),
+                          (0.3, 1.2, True),
+                          (0.3, np.inf, False),
+                          (-0.3, np.inf, False)])
+def test_pc_potential(rc, rc2, com):
+    rng = np.random.default_rng(11)
+    shape = (14, 12, 10)
+    beg_v = np.array([1, 0, 2])
+    h_v = np.array([0.2, 0.21, 0.22])
+    npc = 60
+    R_pv = rng.random((npc, 3)) * 4.0 - 0.5
+    q_p = rng.random(npc) - 0.5
+    dcom_pv = rng.random((npc, 3)) * 1.5 - 0.5 if com else None
+    width = 0.4
+    rhot_G = rng.random(shape)
+
+    vext_G = np.zeros(shape)
+    cgpaw.pc_potential(beg_v, h_v, q_p, R_pv, rc, rc2, width,
+                       vext_G, dcom_pv)
+    ref_G = pc_potential_py(beg_v, h_v, q_p, R_pv, rc, rc2, width, shape,
+                            dcom_pv)
+    assert vext_G == pytest.approx(ref_G, abs=1e-11)
+
+    F_pv = np.zeros((npc, 3))
+    cgpaw.pc_potential(beg_v, h_v, q_p, R_pv, rc, rc2, width,
+                       vext_G, dcom_pv, rhot_G, F_pv)
+    ref_pv = pc_potential_py(beg_v, h_v, q_p, R_pv, rc, rc2, width, shape,
+                             dcom_pv, rhot_G)
+    assert F_pv == pytest.approx(ref_pv, abs=1e-11)
@@ -0,0 +1,63 @@
+import numpy as np
+import pytest
+
+from gpaw.gaunt import gaunt
+from gpaw.lcao.overlap import (AtomicDisplacement,
+                               DerivativeAtomicDisplacement,
+                               FourierTransformer, NullPhases,
+                               TwoSiteOverlapCalculator)
+from gpaw.spherical_harmonics import solid_harmonics
+from gpaw.spline import Spline
+
+
+def expansions():
+    rcut = 5.0
+    r_g = np.linspace(0, rcut, 200)
+    f_j = [Spline.from_data(l, rcut, np.exp(-a * r_g**2) * (rcut - r_g))
+           for l, a in [(0, 0.5), (1, 0.7), (2, 1.1), (3, 0.9)]]
+    tsoc = TwoSiteOverlapCalculator(FourierTransformer(rcut, N=2**10))
+    f_jq = tsoc.transform(f_j)
+    l_j = [f.get_angular_momentum_number() for f in f_j]
+    return tsoc.calculate_expansions(l_j, f_jq, l_j[1:], f_jq[1:])
+
+
+@pytest.mark.parametrize('derivative', [False, True])
+def test_tci_many(derivative):
+    tsoe = expansions()
+    R_pc = np.random.default_rng(42).random((70, 3)) * 6 - 3
+    R_pc[0] = 0.0
+    disp = DerivativeAtomicDisplacement if derivative else AtomicDisplacement
+    shape = (1, 3) if derivative else (1,)
+
+    ref_pxMM = []
+    for R_c in R_pc:
+        x_qxMM = tsoe.zeros(shape)
+        disp(None, 0, 0, R_c, None, NullPhases(None, None)).evaluate_overlap(
+            tsoe, x_qxMM)
+        ref_pxMM.append(x_qxMM[0])
+    x_pxMM = tsoe.evaluate_many(R_pc, derivative)
+    assert x_pxMM == pytest.approx(np.array(ref_pxMM), abs=1e-9)
+
+
+def test_tci_many_checks():
+    tsoe = expansions()
+    oe = tsoe.oe_jj[1, 1]
+    G_LLL = gaunt(tsoe.lmaxgaunt)
+    R_pc = np.ones((4, 3))
+    rlY_Lp, drlYdR_cLp = solid_harmonics(tsoe.lmaxspline, R_pc.T,
+                                         derivatives=True)
+    x_pmi = np.zeros((4,) + oe.shape)
+    oe.evaluate_many(R_pc, rlY_Lp, G_LLL, x_pmi)
+    for args in [(R_pc.astype(np.float32), rlY_Lp, G_LLL, x_pmi),
+                 (R_pc[:, :2], rlY_Lp, G_LLL, x_pmi),
+                 (R_pc, rlY_Lp[:, ::2], G_LLL, x_pmi),
+                 (R_pc, rlY_Lp.T.copy(), G_LLL, x_pmi),
+                 (R_pc, rlY_Lp, G_LLL, x_pmi[:3]),
+                 (R_pc, rlY_Lp, G_LLL, None,
+                  drlYdR_cLp[:2], np.zeros((4, 3) + oe.shape)),
+                 (R_pc, rlY_Lp, G_LLL, None,
+                  drlYdR_cLp[:, :, :3].copy(), np.zeros((4, 3) + oe.shape)),
+                 (R_pc, rlY_Lp, G_LLL, None,
+                  drlYdR_cLp.astype(complex), np.zeros((4, 3) + oe.shape))]:
+        with pytest.raises(ValueError):
+            oe.evaluate_many(*args)
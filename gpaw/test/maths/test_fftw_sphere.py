@@ -0,0 +1,135 @@
+import gc
+from time import time
+
+import numpy as np
+import pytest
+
+import gpaw.fftw as fftw
+from gpaw.core import PWDesc, UGDesc
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+@pytest.mark.parametrize('dtype, kpt', [(complex, None),
+                                        (complex, [0.1, 0.2, -0.3]),
+                                        (float, None)])
+def test_sphere_ffts(dtype, kpt):
+    grid = UGDesc(cell=[3.1, 3.7, 4.3], size=[20, 24, 27],
+                  dtype=dtype, kpt=kpt)
+    pw = PWDesc(ecut=40, cell=grid.cell, dtype=dtype, kpt=kpt)
+    plans = fftw.FFTWPlans(grid.size_c, dtype, fftw.ESTIMATE)
+    ref = fftw.NumpyFFTPlans(grid.size_c, dtype)
+
+    # An odd number of bands leaves a partial last block:
+    nbands = 21
+    rng = np.random.default_rng(42)
+    coef_bG = rng.random((nbands, pw.shape[0])) - 0.5 + 0.0j
+    coef_bG += 1j * (rng.random((nbands, pw.shape[0])) - 0.5)
+    if dtype == float:
+        coef_bG[:, 0] = coef_bG[:, 0].real
+
+    a_bR = np.empty((nbands,) + tuple(grid.size_c), dtype)
+    b_bR = np.empty_like(a_bR)
+    plans.ifft_spheres(coef_bG, pw, a_bR)
+    ref.ifft_spheres(coef_bG, pw, b_bR)
+    assert a_bR == pytest.approx(b_bR, abs=1e-12)
+
+    a_bG = np.empty_like(coef_bG)
+    b_bG = np.empty_like(coef_bG)
+    plans.fft_spheres(a_bR, pw, a_bG)
+    ref.fft_spheres(a_bR, pw, b_bG)
+    assert a_bG == pytest.approx(b_bG, abs=1e-14)
+    assert a_bG == pytest.approx(coef_bG, abs=1e-14)
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+def test_sphere_plans_released():
+    grid = UGDesc(cell=[3.1, 3.7, 4.3], size=[20, 24, 27])
+    plans = fftw.FFTWPlans(grid.size_c, complex, fftw.ESTIMATE)
+    a_bR = np.empty((3,) + tuple(grid.size_c), complex)
+    boxes = set()
+    for ecut in [30, 40]:
+        pw = PWDesc(ecut=ecut, cell=grid.cell, dtype=complex)
+        plans.ifft_spheres(np.ones((3, pw.shape[0]), complex), pw, a_bR)
+        assert len(plans.sphere_plans) == 1
+        boxes.add(id(plans.sphere_box))
+        del pw
+        gc.collect()
+        assert len(plans.sphere_plans) == 0
+    assert len(boxes) == 1
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+@pytest.mark.parametrize('dtype', [complex, float])
+def test_sphere_box_shared(dtype):
+    # Alternate between spheres that share buffers and plans:
+    grid = UGDesc(cell=[3.1, 3.7, 4.3], size=[20, 24, 27], dtype=dtype)
+    kpts = [None] if dtype == float else [None, [0.25, 0.0, 0.5]]
+    pws = [PWDesc(ecut=ecut, cell=grid.cell, dtype=dtype, kpt=kpt)
+           for kpt in kpts for ecut in [20, 40]]
+    plans = fftw.FFTWPlans(grid.size_c, dtype, fftw.ESTIMATE)
+    ref = fftw.NumpyFFTPlans(grid.size_c, dtype)
+    rng = np.random.default_rng(7)
+    for pw in pws + pws[::-1]:
+        coef_bG = rng.random((5, pw.shape[0])) + 0.0j
+        a_bR = np.empty((5,) + tuple(grid.size_c), dtype)
+        b_bR = np.empty_like(a_bR)
+        plans.ifft_spheres(coef_bG, pw, a_bR)
+        ref.ifft_spheres(coef_bG, pw, b_bR)
+        assert a_bR == pytest.approx(b_bR, abs=1e-12)
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+@pytest.mark.parametrize('dtype', [complex, float])
+def test_sphere_ffts_timing(dtype):
+    grid = UGDesc(cell=[5.0, 5.0, 5.0], size=[48, 48, 48], dtype=dtype)
+    pw = PWDesc(ecut=25, cell=grid.cell, dtype=dtype)
+    plans = fftw.FFTWPlans(grid.size_c, dtype)
+    nbands = 64
+    coef_bG = np.ones((nbands, pw.shape[0]), complex)
+    psit_nG = pw.empty(nbands)
+    psit_nG.data[:] = coef_bG
+    psit_nR = grid.empty(nbands)
+
+    t0 = time()
+    for psit_G, psit_R in zip(psit_nG, psit_nR):
+        plans.ifft_sphere(psit_G.data, pw, psit_R)
+    t1 = time()
+    a_bR = psit_nR.data.copy()
+    plans.ifft_spheres(coef_bG, pw, psit_nR.data)  # plan
+    t2 = time()
+    plans.ifft_spheres(coef_bG, pw, psit_nR.data)
+    t3 = time()
+    assert psit_nR.data == pytest.approx(a_bR, abs=1e-9)
+
+    t4 = time()
+    for psit_R, coef_G in zip(psit_nR, coef_bG):
+        coef_G[:] = plans.fft_sphere(psit_R.data, pw)
+    t5 = time()
+    plans.fft_spheres(psit_nR.data, pw, coef_bG)
+    t6 = time()
+    assert coef_bG == pytest.approx(1.0)
+
+    print(f'{pw.shape[0]} G-vectors, {nbands} bands:')
+    print(f'ifft: band by band {t1 - t0:.3f} s, batched {t3 - t2:.3f} s '
+          f'(planning {t2 - t1 - (t3 - t2):.3f} s)')
+    print(f'fft:  band by band {t5 - t4:.3f} s, batched {t6 - t5:.3f} s')
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+@pytest.mark.parametrize('dtype', [complex, float])
+def test_apply_potential(dtype):
+    grid = UGDesc(cell=[3.1, 3.7, 4.3], size=[20, 24, 27], dtype=dtype)
+    pw = PWDesc(ecut=40, cell=grid.cell, dtype=dtype)
+    plans = fftw.FFTWPlans(grid.size_c, dtype, fftw.ESTIMATE)
+    ref = fftw.NumpyFFTPlans(grid.size_c, dtype)
+    rng = np.random.default_rng(3)
+    nbands = 11
+    psit_bG = rng.random((nbands, pw.shape[0])) + 0.5j
+    if dtype == float:
+        psit_bG[:, 0] = psit_bG[:, 0].real
+    vt_R = rng.random(grid.size_c)
+    a_bG = np.empty_like(psit_bG)
+    b_bG = np.empty_like(psit_bG)
+    plans.apply_potential_spheres(psit_bG, pw, vt_R, pw.ekin_G, a_bG)
+    ref.apply_potential_spheres(psit_bG, pw, vt_R, pw.ekin_G, b_bG)
+    assert a_bG == pytest.approx(b_bG, abs=1e-12)
@@ -0,0 +1,48 @@
+import gc
+import weakref
+
+import numpy as np
+import pytest
+
+import gpaw.cgpaw as cgpaw
+import gpaw.fftw as fftw
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+def test_plan_keeps_arrays_alive():
+    a = fftw.empty((6, 8, 10), complex)
+    b = fftw.empty((6, 8, 10), complex)
+    plan = cgpaw.FFTWPlan(a, b, -1, fftw.ESTIMATE)
+    a[:] = 1.0
+    a_ref = weakref.ref(a)
+    b_ref = weakref.ref(b)
+    del a, b
+    gc.collect()
+    # The plan owns references to its arrays:
+    assert a_ref() is not None
+    assert b_ref() is not None
+    plan.execute()
+    b = b_ref()
+    assert b[0, 0, 0] == pytest.approx(480.0)
+    assert abs(b).sum() == pytest.approx(480.0)
+    del b, plan
+    gc.collect()
+    assert a_ref() is None
+    assert b_ref() is None
+
+
+@pytest.mark.skipif(not fftw.have_fftw(), reason='No FFTW')
+def test_wisdom(tmp_path, monkeypatch):
+    monkeypatch.setenv('GPAW_FFTW_WISDOM', str(tmp_path))
+    size_c = (60, 64, 72)
+    results = []
+    for cache in ['cold', 'warm']:
+        cgpaw.FFTWForgetWisdom()
+        plans = fftw.FFTWPlans(size_c, complex, fftw.MEASURE)
+        plans.tmp_R[:] = np.arange(np.prod(size_c)).reshape(size_c)
+        plans.fft()
+        results.append(plans.tmp_Q.copy())
+        files = list(tmp_path.glob('60x64x72-complex-*.wisdom'))
+        assert len(files) == 1
+        assert not cgpaw.FFTWNewWisdom()
+    assert results[0] == pytest.approx(results[1])
@@ -0,0 +1,96 @@
+from types import SimpleNamespace
+
+import numpy as np
+import pytest
+
+from gpaw.core import UGDesc
+from gpaw.core.atom_arrays import AtomArraysLayout
+from gpaw.mpi import world
+from gpaw.new.external_potential import ExternalPotential
+from gpaw.new.pot_calc import calculate_non_local_potential
+from gpaw.new.xc import create_functional
+from gpaw.setup import create_setup
+from gpaw.spinorbit import soc as soc_terms
+from gpaw.utilities import pack_density, pack_hermitian, unpack_hermitian
+from gpaw.xc import XC
+
+
+def non_local_potential_per_atom(setup, xc, ext_pot, D_sii, Q_L, soc):
+    """Reference: one atom at a time with full matrices."""
+    ncomponents = len(D_sii)
+    ndensities = 2 if ncomponents == 2 else 1
+    D_sp = np.array([pack_density(D_ii.real) for D_ii in D_sii])
+    D_p = D_sp[:ndensities].sum(0)
+    dH_p = (setup.K_p + setup.M_p +
+            setup.MB_p + 2.0 * setup.M_pp @ D_p +
+            setup.Delta_pL @ Q_L)
+    e_kinetic = setup.K_p @ D_p + setup.Kc
+    e_zero = setup.MB + setup.MB_p @ D_p
+    e_coulomb = setup.M + D_p @ (setup.M_p + setup.M_pp @ D_p)
+    dH_sp = np.zeros_like(D_sp, dtype=float if ncomponents < 4 else complex)
+    e_soc = 0.0
+    if soc:
+        dHsoc_sii = soc_terms(setup, xc.xc, D_sp)
+        e_soc += (D_sii[1:4] * dHsoc_sii).sum().real
+        dH_sp[1:4] = pack_hermitian(dHsoc_sii)
+    dH_sp[:ndensities] = dH_p
+    e_xc = xc.calculate_paw_correction(setup, D_sp, dH_sp)
+    e_external = ext_pot.add_paw_correction(setup.Delta_pL[:, 0], dH_sp)
+    dH_sii = unpack_hermitian(dH_sp)
+    if setup.hubbard_u is not None:
+        eU, dHU_sii = setup.hubbard_u.calculate(setup, D_sii)
+        e_xc += eU
+        dH_sii += dHU_sii
+    e_kinetic -= (D_sii * dH_sii).sum().real
+    return dH_sii, {'kinetic': e_kinetic,
+                    'coulomb': e_coulomb,
+                    'zero': e_zero,
+                    'xc': e_xc,
+                    'external': e_external,
+                    'spinorbit': e_soc}
+
+
+@pytest.mark.parametrize('ncomponents, soc, hubbard',
+                         [(1, False, False),
+                          (2, False, False),
+                          (2, False, True),
+                          (4, False, True),
+                          (4, True, False)])
+def test_packed_non_local_potential(ncomponents, soc, hubbard):
+    type = 'paw:d,4.0' if hubbard else 'paw'
+    setups = [create_setup('Fe', type=type),
+              create_setup('O'),
+              create_setup('Fe', type=type)]
+    grid = UGDesc(cell=[1, 1, 1], size=[9, 9, 9])
+    xc = create_functional(XC('LDA', collinear=ncomponents < 4), grid)
+    ext_pot = ExternalPotential()
+    dtype = float if ncomponents < 4 else complex
+
+    rng = np.random.default_rng(17)
+    D_asii = AtomArraysLayout([(setup.ni, setup.ni) for setup in setups],
+                              dtype=dtype).empty(ncomponents)
+    for a, D_sii in D_asii.items():
+        ni = setups[a].ni
+        D_sii[:] = 0.05 * (rng.random(D_sii.shape) - 0.5)
+        if dtype == complex:
+            D_sii += 0.05j * (rng.random(D_sii.shape) - 0.5)
+        D_sii += D_sii.transpose((0, 2, 1)).conj()
+        D_sii[0] += 0.5 * np.eye(ni)
+    Q_aL = AtomArraysLayout([setup.Delta_pL.shape[1]
+                             for setup in setups]).empty()
+    Q_aL.data[:] = rng.random(Q_aL.data.shape) - 0.5
+    density = SimpleNamespace(D_asii=D_asii, ncomponents=ncomponents)
+
+    # Atoms distributed over world like over a kpt/band communicator:
+    dH_asii, energies = calculate_non_local_potential(
+        setups, density, xc, ext_pot, Q_aL, soc, world)
+
+    ref_energies = dict.fromkeys(energies, 0.0)
+    for a, D_sii in D_asii.items():
+        dH_sii, corrections = non_local_potential_per_atom(
+            setups[a], xc, ext_pot, D_sii, Q_aL[a], soc)
+        assert dH_asii[a] == pytest.approx(dH_sii, abs=1e-12)
+        for key, e in corrections.items():
+            ref_energies[key] += e
+    for key, e in ref_energies.items():
+        assert energies[key] == pytest.approx(e, abs=1e-10), key
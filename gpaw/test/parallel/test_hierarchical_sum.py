@@ -0,0 +1,57 @@
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.mpi import world
+
+
+@pytest.mark.ci
+@pytest.mark.parametrize('dtype', [float, complex, int])
+@pytest.mark.parametrize('n', [0, 1, 1001, 100003])
+def test_hierarchical_sum(dtype, n):
+    rng = np.random.default_rng(world.rank)
+    a = (rng.random(n) * 100).astype(dtype)
+    if dtype == complex:
+        a += 1j * rng.random(n)
+    b = a.copy()
+    world.sum(a)
+    world.sum(b, hierarchical=True)
+    assert b == pytest.approx(a, abs=1e-12)
+
+
+@pytest.mark.parametrize('n', [1001, 100003])
+def test_hierarchical_sum_fake_nodes(n):
+    """Several "nodes" so that the node leaders have to communicate."""
+    # A new communicator, so that the node split is done again:
+    comm = world.new_communicator(np.arange(world.size))
+    comm.setup_hierarchical(fake_nodes=2)
+    rng = np.random.default_rng(comm.rank)
+    for _ in range(3):
+        a = rng.random(n)
+        b = a.copy()
+        comm.sum(a)
+        comm.sum(b, hierarchical=True)
+        assert b == pytest.approx(a, abs=1e-12)
+
+
+@pytest.mark.slow
+def test_hierarchical_sum_timing():
+    """Flat vs. node-aware sums.
+
+    Run with e.g. "mpiexec -n 8 python -m pytest -m slow -s ..." to see
+    timings.
+    """
+    for nbytes in [2**10, 2**14, 2**18, 2**22, 2**25]:
+        a = np.ones(nbytes // 8)
+        times = []
+        for hierarchical in [False, True]:
+            world.sum(a, hierarchical=hierarchical)
+            world.barrier()
+            t0 = time()
+            for _ in range(5):
+                world.sum(a, hierarchical=hierarchical)
+            times.append((time() - t0) / 5)
+        if world.rank == 0:
+            print(f'{nbytes:9d} bytes: flat {times[0] * 1e3:8.3f} ms, '
+                  f'hierarchical {times[1] * 1e3:8.3f} ms')
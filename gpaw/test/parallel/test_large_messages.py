@@ -0,0 +1,37 @@
+import os
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.mpi import world
+
+
+def available_memory():
+    return os.sysconf('SC_PAGE_SIZE') * os.sysconf('SC_AVPHYS_PAGES')
+
+
+@pytest.mark.slow
+@pytest.mark.parametrize('nbytes', [2**31 + 12345, 3 * 2**30 + 5])
+@pytest.mark.parametrize('block', [True, False])
+def test_large_broadcast(nbytes, block):
+    """Broadcast more than 2 GiB (chunked or with a derived datatype)."""
+    big_enough = available_memory() > 1.2 * nbytes * world.size
+    if not world.sum_scalar(int(big_enough)) == world.size:
+        pytest.skip('Not enough memory')
+    root = world.size - 1
+    a = np.zeros(nbytes, np.uint8)
+    if world.rank == root:
+        a[::1000003] = 3
+        a[-1] = 5
+    t0 = time()
+    request = world.broadcast(a, root, block=block)
+    if not block:
+        world.wait(request)
+    t = time() - t0
+    assert (a[::1000003] == 3).all()
+    assert a[-1] == 5
+    ntail = (nbytes - 1) % 1000003 > 0
+    assert np.count_nonzero(a) == len(a[::1000003]) + ntail
+    if world.rank == 0:
+        print(f'{nbytes / 2**30:.2f} GiB to {world.size} ranks: {t:.2f} s')
@@ -0,0 +1,74 @@
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.mpi import world
+
+
+@pytest.mark.ci
+def test_nonblocking_collectives():
+    rng = np.random.default_rng(world.rank)
+    a = rng.random((5, 7)) + 1j * rng.random((5, 7))
+    b = a.copy()
+    world.sum(a)
+    request = world.sum(b, block=False)
+    world.wait(request)
+    assert (a == b).all()
+
+    a = np.arange(6.0) * (world.rank == 1 % world.size)
+    world.wait(world.broadcast(a, 1 % world.size, block=False))
+    assert (a == np.arange(6.0)).all()
+
+    a = np.full(3, world.rank)
+    b = np.empty((world.size, 3), int)
+    world.wait(world.all_gather(a, b, block=False))
+    assert (b == np.arange(world.size)[:, np.newaxis]).all()
+
+    # Send rank + 1 numbers to every rank:
+    n = world.rank + 1
+    scounts = np.full(world.size, n)
+    sdispls = np.arange(world.size) * n
+    rcounts = np.arange(world.size) + 1
+    rdispls = np.cumsum(rcounts) - rcounts
+    sbuffer = np.full(n * world.size, float(world.rank))
+    rbuffer = np.empty(rcounts.sum())
+    requests = [world.alltoallv(sbuffer, scounts, sdispls,
+                                rbuffer, rcounts, rdispls, block=False)]
+    world.waitall(requests)
+    assert (rbuffer == np.repeat(np.arange(world.size), rcounts)).all()
+
+
+def test_overlapped_subspace_diagonalization():
+    """Blocking vs. overlapped sums of H and S in a subspace rotation.
+
+    Run with e.g. "mpiexec -n 4 python -m pytest -s ..." to see timings.
+    """
+    nbands = 300
+    nG = 20000 // world.size
+    rng = np.random.default_rng(world.rank + 17)
+    psit_nG = rng.random((nbands, nG)) - 0.5
+    Hpsit_nG = psit_nG * np.linspace(0, 1, nG) + 0.1 * psit_nG[::-1]
+
+    def step(block):
+        H_nn = psit_nG @ Hpsit_nG.T
+        request = world.sum(H_nn, block=block)
+        S_nn = psit_nG @ psit_nG.T  # overlaps with the sum of H
+        world.sum(S_nn)
+        if not block:
+            world.wait(request)
+        L_nn = np.linalg.cholesky(S_nn)
+        iL_nn = np.linalg.inv(L_nn)
+        eig_n, U_nn = np.linalg.eigh(iL_nn @ H_nn @ iL_nn.T)
+        return eig_n
+
+    step(True)
+    t0 = time()
+    eig1_n = step(True)
+    t1 = time()
+    eig2_n = step(False)
+    t2 = time()
+    assert eig2_n == pytest.approx(eig1_n, abs=1e-10)
+    if world.rank == 0:
+        print(f'{world.size} ranks: blocking {t1 - t0:.4f} s, '
+              f'overlapped {t2 - t1:.4f} s')
@@ -0,0 +1,44 @@
+import numpy as np
+import pytest
+
+from gpaw.mpi import free_shared, share_on_node, world
+
+
+def test_allocate_shared():
+    node_comm = world.split_shared()
+    members = node_comm.get_members()
+    assert members[node_comm.rank] == world.rank
+    assert len(members) == node_comm.size
+
+    a = node_comm.allocate_shared(8 * 5).view(float)
+    if node_comm.rank == 0:
+        a[:] = np.arange(5)
+    node_comm.barrier()
+    assert (a == np.arange(5)).all()  # written by another rank
+    node_comm.barrier()
+
+
+def test_share_on_node():
+    calls = []
+
+    def create():
+        calls.append(1)
+        return np.arange(12.0).reshape((3, 4))
+
+    a = share_on_node(create, world)
+    assert a.shape == (3, 4)
+    assert (a == np.arange(12.0).reshape((3, 4))).all()
+    assert not a.flags.writeable
+    # create() only called once per node:
+    assert world.sum_scalar(len(calls)) == world.sum_scalar(
+        int(world.split_shared().rank == 0))
+    with pytest.raises(ValueError):
+        a[0, 0] = 1.0
+
+
+def test_free_shared():
+    a = share_on_node(lambda: np.ones(7), world)
+    assert a.sum() == 7
+    free_shared(a)
+    free_shared(a)  # no-op the second time
+    free_shared(np.ones(3))  # not shared
@@ -0,0 +1,39 @@
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.new.c import pw_precond
+
+
+def test_pw_precond_block():
+    rng = np.random.default_rng(5)
+    nbands = 64
+    nG = 20000
+    G2_G = rng.random(nG) * 30
+    r_nG = rng.random((nbands, nG)) + 1j * rng.random((nbands, nG))
+    ekin_n = rng.random(nbands) + 0.5
+
+    a_nG = np.empty_like(r_nG)
+    t0 = time()
+    for r_G, a_G, ekin in zip(r_nG, a_nG, ekin_n):
+        pw_precond(G2_G, r_G, ekin, a_G)
+    t1 = time()
+    b_nG = np.empty_like(r_nG)
+    pw_precond(G2_G, r_nG[:1], ekin_n[:1], b_nG[:1])  # start threads
+    t2 = time()
+    pw_precond(G2_G, r_nG, ekin_n, b_nG)
+    t3 = time()
+    assert (a_nG == b_nG).all()
+
+    x_nG = G2_G / ekin_n[:, np.newaxis] / 3
+    y_nG = 27.0 + x_nG * (18.0 + x_nG * (12.0 + x_nG * 8.0))
+    c_nG = (-4.0 / 3 / ekin_n[:, np.newaxis] * y_nG /
+            (y_nG + 16.0 * x_nG**4) * r_nG)
+    assert b_nG == pytest.approx(c_nG, rel=1e-12)
+
+    with pytest.raises(ValueError):
+        pw_precond(G2_G, r_nG[:, ::2], ekin_n, b_nG[:, ::2])
+
+    print(f'{nbands} bands: band by band {t1 - t0:.4f} s, '
+          f'block {t3 - t2:.4f} s')
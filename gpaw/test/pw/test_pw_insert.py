@@ -0,0 +1,67 @@
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.core import PWDesc, UGDesc
+from gpaw.new.c import pw_insert
+
+
+def paste_and_complete(coef_G, pw, tmp_Q):
+    """Old Python version: zero-fill, paste and fix the Q_z=0 plane."""
+    pw.paste(coef_G, tmp_Q)
+    t = tmp_Q[:, :, 0]
+    n, m = ((s - 1) // 2 for s in tmp_Q.shape[:2])
+    t[0, -m:] = t[0, m:0:-1].conj()
+    t[n:0:-1, -m:] = t[-n:, m:0:-1].conj()
+    t[-n:, -m:] = t[n:0:-1, m:0:-1].conj()
+    t[-n:, 0] = t[n:0:-1, 0].conj()
+
+
+@pytest.mark.parametrize('size, ecut',
+                         [((20, 24, 27), 40),
+                          ((45, 45, 45), 40),
+                          ((7, 7, 10), 20)])  # sphere reaches (N - 1) / 2
+def test_pw_insert_hermitian(size, ecut):
+    grid = UGDesc(cell=[3.1, 3.7, 4.3], size=size, dtype=float)
+    pw = PWDesc(ecut=ecut, cell=grid.cell, dtype=float)
+    shape = (size[0], size[1], size[2] // 2 + 1)
+    Q_G = pw.indices(shape)
+    rng = np.random.default_rng(7)
+    nbands = 5
+    coef_bG = rng.random((nbands, len(Q_G))) + 1j * rng.random(
+        (nbands, len(Q_G)))
+    coef_bG[:, 0] = coef_bG[:, 0].real
+
+    ref_bQ = np.empty((nbands,) + shape, complex)
+    tmp_bQ = np.empty_like(ref_bQ)
+    tmp_bQ[:] = np.nan
+    pw_insert(coef_bG, Q_G, 1.0, tmp_bQ, True)
+
+    t0 = time()
+    for coef_G, ref_Q in zip(coef_bG, ref_bQ):
+        paste_and_complete(coef_G, pw, ref_Q)
+    t1 = time()
+    pw_insert(coef_bG, Q_G, 1.0, tmp_bQ, True)
+    t2 = time()
+    assert (tmp_bQ == ref_bQ).all()
+
+    # Single band and the real grid it gives:
+    tmp_Q = np.empty(shape, complex)
+    pw_insert(coef_bG[2], Q_G, 1.0, tmp_Q, True)
+    assert (tmp_Q == ref_bQ[2]).all()
+    a_R = np.fft.irfftn(tmp_Q, size, norm='forward')
+    b_R = np.fft.ifftn(np.fft.fftn(a_R)).real
+    assert a_R == pytest.approx(b_R, abs=1e-12)
+
+    # Compare with an explicit sum over G and -G:
+    full_Q = np.zeros(size, complex)
+    i_Gc = np.array(np.unravel_index(Q_G, shape)).T
+    for i_c, coef in zip(i_Gc, coef_bG[2]):
+        full_Q[tuple(i_c)] = coef
+        full_Q[tuple(-i_c)] = coef.conj()
+    c_R = np.fft.ifftn(full_Q, norm='forward')
+    assert a_R == pytest.approx(c_R.real, abs=1e-12)
+
+    print(f'{size}: paste + slices {t1 - t0:.5f} s, '
+          f'pw_insert(hermitian=True) {t2 - t1:.5f} s')
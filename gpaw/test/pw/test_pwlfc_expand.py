@@ -0,0 +1,121 @@
+import numpy as np
+import pytest
+
+from gpaw.core import PWDesc
+from gpaw.core.pwacf import PWAtomCenteredFunctions
+from gpaw.new.spinspiral import SpiralPWDesc
+from gpaw.spline import Spline
+
+
+def expand_python(lfc, cc):
+    """Equivalent slow Python code."""
+    f_GI = np.empty((len(lfc.Y_GL), lfc.nI), complex)
+    I1 = 0
+    for J, (a, s) in enumerate(zip(lfc.a_J, lfc.s_J)):
+        l = lfc.l_s[s]
+        I2 = I1 + 2 * l + 1
+        f_GI[:, I1:I2] = (lfc.f_Gs[:, s] *
+                          lfc.emiGR_Ga[:, a] *
+                          lfc.Y_GL[:, l**2:(l + 1)**2].T *
+                          (-1.0j)**l).T
+        I1 = I2
+    if cc:
+        f_GI = f_GI.conj()
+    if lfc.dtype == float:
+        f_GI = f_GI.T.copy().view(float).T.copy()
+    return f_GI
+
+
+@pytest.mark.parametrize('dtype', [complex, float])
+def test_pwlfc_expand(dtype):
+    rc = 2.5
+    r = np.linspace(0, rc, 100)
+    splines = [Spline.from_data(l, rc, np.exp(-(l + 1) * r**2))
+               for l in range(3)]
+    kpt = [0.25, -0.25, 0.0] if dtype == complex else None
+    pw = PWDesc(ecut=30, cell=[6.1, 6.3, 6.5], kpt=kpt, dtype=dtype)
+    rng = np.random.default_rng(4)
+    natoms = 12
+    fracpos_ac = rng.random((natoms, 3)) * 1.2 - 0.1
+    pt = PWAtomCenteredFunctions([splines] * natoms, fracpos_ac, pw)
+    pt._lazy_init()
+    lfc = pt._lfc
+
+    # Structure factors:
+    GkR_Ga = pw.G_plus_k_Gv @ lfc.pos_av.T
+    emiGR_Ga = np.exp(-1j * GkR_Ga) * lfc.eikR_a
+    assert lfc.emiGR_Ga == pytest.approx(emiGR_Ga, abs=1e-12)
+
+    for cc in [False, True]:
+        assert lfc.expand(cc=cc) == pytest.approx(expand_python(lfc, cc),
+                                                  abs=1e-14)
+    G1, G2 = 10, 100
+    f_GI = lfc.expand(G1, G2)
+    if dtype == float:
+        G1 *= 2
+        G2 *= 2
+    assert (f_GI == lfc.expand()[G1:G2]).all()
+
+
+def test_pwlfc_spin_spiral():
+    """Structure factors for the k + q/2 and k - q/2 spinor components."""
+    rc = 2.5
+    r = np.linspace(0, rc, 100)
+    splines = [Spline.from_data(l, rc, np.exp(-(l + 1) * r**2))
+               for l in range(3)]
+    pw = PWDesc(ecut=30, cell=[6.1, 6.3, 6.5], kpt=[0.25, 0.0, 0.0],
+                dtype=complex)
+    rng = np.random.default_rng(5)
+    natoms = 4
+    fracpos_ac = rng.random((natoms, 3))
+    for sign in [1, -1]:
+        spw = SpiralPWDesc(pw, 0.5 * sign * np.array([0.1, 0.2, 0.0]))
+        pt = PWAtomCenteredFunctions([splines] * natoms, fracpos_ac, spw)
+        pt._lazy_init()
+        lfc = pt._lfc
+        GkR_Ga = spw.G_plus_k_Gv @ lfc.pos_av.T
+        emiGR_Ga = np.exp(-1j * GkR_Ga) * lfc.eikR_a
+        assert lfc.emiGR_Ga == pytest.approx(emiGR_Ga, abs=1e-12)
+        assert lfc.expand() == pytest.approx(expand_python(lfc, False),
+                                             abs=1e-14)
+
+
+@pytest.mark.parametrize('dtype', [complex, float])
+def test_pwlfc_integrate_add(dtype):
+    """Fused kernels must agree with a GEMM against the full f_GI."""
+    rc = 2.5
+    r = np.linspace(0, rc, 100)
+    splines = [Spline.from_data(l, rc, np.exp(-(l + 1) * r**2))
+               for l in range(3)]
+    pw = PWDesc(ecut=40, cell=[6.1, 6.3, 6.5], dtype=dtype)
+    rng = np.random.default_rng(8)
+    natoms = 12
+    pt = PWAtomCenteredFunctions([splines] * natoms,
+                                 rng.random((natoms, 3)), pw)
+    pt._lazy_init()
+    lfc = pt._lfc
+    nbands = 7
+    psit_nG = pw.empty(nbands)
+    psit_nG.data[:] = rng.random(psit_nG.data.shape) - 0.5j
+    if dtype == float:
+        psit_nG.data[:, 0] = psit_nG.data[:, 0].real
+
+    f_GI = lfc.expand(cc=dtype == complex)
+    a_nG = psit_nG.data
+    if dtype == float:
+        f_GI[0] *= 0.5
+        a_nG = a_nG.view(float)
+    ref_nI = a_nG @ f_GI * (2 if dtype == float else 1)
+    P_ani = pt.integrate(psit_nG)
+    for a, I1, I2 in lfc.my_indices:
+        assert P_ani[a] == pytest.approx(lfc.eikR_a[a] * ref_nI[:, I1:I2],
+                                         abs=1e-11)
+
+    out_nG = psit_nG.copy()
+    pt.add_to(out_nG, P_ani)
+    c_nI = np.concatenate([P_ani[a] for a in range(natoms)], axis=1)
+    f_GI = lfc.expand()
+    ref_nG = a_nG + c_nI @ f_GI.T / pw.dv
+    if dtype == float:
+        ref_nG = ref_nG.view(complex)
+    assert out_nG.data == pytest.approx(ref_nG, abs=1e-11)
@@ -1,7 +1,10 @@
+from time import time
+
 import pytest
 import numpy as np
 from ase.units import Hartree as Ha
 from gpaw.cgpaw import evaluate_mpa_poly as mpa_C
+from gpaw.cgpaw import evaluate_mpa_poly_batch as mpa_batch_C
 
 
 def mpa_py(omega, f, omegat_nGG, W_nGG, eta, factor):
@@ -40,3 +43,34 @@ def test_residues(in_tmp_dir, f):
     mpa_C(x_GG_C, dx_GG_C, omega, f, omegat_nGG, W_nGG, eta, factor)
 
     assert np.allclose(x_GG_py, x_GG_C, atol=1e-6)
+
+
+@pytest.mark.parametrize('nG, npols', [(5, 10), (60, 8)])
+def test_batch(nG, npols):
+    factor = 2.0
+    eta = 0.1 * Ha
+    rng = np.random.default_rng(seed=2)
+    omegat_nGG = rng.random((npols, nG, nG)) * 0.05 + 5.5 - 0.01j
+    W_nGG = rng.random((npols, nG, nG)) + 0.3j
+    nw = 40
+    omega_w = np.linspace(-1.0, 1.0, nw)
+    f_w = rng.choice([0.0, 1.0, 0.3, 1 - 1e-12], nw)
+
+    t0 = time()
+    x_wGG = np.empty((nw, nG, nG), complex)
+    dx_wGG = np.empty((nw, nG, nG), complex)
+    for omega, f, x_GG, dx_GG in zip(omega_w, f_w, x_wGG, dx_wGG):
+        mpa_C(x_GG, dx_GG, omega, f, omegat_nGG, W_nGG, eta, factor)
+    t1 = time()
+    y_wGG = np.empty_like(x_wGG)
+    dy_wGG = np.empty_like(x_wGG)
+    mpa_batch_C(y_wGG, dy_wGG, omega_w, f_w, omegat_nGG, W_nGG, eta, factor)
+    t2 = time()
+    assert y_wGG == pytest.approx(x_wGG, rel=1e-12)
+    assert dy_wGG == pytest.approx(dx_wGG, rel=1e-12)
+    print(f'{nw} frequencies, {npols} poles, nG={nG}: '
+          f'one by one {t1 - t0:.4f} s, batched {t2 - t1:.4f} s')
+
+    with pytest.raises(TypeError):
+        mpa_batch_C(y_wGG, dy_wGG, omega_w, f_w + 1.0,
+                    omegat_nGG, W_nGG, eta, factor)
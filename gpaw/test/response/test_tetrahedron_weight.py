@@ -0,0 +1,53 @@
+from itertools import product
+from time import time
+
+import numpy as np
+import pytest
+
+from gpaw.response.integrators import KPointTesselation
+
+
+@pytest.mark.tetrahedron
+@pytest.mark.response
+def test_tetrahedron_weights():
+    x_g = np.linspace(-1, 1, 9)
+    kpts_kc = np.array(list(product(x_g, x_g, x_g)))
+    tesselation = KPointTesselation(kpts_kc)
+    nk = tesselation.nkpts
+    tesselation.pts_k, tesselation.simplex_volumes  # fill caches
+
+    rng = np.random.default_rng(42)
+    nbands = 300
+    k_k = np.linalg.norm(tesselation.bzk_kc, axis=1)
+    deps_Mk = (k_k**2 * rng.random((nbands, 1)) +
+               rng.random((nbands, 1)) - 0.5 + 0.01 * rng.random(nk))
+    deps_Mk[3] = 0.25  # flat band
+    omega_w = np.linspace(-1.0, 3.0, 4000)
+
+    for K in [0, nk // 2, nk - 1]:
+        neighbours_k = tesselation.neighbours_k[K]
+        e1_M = deps_Mk[:, neighbours_k].min(1)
+        e2_M = deps_Mk[:, neighbours_k].max(1)
+        i0_M = np.searchsorted(omega_w, e1_M)
+        i1_M = np.searchsorted(omega_w, e2_M, side='right')
+
+        t0 = time()
+        ref_Mw = [tesselation.tetrahedron_weight(K, deps_k, omega_w[i0:i1])
+                  for deps_k, i0, i1 in zip(deps_Mk, i0_M, i1_M)]
+        t1 = time()
+        W_Mw = tesselation.tetrahedron_weights(K, deps_Mk, omega_w,
+                                               i0_M, i1_M)
+        t2 = time()
+        for W_w, ref_w, i0, i1 in zip(W_Mw, ref_Mw, i0_M, i1_M):
+            assert W_w[:i1 - i0] == pytest.approx(ref_w, rel=1e-10, abs=1e-14)
+        print(f'K={K}: band by band {t1 - t0:.4f} s, '
+              f'batched {t2 - t1:.4f} s')
+
+    # Frequencies do not have to be sorted:
+    i0_M = np.zeros(nbands, int)
+    i1_M = np.full(nbands, len(omega_w))
+    W_Mw = tesselation.tetrahedron_weights(0, deps_Mk, omega_w[::-1].copy(),
+                                           i0_M, i1_M)
+    ref_Mw = tesselation.tetrahedron_weights(0, deps_Mk, omega_w,
+                                             i0_M, i1_M)
+    assert W_Mw[:, ::-1] == pytest.approx(ref_Mw, rel=1e-10, abs=1e-14)
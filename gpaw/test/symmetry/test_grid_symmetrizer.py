@@ -0,0 +1,40 @@
+from itertools import permutations, product
+
+import numpy as np
+import pytest
+
+from gpaw.cgpaw import symmetrize_ft
+from gpaw.symmetry import GridSymmetrizer
+
+
+def cubic_operations():
+    op_scc = []
+    for p in permutations(range(3)):
+        for signs in product([1, -1], repeat=3):
+            op_cc = np.zeros((3, 3), int)
+            op_cc[range(3), p] = signs
+            op_scc.append(op_cc)
+    return np.array(op_scc)
+
+
+@pytest.mark.parametrize('N_c, offset_c, translate',
+                         [((6, 6, 6), (0, 0, 0), False),
+                          ((6, 6, 6), (0, 0, 0), True),
+                          ((8, 8, 8), (1, 1, 1), False)])
+def test_grid_symmetrizer(N_c, offset_c, translate, rng):
+    op_scc = cubic_operations()
+    N_c = np.array(N_c)
+    offset_c = np.array(offset_c)
+    if translate:
+        t_sc = rng.integers(-7, 7, (len(op_scc), 3))
+    else:
+        t_sc = np.zeros((len(op_scc), 3), int)
+
+    a_g = rng.random(N_c - offset_c)
+    b0_g = np.zeros_like(a_g)
+    for op_cc, t_c in zip(op_scc, t_sc):
+        symmetrize_ft(a_g, b0_g, op_cc, t_c, offset_c)
+
+    b_g = np.ones_like(a_g)
+    GridSymmetrizer(op_scc, t_sc, N_c, offset_c)(a_g, b_g)
+    assert abs(b_g - 1 - b0_g).max() < 1e-12
@@ -0,0 +1,73 @@
+import time
+
+import numpy as np
+import pytest
+from ase.dft.kpoints import monkhorst_pack
+
+import gpaw.cgpaw as cgpaw
+from gpaw.symmetry import (Symmetry, k_point_lattice, map_k_points,
+                           map_k_points_fast)
+
+
+def brute_force(bzk_kc, U_scc, tol):
+    bz2bz_ks = -np.ones((len(bzk_kc), len(U_scc)), int)
+    cgpaw.map_k_points(bzk_kc, U_scc, tol, bz2bz_ks, 0, len(bzk_kc))
+    return bz2bz_ks
+
+
+def cubic_symmetry():
+    sym = Symmetry(np.zeros(1, int), np.eye(3))
+    sym.find_lattice_symmetry()
+    return sym.op_scc
+
+
+def test_off_lattice_points(rng):
+    U_scc = cubic_symmetry()
+    bzk_kc = monkhorst_pack((4, 4, 4))
+    # Add some off-lattice points and a duplicate:
+    bzk_kc = np.concatenate([bzk_kc,
+                             rng.random((5, 3)) - 0.5,
+                             bzk_kc[7:8] + 1])
+    bz2bz_ks = map_k_points(bzk_kc, U_scc, True, tol=1e-7)
+    U2_scc = np.concatenate([U_scc, -U_scc])
+    assert (bz2bz_ks == brute_force(bzk_kc, U2_scc, 1e-7)).all()
+
+
+def test_irregular_points(rng):
+    # Random points would need a huge lookup table:
+    U_scc = cubic_symmetry()
+    bzk_kc = rng.random((100, 3)) - 0.5
+    bzk_kc = np.concatenate([bzk_kc, -bzk_kc[:10]])
+    size_c, _ = k_point_lattice(bzk_kc)
+    assert size_c.prod() > 8 * len(bzk_kc)
+    bz2bz_ks = map_k_points(bzk_kc, U_scc, True, tol=1e-7)
+    U2_scc = np.concatenate([U_scc, -U_scc])
+    assert (bz2bz_ks == brute_force(bzk_kc, U2_scc, 1e-7)).all()
+
+
+@pytest.mark.parametrize('gamma', [False, True])
+def test_kpoint_mapping(gamma):
+    U_scc = cubic_symmetry()
+    for n in [4, 8, 12, 16]:
+        bzk_kc = monkhorst_pack((n, n, n))
+        if gamma:
+            bzk_kc += 0.5 / n
+        bz2bz_ks = map_k_points(bzk_kc, U_scc, True, tol=1e-7)
+        bz2bzfast_ks = map_k_points_fast(bzk_kc, U_scc, True, tol=1e-7)
+        assert (bz2bz_ks == bz2bzfast_ks).all()
+        assert (bz2bz_ks >= 0).all()
+
+
+@pytest.mark.slow
+def test_kpoint_mapping_timing():
+    U_scc = cubic_symmetry()
+    for n in [4, 8, 12, 16, 24]:
+        bzk_kc = monkhorst_pack((n, n, n))
+        t1 = time.perf_counter()
+        bz2bz_ks = map_k_points(bzk_kc, U_scc, True, tol=1e-7)
+        t2 = time.perf_counter()
+        bz2bzfast_ks = map_k_points_fast(bzk_kc, U_scc, True, tol=1e-7)
+        t3 = time.perf_counter()
+        print(f'{n:3} {len(bzk_kc):6} lattice: {t2 - t1:.4f} s '
+              f'lexsort: {t3 - t2:.4f} s')
+        assert (bz2bz_ks == bz2bzfast_ks).all()
@@ -1,7 +1,10 @@
-from gpaw.cgpaw import GG_shuffle
-import numpy as np
 import time
 
+import numpy as np
+import pytest
+
+from gpaw.cgpaw import GG_shuffle, GG_shuffle_batch
+
 
 def test_GG_shuffle(rng):
     N = 1000
@@ -26,3 +29,36 @@ def test_GG_shuffle(rng):
     GG_shuffle(G_G, -1, A_GG, B_GG)
     B2_GG = A_GG.copy()[:, G_G][G_G].T
     assert np.allclose(B_GG, B2_GG)
+
+
+def test_GG_shuffle_batch(rng):
+    N = 700
+    nsym = 6
+    G_sG = np.array([rng.permutation(N) for s in range(nsym)],
+                    dtype=np.int32)
+    sign_s = np.array([1, -1, 1, -1, -1, 1], dtype=np.int32)
+    A_GG = rng.random((N, 2 * N)) + 1j * rng.random((N, 2 * N))
+    A_GG = A_GG[:, ::2]  # strided columns
+
+    B2_GG = np.zeros((N, N), dtype=np.complex128)
+    for G_G, sign in zip(G_sG, sign_s):
+        if sign == 1:
+            B2_GG += A_GG[G_G][:, G_G]
+        else:
+            B2_GG += A_GG[G_G][:, G_G].T
+
+    start = time.perf_counter()
+    B1_GG = np.zeros((N, N), dtype=np.complex128)
+    for G_G, sign in zip(G_sG, sign_s):
+        GG_shuffle(G_G, int(sign), A_GG, B1_GG)
+    single = time.perf_counter() - start
+
+    start = time.perf_counter()
+    B_GG = np.zeros((N, N), dtype=np.complex128)
+    GG_shuffle_batch(G_sG, sign_s, A_GG, B_GG)
+    batch = time.perf_counter() - start
+
+    print(f'{nsym} symmetries: one by one {single:.4f} s, '
+          f'batched {batch:.4f} s')
+    assert (B1_GG == B2_GG).all()
+    assert B_GG == pytest.approx(B2_GG, abs=1e-12)
@@ -0,0 +1,39 @@
+import numpy as np
+
+from gpaw.cgpaw import (symmetrize_return_index, symmetrize_wavefunction,
+                        symmetrize_with_index)
+
+
+def reference(a_xg, C_cc, kpt0_c, kpt1_c):
+    N_c = np.array(a_xg.shape[-3:])
+    g_gc = np.indices(N_c).reshape((3, -1)).T
+    p_gc = (g_gc @ C_cc) % N_c
+    phase_g = np.exp(2j * np.pi * (p_gc @ (kpt1_c / N_c) -
+                                   g_gc @ (kpt0_c / N_c)))
+    p_g = np.ravel_multi_index(p_gc.T, N_c)
+    b_xg = np.zeros_like(a_xg).reshape((-1, N_c.prod()))
+    b_xg[:, p_g] = a_xg.reshape((-1, N_c.prod())) * phase_g
+    return b_xg.reshape(a_xg.shape)
+
+
+def test_symmetrize_wavefunction(rng):
+    N_c = (6, 4, 6)
+    C_cc = np.array([[0, 0, 1],
+                     [0, -1, 0],
+                     [1, 0, 0]])
+    kpt0_c = np.array([0.25, 0.5, -0.125])
+    kpt1_c = kpt0_c @ C_cc
+    a_xg = rng.random((2, 3) + N_c) + 1j * rng.random((2, 3) + N_c)
+
+    b0_xg = reference(a_xg, C_cc, kpt0_c, kpt1_c)
+
+    b_xg = np.zeros_like(a_xg)
+    symmetrize_wavefunction(a_xg, b_xg, C_cc, kpt0_c, kpt1_c)
+    assert abs(b_xg - b0_xg).max() < 1e-12
+
+    index_g = np.zeros(N_c, int)
+    phase_g = np.zeros(N_c, complex)
+    symmetrize_return_index(index_g, phase_g, C_cc, kpt0_c, kpt1_c)
+    b_g = np.zeros_like(a_xg[0, 0])
+    symmetrize_with_index(a_xg[0, 0], b_g, index_g, phase_g)
+    assert abs(b_g - b0_xg[0, 0]).max() < 1e-12
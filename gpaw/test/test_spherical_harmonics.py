@@ -1,8 +1,10 @@
 from math import pi
+from time import time
 
 import numpy as np
 import pytest
-from gpaw.spherical_harmonics import (YL, Y, Yl, gam, print_YL_table_code,
+from gpaw.spherical_harmonics import (YL, Y, Yl, gam, nablarlYL,
+                                      print_YL_table_code, solid_harmonics,
                                       write_c_code)
 
 
@@ -26,12 +28,14 @@ def test_yy():
 
 def test_y_c_code():
     R = np.zeros(3)
-    Y = np.zeros(1)
-    Yl(0, R, Y)
-    assert Y[0] == pytest.approx((4 * pi)**-0.5)
-    Y = np.zeros(2 * 8 + 1)
-    with pytest.raises(RuntimeError):
-        Yl(8, R, Y)
+    Y_m = np.zeros(1)
+    Yl(0, R, Y_m)
+    assert Y_m[0] == pytest.approx((4 * pi)**-0.5)
+    R = np.array([0.1, -0.2, 0.3])
+    Y_m = np.zeros(2 * 8 + 1)
+    Yl(8, R, Y_m)
+    assert Y_m == pytest.approx([Y(L, *R) for L in range(64, 81)],
+                                abs=1e-14)
 
 
 def test_y_c_code2():
@@ -55,6 +59,41 @@ def test_y_c_code2():
         assert np.allclose(rlY2_m, rlY1_m)
 
 
+def test_solid_harmonics():
+    lmax = 8
+    nL = (lmax + 1)**2
+    R_vx = np.random.default_rng(7).random((3, 5, 67)) - 0.5
+    t0 = time()
+    Y_Lx, dYdR_vLx = solid_harmonics(lmax, R_vx, derivatives=True)
+    t1 = time()
+    ref_Lx = np.array([Y(L, *R_vx) for L in range(nL)])
+    t2 = time()
+    assert Y_Lx == pytest.approx(ref_Lx, abs=1e-13)
+    ref_Lvx = np.array([nablarlYL(L, R_vx) for L in range(nL)])
+    assert dYdR_vLx == pytest.approx(ref_Lvx.transpose((1, 0, 2, 3)),
+                                     abs=1e-12)
+    print(f'Python: {t2 - t1:.4f} s, C (with gradients): {t1 - t0:.4f} s')
+
+    # Beyond the YL table: check the addition theorem
+    # sum_m Y_lm(u)^2 = (2l+1)/(4pi) for unit vectors and the gradients
+    # with finite differences:
+    lmax = 14
+    R_vx /= (R_vx**2).sum(0)**0.5
+    Y_Lx, dYdR_vLx = solid_harmonics(lmax, R_vx, derivatives=True)
+    for l in range(lmax + 1):
+        assert (Y_Lx[l**2:(l + 1)**2]**2).sum(0) == pytest.approx(
+            (2 * l + 1) / (4 * pi), abs=1e-11)
+    eps = 1e-6
+    for v in range(3):
+        R_vx[v] += eps
+        Yp_Lx = solid_harmonics(lmax, R_vx)
+        R_vx[v] -= 2 * eps
+        Ym_Lx = solid_harmonics(lmax, R_vx)
+        R_vx[v] += eps
+        assert dYdR_vLx[v] == pytest.approx((Yp_Lx - Ym_Lx) / (2 * eps),
+                                            abs=1e-6)
+
+
 def test_write_c_code(capsys):
     write_c_code(1)
     s = capsys.readouterr().out
@@ -1,7 +1,11 @@
+import numpy as np
+import pytest
 from ase import Atom, Atoms
 
+import gpaw.cgpaw as cgpaw
 from gpaw import GPAW
 from gpaw.analyse.eed import ExteriorElectronDensity
+from gpaw.grid_descriptor import GridDescriptor
 
 
 def test_utilities_eed(in_tmp_dir):
@@ -17,3 +21,25 @@ def test_utilities_eed(in_tmp_dir):
 
     eed = ExteriorElectronDensity(c.wfs.gd, s)
     eed.write_mies_weights(c.wfs)
+    assert ((eed.get_signed_distance(1.0) >= 0) == eed.mask).all()
+
+
+def test_eed_region():
+    gd = GridDescriptor((40, 36, 44), (10.0, 9.0, 11.0))
+    rng = np.random.default_rng(8)
+    natoms = 60
+    atom_c = rng.random((natoms, 3)) * gd.cell_cv.diagonal() * 1.2 - 0.5
+    radius_a = rng.random(natoms) + 1.5
+    args = (atom_c, gd.beg_c, gd.end_c, gd.h_cv.diagonal().copy(), radius_a)
+
+    mask_G = gd.empty(dtype=int)
+    cgpaw.eed_region(mask_G, *args)
+    dmax = 1.3
+    d_G = gd.empty()
+    cgpaw.eed_region(d_G, *args, dmax)
+
+    r_Gv = gd.get_grid_point_coordinates().transpose((1, 2, 3, 0))
+    d_Ga = (((r_Gv[..., np.newaxis, :] - atom_c)**2).sum(-1)**0.5 -
+            radius_a)
+    assert (mask_G == (d_Ga >= 0).all(-1)).all()
+    assert d_G == pytest.approx(np.minimum(d_Ga.min(-1), dmax), abs=1e-12)
@@ -0,0 +1,50 @@
+import numpy as np
+import pytest
+
+from gpaw.utilities import (pack_density, pack_hermitian, pack_many,
+                            packed_dot, unpack_many)
+
+
+def random_matrices(rng, ni_a, ns, dtype):
+    A_asii = []
+    for ni in ni_a:
+        A_sii = rng.random((ns, ni, ni)) - 0.5
+        if dtype == complex:
+            A_sii = A_sii + 1j * (rng.random((ns, ni, ni)) - 0.5)
+        A_asii.append(A_sii + A_sii.transpose(0, 2, 1).conj())
+    A_sM = np.concatenate([A_sii.reshape((ns, -1)) for A_sii in A_asii],
+                          axis=1)
+    return A_asii, A_sM
+
+
+@pytest.mark.ci
+@pytest.mark.parametrize('dtype', [float, complex])
+def test_pack_many(dtype):
+    rng = np.random.default_rng(42)
+    ni_a = [5, 1, 13, 0, 8]
+    ns = 3
+    A_asii, A_sM = random_matrices(rng, ni_a, ns, dtype)
+    B_asii, B_sM = random_matrices(rng, ni_a, ns, dtype)
+
+    for density, pack in [(True, pack_density), (False, pack_hermitian)]:
+        A_sP = pack_many(A_sM, ni_a, density=density)
+        ref_sP = np.concatenate(
+            [[pack(A_ii) for A_ii in A_sii] for A_sii in A_asii], axis=1)
+        assert A_sP == pytest.approx(ref_sP, abs=1e-14)
+        A2_sP = A_sP.copy()
+        pack_many(A_sM, ni_a, A2_sP, density=density, add=True)
+        assert A2_sP == pytest.approx(2 * A_sP, abs=1e-14)
+        if density and dtype == complex:
+            # pack_density() can't be undone for complex matrices
+            continue
+        assert unpack_many(A_sP, ni_a, density=density) == pytest.approx(
+            A_sM, abs=1e-14)
+
+    B_sP = pack_many(B_sM, ni_a)
+    ref_a = [(A_sii * B_sii).sum().real
+             for A_sii, B_sii in zip(A_asii, B_asii)]
+    assert packed_dot(pack_many(A_sM, ni_a), B_sP, ni_a) == pytest.approx(
+        ref_a, abs=1e-12)
+    if dtype == float:
+        assert packed_dot(pack_many(A_sM, ni_a, density=True), B_sP, ni_a,
+                          density=True) == pytest.approx(ref_a, abs=1e-12)
@@ -0,0 +1,59 @@
+import numpy as np
+import pytest
+from gpaw.cgpaw import vdw, vdw_cells
+
+
+def kernel_table(ndelta=20, nD=60, ddelta=0.05, dD=0.5):
+    """Asymptotic kernel, smoothed at small D."""
+    delta_i = np.arange(ndelta) * ddelta
+    D_j = np.arange(nD) * dD + 1.0
+    d1_ij = D_j * (1 + delta_i[:, None])
+    d2_ij = D_j * (1 - delta_i[:, None])
+    C = -1024 / 243 * np.pi**4
+    return C / (d1_ij**2 * d2_ij**2 * (d1_ij**2 + d2_ij**2) + 1.0)
+
+
+def points(pbc):
+    rng = np.random.default_rng(42)
+    L = 12.0
+    R_ic = np.array([(x, y, z)
+                     for x in np.arange(0, L, 1.0)
+                     for y in np.arange(0, L, 1.0)
+                     for z in np.arange(0, L, 1.0)])
+    r2_i = ((R_ic - L / 2)**2).sum(1)
+    n_i = np.exp(-r2_i / 8) + 0.01 * rng.random(len(R_ic))
+    q0_i = 1.0 + 0.5 * n_i
+    cell_c = np.array([L, L, L])
+    return n_i, q0_i, R_ic, cell_c, np.array([pbc] * 3)
+
+
+@pytest.mark.parametrize('pbc, repeat',
+                         [(False, 0), (True, 0), (True, 1)])
+def test_vdw_cells(pbc, repeat):
+    n_i, q0_i, R_ic, cell_c, pbc_c = points(pbc)
+    phi_ij = kernel_table()
+    repeat_c = np.array([repeat] * 3)
+    args = (n_i, q0_i, R_ic, cell_c, pbc_c, repeat_c, phi_ij, 0.05, 0.5)
+    ni = len(n_i)
+
+    hist = [np.zeros(100), 0.093, np.zeros(100), 0.093]
+    E0 = vdw(*args, 0, ni, *hist)
+
+    # Cutoff larger than the cell gives the exact result:
+    hist1 = [np.zeros(100), 0.093, np.zeros(100), 0.093]
+    E1, Efar = vdw_cells(*args, 0, ni, *hist1, 100.0)
+    assert Efar == 0.0
+    assert E1 == pytest.approx(E0, rel=1e-10)
+    assert hist1[0] == pytest.approx(hist[0], rel=1e-10, abs=1e-10)
+    assert hist1[2] == pytest.approx(hist[2], rel=1e-10, abs=1e-10)
+
+    # Splitting the points must not change anything:
+    Es = [sum(vdw_cells(*args, iA, iB,
+                        np.zeros(100), 0.093, np.zeros(100), 0.093, 3.0))
+          for iA, iB in [(0, ni // 3), (ni // 3, ni)]]
+    E2 = sum(vdw_cells(*args, 0, ni,
+                       np.zeros(100), 0.093, np.zeros(100), 0.093, 3.0))
+    assert sum(Es) == pytest.approx(E2, rel=1e-12)
+
+    # Far-field approximation:
+    assert E2 == pytest.approx(E0, rel=2e-3)
@@ -0,0 +1,33 @@
+import numpy as np
+from gpaw.cgpaw import vdw2, vdw2_batch
+
+
+def test_vdw2_batch():
+    rng = np.random.default_rng(7)
+    na = 5
+    alphas = [1, 3, 4]
+    nj = 30
+    phi_aajp = {(a, b): rng.random((nj, 4))
+                for a in range(na) for b in range(na)}
+    shape = (6, 5, 4)
+    j_k = rng.integers(0, nj, shape)
+    dj_k = rng.random(shape)
+    theta_ak = {b: rng.random(shape) + 1j * rng.random(shape)
+                for b in alphas}
+
+    F0_ak = np.zeros((na,) + shape, complex)
+    for a in range(na):
+        for b in alphas:
+            vdw2(phi_aajp[a, b], j_k, dj_k, theta_ak[b], F0_ak[a])
+
+    phi_jabp = np.array([[phi_aajp[a, b] for b in alphas]
+                         for a in range(na)]).transpose((2, 0, 1, 3)).copy()
+    theta_bk = np.array([theta_ak[b] for b in alphas])
+    F_ak = np.ones((na,) + shape, complex)
+    vdw2_batch(phi_jabp, j_k, dj_k, theta_bk, F_ak)
+    assert abs(F_ak - 1 - F0_ak).max() < 1e-12
+
+    # Only rows a0, a0 + 1, ...:
+    F_ak = np.zeros((2,) + shape, complex)
+    vdw2_batch(phi_jabp, j_k, dj_k, theta_bk, F_ak, 2)
+    assert abs(F_ak - F0_ak[2:4]).max() < 1e-12
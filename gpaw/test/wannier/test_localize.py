@@ -0,0 +1,37 @@
+import numpy as np
+import pytest
+
+import gpaw.cgpaw as cgpaw
+
+
+@pytest.mark.parametrize('n', [1, 2, 7, 8, 120])
+def test_localize_parallel(n):
+    """Round-robin sweeps should localize as well as the serial ones."""
+    rng = np.random.default_rng(n)
+    Q_nn = np.linalg.qr(rng.random((n, n)) - 0.5)[0]
+    Z0_nnc = np.empty((n, n, 3), complex)
+    for c in range(3):
+        phase_n = np.exp(2j * np.pi * rng.random(n))
+        Z0_nnc[:, :, c] = Q_nn @ np.diag(0.9 * phase_n) @ Q_nn.T
+        Z0_nnc[:, :, c] += 0.05 * np.exp(2j * np.pi * rng.random((n, n)))
+        Z0_nnc[:, :, c] += Z0_nnc[:, :, c].T
+
+    values = []
+    for localize in [cgpaw.localize, cgpaw.localize_parallel]:
+        Z_nnc = Z0_nnc.copy()
+        U_nn = np.identity(n)
+        old = 0.0
+        for iter in range(200):
+            value = localize(Z_nnc, U_nn)
+            if value - old < 1e-10:
+                break
+            old = value
+        values.append(value)
+
+        assert U_nn.T @ U_nn == pytest.approx(np.identity(n), abs=1e-12)
+        Z_cnn = np.einsum('ia, ijc, jb -> cab', U_nn, Z0_nnc, U_nn)
+        assert Z_cnn.diagonal(0, 1, 2) == pytest.approx(
+            Z_nnc.diagonal(), abs=1e-11)
+        assert value == pytest.approx((abs(Z_nnc.diagonal())**2).sum())
+
+    assert values[1] == pytest.approx(values[0], rel=1e-3)
@@ -11,7 +11,7 @@ import time
 from contextlib import contextmanager
 from math import sqrt
 from pathlib import Path
-from typing import Union
+from typing import Sequence, Union
 
 import numpy as np
 from ase import Atoms
@@ -283,6 +283,75 @@ def unpack_density(M):
     return M2
 
 
+def pack_many(A_xM: np.ndarray,
+              ni_a: Sequence[int],
+              out: Union[np.ndarray, None] = None,
+              *,
+              density: bool = False,
+              add: bool = False) -> np.ndarray:
+    """Pack matrices of many atoms in one go.
+
+    The ``ni x ni`` matrices of the atoms are stored one after the other
+    along the last axis of ``A_xM`` (like ``AtomArrays.data``) and the
+    packed matrices are written the same way to ``out``.  Packing is done
+    as in ``pack_density()`` or ``pack_hermitian()`` (no symmetry check).
+    With ``add=True``, the packed matrices are added to ``out``.
+    """
+    A_xM = np.ascontiguousarray(A_xM)
+    n_a = np.asarray(ni_a, dtype=np.int64)
+    assert A_xM.shape[-1] == (n_a**2).sum()
+    if out is None:
+        assert not add
+        out = np.empty(A_xM.shape[:-1] + ((n_a * (n_a + 1) // 2).sum(),),
+                       A_xM.dtype)
+    assert is_contiguous(out, A_xM.dtype)
+    assert out.shape[:-1] == A_xM.shape[:-1]
+    cgpaw.pack_many(A_xM, n_a, out, density, add)
+    return out
+
+
+def unpack_many(P_xP: np.ndarray,
+                ni_a: Sequence[int],
+                out: Union[np.ndarray, None] = None,
+                *,
+                density: bool = False) -> np.ndarray:
+    """Unpack matrices of many atoms in one go.
+
+    Inverse of ``pack_many()``.
+    """
+    P_xP = np.ascontiguousarray(P_xP)
+    n_a = np.asarray(ni_a, dtype=np.int64)
+    assert P_xP.shape[-1] == (n_a * (n_a + 1) // 2).sum()
+    if out is None:
+        out = np.empty(P_xP.shape[:-1] + ((n_a**2).sum(),), P_xP.dtype)
+    assert is_contiguous(out, P_xP.dtype)
+    assert out.shape[:-1] == P_xP.shape[:-1]
+    cgpaw.unpack_many(P_xP, n_a, out, density)
+    return out
+
+
+def packed_dot(A_xP: np.ndarray,
+               B_xP: np.ndarray,
+               ni_a: Sequence[int],
+               *,
+               density: bool = False) -> np.ndarray:
+    """Calculate sum_xij A_xij B_xij for each atom from packed matrices.
+
+    Both matrices must be Hermitian and ``B_xP`` packed as in
+    ``pack_hermitian()``.  ``A_xP`` is packed the same way or, if
+    ``density=True``, as in ``pack_density()`` (real matrices only).
+    Returns the real part of the sums, one number per atom.
+    """
+    n_a = np.asarray(ni_a, dtype=np.int64)
+    assert is_contiguous(A_xP) and is_contiguous(B_xP, A_xP.dtype)
+    assert A_xP.shape == B_xP.shape
+    assert A_xP.shape[-1] == (n_a * (n_a + 1) // 2).sum()
+    assert not (density and A_xP.dtype == complex)
+    out_a = np.empty(len(n_a))
+    cgpaw.packed_dot(A_xP, B_xP, n_a, out_a, density)
+    return out_a
+
+
 for method in (pack_hermitian, unpack_hermitian, pack_density, pack_density):
     method.__doc__ += packing_conventions  # type: ignore
 
@@ -34,9 +34,15 @@ def localize(overlaps: WannierOverlaps,
         print('iter      value     change')
         print('---- ---------- ----------')
 
+    # The round-robin sweeps only pay off with several OpenMP threads:
+    if cgpaw.get_num_threads() > 1:
+        sweep = cgpaw.localize_parallel
+    else:
+        sweep = cgpaw.localize
+
     old = 0.0
     for iter in range(maxiter):
-        value = cgpaw.localize(Z_nnc, U_nn)
+        value = sweep(Z_nnc, U_nn)
         if verbose:
             print(f'{iter:4} {value:10.3f} {value - old:10.6f}')
         if value - old < tolerance:
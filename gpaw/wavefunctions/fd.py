@@ -95,9 +95,10 @@ class FDWaveFunctions(FDPWWaveFunctions):
     def add_to_density_from_k_point_with_occupation(self, nt_sG, kpt, f_n):
         # Used in calculation of response part of GLLB-potential
         nt_G = nt_sG[kpt.s]
-        for f, psit_G in zip(f_n, kpt.psit_nG):
-            # Same as nt_G += f * abs(psit_G)**2, but much faster:
-            cgpaw.add_to_density(f, psit_G, nt_G)
+        nbands = min(len(f_n), len(kpt.psit_nG))
+        # Same as nt_G += f * abs(psit_G)**2 for all bands, but much faster:
+        cgpaw.add_to_density_batch(np.asarray(f_n[:nbands], float),
+                                   kpt.psit_nG[:nbands], nt_G)
 
         # Hack used in delta-scf calculations:
         if hasattr(kpt, 'c_on'):
@@ -184,9 +185,8 @@ class FDWaveFunctions(FDPWWaveFunctions):
                 # Transform wave functions using symmetry operation:
                 Psit_nG = self.gd.collect(kpt.psit_nG)
                 if Psit_nG is not None:
-                    Psit_nG = Psit_nG.copy()
-                    for Psit_G in Psit_nG:
-                        Psit_G[:] = self.kd.transform_wave_function(Psit_G, k)
+                    Psit_nG = self.kd.transform_wave_function(Psit_nG,
+                                                              k).copy()
                 kpt2.psit = UniformGridWaveFunctions(
                     self.bd.nbands, self.gd, self.dtype,
                     kpt=k, dist=(self.bd.comm, self.bd.comm.size),
@@ -291,15 +291,39 @@ class VDWFunctionalBase:
         self.Ecnl = Ecnl
         return Ecnl
 
+    @property
+    def phi_ij(self):
+        """Kernel table (delta_i x D_j), one copy per node."""
+        self.load_table()
+        return self._phi_ij
+
+    def load_table(self):
+        """Read the kernel table into memory shared on each node.
+
+        Must be called by all ranks of self.world."""
+        if self._phi_ij is None:
+            self._phi_ij = mpi.share_on_node(
+                lambda: np.loadtxt(self.table_file), self.world)
+
+    def free_table(self):
+        """Release the kernel table.
+
+        Must be called by all ranks of self.world."""
+        if self._phi_ij is not None:
+            mpi.free_shared(self._phi_ij)
+            self._phi_ij = None
+
     def read_table(self):
         name = (f'phi-{self.phi0:.3f}-{self.ds:.3f}-{self.D_j[-1]:.3f}'
                 f'-{len(self.delta_i):d}-{len(self.D_j):d}.txt')
         dirs = setup_paths + ['.']
 
+        self._phi_ij = None
         for dir in dirs:
             filename = os.path.join(dir, name)
             if os.path.isfile(filename):
-                self.phi_ij = np.loadtxt(filename)
+                # Read on first use (see phi_ij):
+                self.table_file = filename
                 if self.verbose:
                     print('VDW: using', filename)
                 return
@@ -312,7 +336,8 @@ class VDWFunctionalBase:
         print('VDW:', end=' ')
         ndelta = len(self.delta_i)
         nD = len(self.D_j)
-        self.phi_ij = np.zeros((ndelta, nD))
+        self.table_file = name
+        self._phi_ij = np.zeros((ndelta, nD))
         for i in range(self.world.rank, ndelta, self.world.size):
             print(ndelta - i, end=' ')
             sys.stdout.flush()
@@ -393,7 +418,8 @@ class VDWFunctionalBase:
 
 class RealSpaceVDWFunctional(VDWFunctionalBase):
     """Real-space implementation of vdW-DF."""
-    def __init__(self, repeat=None, ncut=0.0005, **kwargs):
+    def __init__(self, repeat=None, ncut=0.0005, rcut=None, check=False,
+                 **kwargs):
         """Real-space vdW-DF.
 
         parameters:
@@ -402,11 +428,22 @@ class RealSpaceVDWFunctional(VDWFunctionalBase):
             Repeat the unit cell.
         ncut: float
             Density cutoff.
+        rcut: float
+            Use a cell list and evaluate the kernel exactly only for
+            pairs closer than rcut (in Bohr).  More distant pairs are
+            grouped in boxes and treated with the asymptotic form of the
+            kernel.  Default is to do the full double sum.
+        check: bool
+            Also do the full double sum and store the error of the
+            cell-list result in self.cutoff_error.
         """
 
         VDWFunctionalBase.__init__(self, **kwargs)
         self.repeat = repeat
         self.ncut = ncut
+        self.rcut = rcut
+        self.check = check
+        self.cutoff_error = None
 
     def calculate_6d_integral(self, n_g, q0_g,
                               a2_g=None, e_LDAc_g=None, v_LDAc_g=None,
@@ -434,45 +471,37 @@ class RealSpaceVDWFunctional(VDWFunctionalBase):
         if self.verbose:
             print('VDW: number of points:', ni)
 
-        # Number of pairs per processor:
         world = self.world
-        p = ni * (ni - 1) // 2 // world.size
-
-        # When doing supercell, the pairs are not that important
-        if np.any(self.repeat):  # XXX This can be further optimized
-            iA = world.rank * (ni // world.size)
-            iB = (world.rank + 1) * (ni // world.size)
-        else:
-            iA = 0
-            for r in range(world.size):
-                iB = iA + int(0.5 - iA + sqrt((iA - 0.5)**2 + 2 * p))
-                if r == world.rank:
-                    break
-                iA = iB
-
-        assert iA <= iB
-
-        if world.rank == world.size - 1:
-            iB = ni
 
         if self.repeat is None:
             repeat_c = np.zeros(3, int)
         else:
             repeat_c = np.asarray(self.repeat, int)
 
+        args = (n_i, q0_i, R_ic, gd.cell_cv.diagonal().copy(), gd.pbc_c,
+                repeat_c, self.phi_ij, self.delta_i[1], self.D_j[1])
+
         self.rhistogram = np.zeros(200)
         self.Dhistogram = np.zeros(200)
         dr = 0.05
         dD = 0.05
         if self.verbose:
             start = time.time()
-        E_vdwnl = cgpaw.vdw(n_i, q0_i, R_ic, gd.cell_cv.diagonal().copy(),
-                            gd.pbc_c,
-                            repeat_c,
-                            self.phi_ij, self.delta_i[1], self.D_j[1],
-                            iA, iB,
-                            self.rhistogram, dr,
-                            self.Dhistogram, dD)
+        if self.rcut is None:
+            iA, iB = self.distribute_pairs(ni)
+            E_vdwnl = cgpaw.vdw(*args, iA, iB,
+                                self.rhistogram, dr,
+                                self.Dhistogram, dD)
+        else:
+            # All partners are visited for each point, so the points
+            # can be distributed evenly:
+            iA = world.rank * ni // world.size
+            iB = (world.rank + 1) * ni // world.size
+            E_near, E_far = cgpaw.vdw_cells(*args, iA, iB,
+                                            self.rhistogram, dr,
+                                            self.Dhistogram, dD,
+                                            self.rcut)
+            E_vdwnl = E_near + E_far
         end = time.time()
         if self.verbose:
             print("vdW in rank ", world.rank, 'took', end - start)
@@ -482,8 +511,46 @@ class RealSpaceVDWFunctional(VDWFunctionalBase):
         self.world.sum(self.rhistogram)
         self.world.sum(self.Dhistogram)
         E_vdwnl = self.world.sum(E_vdwnl * gd.dv**2)
+
+        if self.rcut is not None and self.check:
+            iA, iB = self.distribute_pairs(ni)
+            E_exact = cgpaw.vdw(*args, iA, iB,
+                                np.zeros(200), dr, np.zeros(200), dD)
+            E_exact = self.world.sum(E_exact * gd.dv**2)
+            self.cutoff_error = E_vdwnl - E_exact
+            if self.verbose:
+                print('VDW: cell-list error: {:.3e} Ha (exact: {:.9f} Ha)'
+                      .format(self.cutoff_error, E_exact))
+
         return E_vdwnl
 
+    def distribute_pairs(self, ni):
+        """Find range of points i1 such that the pairs i2 <= i1 are
+        distributed evenly among the processors."""
+        world = self.world
+
+        # Number of pairs per processor:
+        p = ni * (ni - 1) // 2 // world.size
+
+        # When doing supercell, the pairs are not that important
+        if np.any(self.repeat):  # XXX This can be further optimized
+            iA = world.rank * (ni // world.size)
+            iB = (world.rank + 1) * (ni // world.size)
+        else:
+            iA = 0
+            for r in range(world.size):
+                iB = iA + int(0.5 - iA + sqrt((iA - 0.5)**2 + 2 * p))
+                if r == world.rank:
+                    break
+                iA = iB
+
+        assert iA <= iB
+
+        if world.rank == world.size - 1:
+            iB = ni
+
+        return iA, iB
+
 
 class FFTVDWFunctional(VDWFunctionalBase):
     """FFT implementation of vdW-DF."""
@@ -516,7 +583,7 @@ class FFTVDWFunctional(VDWFunctionalBase):
         self.size = size
 
         self.C_aip = None
-        self.phi_aajp = None
+        self.phi_jabp = None
 
         self.get_alphas()
 
@@ -623,7 +690,6 @@ class FFTVDWFunctional(VDWFunctionalBase):
         return a + dq * (b + dq * (c + dq * d))
 
     def construct_fourier_transformed_kernels(self):
-        self.phi_aajp = phi_aajp = {}
         M = self.Nr
         rcut = self.rcut
         r_g = np.linspace(0, rcut, M, 0)
@@ -633,16 +699,26 @@ class FFTVDWFunctional(VDWFunctionalBase):
             print(f'VDW: cutoff for fft\'ed kernel: '
                   f'{(0.5 * k_j[-1]**2):.3f} Hartree')
 
+        # Layout for cgpaw.vdw2_batch(): all (a, b) splines for one
+        # k-point in one contiguous block (b runs over self.alphas only):
+        B_a = {a: B for B, a in enumerate(self.alphas)}
+        self.phi_jabp = np.empty((M // 2, self.Nalpha, len(self.alphas), 4))
         for a in range(self.Nalpha):
             qa = self.q_a[a]
             for b in range(a, self.Nalpha):
+                if a not in B_a and b not in B_a:
+                    continue
                 qb = self.q_a[b]
                 phi_g = [self.phi(qa * r, qb * r) for r in r_g]
                 phi_j = (fft(r_g * phi_g * 1j).real[:M // 2] *
                          (rcut / M * 4 * pi))
                 phi_j[0] = np.dot(r_g, r_g * phi_g) * (rcut / M * 4 * pi)
                 phi_j[1:] /= k_j[1:]
-                phi_aajp[a, b] = phi_aajp[b, a] = spline(k_j, phi_j)
+                phi_jp = spline(k_j, phi_j)
+                if b in B_a:
+                    self.phi_jabp[:, a, B_a[b]] = phi_jp
+                if a in B_a:
+                    self.phi_jabp[:, b, B_a[a]] = phi_jp
 
     def set_grid_descriptor(self, gd):
         if self.size is None:
@@ -669,7 +745,10 @@ class FFTVDWFunctional(VDWFunctionalBase):
         if self.C_aip is None:
             self.initialize_more_things()
             self.construct_cubic_splines()
+            self.load_table()
             self.construct_fourier_transformed_kernels()
+            # The kernel table is only needed for phi_jabp:
+            self.free_table()
         self.timer.stop('splines')
 
         gd = self.gd
@@ -691,7 +770,10 @@ class FFTVDWFunctional(VDWFunctionalBase):
         if self.verbose:
             print('VDW: fft:', end=' ')
 
-        theta_ak = {}
+        # theta_ak[a] are views into theta_bk used by cgpaw.vdw2_batch():
+        shape_k = (self.shape[0], self.shape[1], self.shape[2] // 2 + 1)
+        theta_bk = np.empty((len(self.alphas),) + shape_k, complex)
+        theta_ak = dict(zip(self.alphas, theta_bk))
         p_ag = {}
         for a in self.alphas:
             self.timer.start('hmm2')
@@ -702,7 +784,7 @@ class FFTVDWFunctional(VDWFunctionalBase):
             self.timer.stop('hmm2')
             del C_pg
             self.timer.start('FFT')
-            theta_ak[a] = rfftn(n_g * pa_g, self.shape).copy()
+            theta_ak[a][:] = rfftn(n_g * pa_g, self.shape)
             self.timer.stop()
 
             if not self.energy_only:
@@ -720,40 +802,43 @@ class FFTVDWFunctional(VDWFunctionalBase):
             print()
             print('VDW: convolution:', end=' ')
 
+        # Convolve blocks of alphas, using at most about 128 MB for F_bk:
+        nblock = max(1, min(N, 2**27 // (16 * int(np.prod(shape_k)))))
         F_ak = {}
-        dj_k = self.dj_k
         energy = 0.0
-        for a in range(N):
-            if vdwcomm is not None:
-                vdw_ranka = a * vdwcomm.size // N
-                F_k = np.zeros((self.shape[0],
-                                self.shape[1],
-                                self.shape[2] // 2 + 1), complex)
+        for a1 in range(0, N, nblock):
+            a2 = min(a1 + nblock, N)
+            F_bk = np.zeros((a2 - a1,) + shape_k, complex)
             self.timer.start('Convolution')
-            for b in self.alphas:
-                cgpaw.vdw2(self.phi_aajp[a, b], self.j_k, dj_k,
-                           theta_ak[b], F_k)
+            if self.alphas:
+                cgpaw.vdw2_batch(self.phi_jabp, self.j_k, self.dj_k,
+                                 theta_bk, F_bk, a1)
             self.timer.stop()
 
-            if vdwcomm is not None:
-                self.timer.start('gather')
-                for F in F_k:
-                    vdwcomm.sum(F, vdw_ranka)
-                self.timer.stop('gather')
+            for a, F_k in enumerate(F_bk, a1):
+                if vdwcomm is not None:
+                    vdw_ranka = a * vdwcomm.size // N
+                    self.timer.start('gather')
+                    for F in F_k:
+                        vdwcomm.sum(F, vdw_ranka)
+                    self.timer.stop('gather')
+
+                if vdwcomm is not None and vdwcomm.rank == vdw_ranka:
+                    if not self.energy_only:
+                        F_ak[a] = F_k.copy()
+                    energy += np.vdot(theta_ak[a][:, :, 0],
+                                      F_k[:, :, 0]).real
+                    energy += np.vdot(theta_ak[a][:, :, -1],
+                                      F_k[:, :, -1]).real
+                    energy += 2 * np.vdot(theta_ak[a][:, :, 1:-1],
+                                          F_k[:, :, 1:-1]).real
 
-            if vdwcomm is not None and vdwcomm.rank == vdw_ranka:
-                if not self.energy_only:
-                    F_ak[a] = F_k
-                energy += np.vdot(theta_ak[a][:, :, 0], F_k[:, :, 0]).real
-                energy += np.vdot(theta_ak[a][:, :, -1], F_k[:, :, -1]).real
-                energy += 2 * np.vdot(theta_ak[a][:, :, 1:-1],
-                                      F_k[:, :, 1:-1]).real
-
-            if self.verbose:
-                print(a, end=' ')
-                sys.stdout.flush()
+                if self.verbose:
+                    print(a, end=' ')
+                    sys.stdout.flush()
+            del F_bk
 
-        del theta_ak
+        del theta_ak, theta_bk
 
         if self.verbose:
             print()
@@ -73,6 +73,7 @@ mpi = None
 noblas = False
 nolibxc = False
 fftw = False
+fftw_threads = False
 scalapack = False
 libvdwxc = False
 elpa = False
@@ -219,6 +220,7 @@ for flag, name in [(noblas, 'GPAW_WITHOUT_BLAS'),
                    (nolibxc, 'GPAW_WITHOUT_LIBXC'),
                    (mpi, 'PARALLEL'),
                    (fftw, 'GPAW_WITH_FFTW'),
+                   (fftw and fftw_threads, 'GPAW_FFTW_THREADS'),
                    (scalapack, 'GPAW_WITH_SL'),
                    (libvdwxc, 'GPAW_WITH_LIBVDWXC'),
                    (elpa, 'GPAW_WITH_ELPA'),
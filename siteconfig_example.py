@@ -42,6 +42,9 @@ if mpi:
 fftw = True
 if fftw:
     libraries += ['fftw3']
+    # Multithreaded FFTW plans (when compiling with OpenMP):
+    # fftw_threads = True
+    # libraries += ['fftw3_omp']
 
 # ScaLAPACK (version 2.0.1+ required):
 scalapack = True